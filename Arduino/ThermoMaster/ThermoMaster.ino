@@ -82,6 +82,20 @@ float lCmd = 0,     rCmd = 0;
 
 float tRef;
 
+// --- Setpoint ramp
+boolean bRamp = false;
+float lRamp0 = 28,  rRamp0 = 28;
+float lRamp1 = 28,  rRamp1 = 28;
+unsigned long tRamp0 = 0;
+unsigned long dRamp = 0;
+
+// --- Relay autotune
+boolean bTune = false;
+char tuneZone = 'L';
+float tuneAmp = 150;
+float tuneHyst = 0.1;
+float lRelay = 0,   rRelay = 0;
+
 // --- INITIALIZATIONS ------------------------------------------------
 
 // --- Thermocouples
@@ -175,7 +189,8 @@ void loop() {
     
   if (Serial.available()) {   
   
-    String cmd = Serial.readString();
+    // One newline-terminated command per iteration; the rest stays buffered
+    String cmd = Serial.readStringUntil('\n');
     cmd.trim();
       
     // --- Identifier
@@ -227,7 +242,37 @@ void loop() {
       lErrInt = ErrIntTime*lErr;
       rErrInt = ErrIntTime*rErr;
     }
-    if (cmd.equals("stop")) { bRegul = false; bDirect = false; }
+    if (cmd.equals("stop")) {
+      bRegul = false;
+      bDirect = false;
+      if (bTune) { Serial.println("Autotune stopped"); }
+      bTune = false;
+      lRelay = 0;
+      rRelay = 0;
+    }
+
+    // --- Relay autotune: "tune <L|R> <amplitude> <hysteresis>" or "tune stop"
+    if (cmd.substring(0,4).equals("tune")) {
+      
+      if (cmd.substring(5).equals("stop")) {
+
+        bTune = false;
+        Serial.println("Autotune stopped");
+        
+      } else {
+
+        int k = cmd.indexOf(' ', 7);
+        tuneZone = cmd.charAt(5);
+        tuneAmp = cmd.substring(7, k).toFloat();
+        tuneHyst = cmd.substring(k+1).toFloat();
+        bTune = true;
+        bDirect = false;
+        lRelay = 0;
+        rRelay = 0;
+        Serial.println("Autotune " + String(tuneZone) + " relay " + String(tuneAmp) + " hysteresis " + String(tuneHyst));
+        
+      }
+    }
 
     if (cmd.substring(0,1).equals("P")) { Pcoeff = cmd.substring(2).toFloat(); }
     if (cmd.substring(0,1).equals("I")) { Icoeff = cmd.substring(2).toFloat(); }
@@ -252,9 +297,30 @@ void loop() {
       Serial.print(lTarget);
       Serial.print(" - ");
       Serial.println(rTarget);
+
+      // A new setpoint cancels any ramp
+      bRamp = false;
       
     }
 
+    // --- Linear ramp of the targets: "ramp <left> <right> <duration ms>"
+    if (cmd.substring(0,4).equals("ramp")) {
+
+      int k1 = cmd.indexOf(' ', 5);
+      int k2 = cmd.indexOf(' ', k1+1);
+
+      lRamp0 = lTarget;
+      rRamp0 = rTarget;
+      lRamp1 = cmd.substring(5, k1).toFloat();
+      rRamp1 = cmd.substring(k1+1, k2).toFloat();
+      dRamp = cmd.substring(k2+1).toInt();
+      tRamp0 = millis();
+      bRamp = true;
+
+      Serial.println("Ramp to " + String(lRamp1) + " - " + String(rRamp1) + " in " + String(dRamp) + " ms");
+
+    }
+
   }
 
   // === MEASUREMENT =================================================
@@ -263,16 +329,35 @@ void loop() {
   float rTemp = rTC.readThermocoupleTemperature();
   unsigned long t = micros();
 
-  // Send data to the program
+  // Send data to the program; the line ends after the control, with the
+  // relay state when autotuning. Full resolution: the host identifies
+  // the zones from these values.
   Serial.print("Data ");   
   Serial.print(t);
   Serial.print(" ");
-  Serial.print(lTemp);
+  Serial.print(lTemp, 4);
   Serial.print(" ");
-  Serial.println(rTemp);
+  Serial.print(rTemp, 4);
 
   // === CONTROL ====================================================
 
+  // --- Setpoints interpolated at every iteration of the ramp
+  if (bRamp) {
+
+    unsigned long el = millis() - tRamp0;
+
+    if (el>=dRamp) {
+      lTarget = lRamp1;
+      rTarget = rRamp1;
+      bRamp = false;
+    } else {
+      float f = (float) el/dRamp;
+      lTarget = lRamp0 + f*(lRamp1-lRamp0);
+      rTarget = rRamp0 + f*(rRamp1-rRamp0);
+    }
+    
+  }
+
   // --- Get errors
   lErr = lTarget - lTemp;
   rErr = rTarget - rTemp;
@@ -301,6 +386,29 @@ void loop() {
       rCmd = 0;
       
   }
+
+  // --- Relay feedback overrides the zone under autotuning
+  if (bTune) {
+    
+    if (tuneZone=='L') {
+      if (lErr>tuneHyst) { lRelay = tuneAmp; }
+      if (lErr<-tuneHyst) { lRelay = -tuneAmp; }
+      lCmd = lRelay;
+    } else {
+      if (rErr>tuneHyst) { rRelay = tuneAmp; }
+      if (rErr<-tuneHyst) { rRelay = -tuneAmp; }
+      rCmd = rRelay;
+    }
+    
+  }
+
+  // --- End of the Data line
+  if (bTune) {
+    float relay = tuneZone=='L' ? lRelay : rRelay;
+    Serial.print(" ");
+    Serial.print(relay>0 ? 1 : relay<0 ? -1 : 0);
+  }
+  Serial.println();
   
   // --- Apply commands
   if (lCmd>=0) {                    // Left, heat
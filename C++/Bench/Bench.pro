@@ -0,0 +1,43 @@
+#-------------------------------------------------
+#
+# ThermoMaster benchmarks
+#
+#-------------------------------------------------
+
+QT       += core gui widgets printsupport
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = Bench
+TEMPLATE = app
+
+# Grayscale16 frames, as in ThermoRig.pri
+lessThan(QT_MAJOR_VERSION, 6):lessThan(QT_MINOR_VERSION, 13): error("Bench needs Qt 5.13 or later (QImage::Format_Grayscale16)")
+
+include(../ThermoMaster/ThermoCore.pri)
+
+# Recording and plot classes of the GUI, without the camera SDK
+SOURCES += main.cpp \
+    Pipeline.cpp \
+    ../ThermoMaster/Recorder.cpp \
+    ../ThermoMaster/EncoderPool.cpp \
+    ../ThermoMaster/FrameStage.cpp \
+    ../ThermoMaster/Tracker.cpp \
+    ../ThermoMaster/TimeSeries.cpp \
+    ../ThermoMaster/MinMaxPyramid.cpp \
+    ../ThermoMaster/qcustomplot.cpp
+
+HEADERS  += Pipeline.h \
+    ../ThermoMaster/Recorder.h \
+    ../ThermoMaster/EncoderPool.h \
+    ../ThermoMaster/FrameStage.h \
+    ../ThermoMaster/Tracker.h \
+    ../ThermoMaster/TimeSeries.h \
+    ../ThermoMaster/MinMaxPyramid.h \
+    ../ThermoMaster/qcustomplot.h
+
+# "make bench" builds and runs the suite, results in bench-results.json
+bench.commands = ./$$TARGET -o bench-results.json
+bench.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += bench
@@ -0,0 +1,96 @@
+#include "Pipeline.h"
+#include "FrameKernels.h"
+
+#include <QThread>
+#include <random>
+
+/* =================================================================== *\
+|    Synthetic_Camera Class                                             |
+\* =================================================================== */
+
+Synthetic_Camera::Synthetic_Camera(int w, int h, double fps, double duration, const QElapsedTimer *clock) {
+
+    W = w;
+    H = h;
+    Fps = fps;
+    Duration = duration;
+    Clock = clock;
+    Produced = 0;
+
+    // A few noisy frames, so that the disk does not see identical data
+    std::mt19937 Gen(42);
+    std::uniform_int_distribution<int> Noise(0, 63);
+    for (int k=0; k<4; k++) {
+        QByteArray B(W*H, 0);
+        for (int i=0; i<B.size(); i++) { B[i] = (char) (96 + Noise(Gen)); }
+        Sources.append(B);
+    }
+
+}
+
+void Synthetic_Camera::run() {
+
+    qint64 n = qRound64(Fps*Duration);
+    qint64 t0 = Clock->nsecsElapsed();
+
+    QVector<QRgb> Colors(256);
+    uchar Lut[256];
+
+    for (qint64 i=0; i<n; i++) {
+
+        // --- Pacing
+        qint64 deadline = t0 + qRound64(i*1e9/Fps);
+        qint64 wait = deadline - Clock->nsecsElapsed();
+        if (wait>0) { QThread::usleep(wait/1000); }
+
+        // --- Same work as the acquisition thread
+        const uchar *Raw = (const uchar*) Sources[i & 3].constData();
+        double mean = frameMean(Raw, (qint64) W*H);
+
+        QImage Img(W, H, QImage::Format_Indexed8);
+        mirrorFrame(Raw, W, Img.bits(), Img.bytesPerLine(), W, H);
+        normalizationTable(Lut, 128, mean);
+        for (int k=0; k<256; k++) { Colors[k] = qRgb(Lut[k], Lut[k], Lut[k]); }
+        Img.setColorTable(Colors);
+
+        Produced.fetchAndAddOrdered(1);
+        emit frame(Img, Clock->nsecsElapsed());
+
+    }
+
+    emit finished();
+
+}
+
+/* =================================================================== *\
+|    Pipeline_Sink Class                                                |
+\* =================================================================== */
+
+Pipeline_Sink::Pipeline_Sink(Recorder *R, const QElapsedTimer *clock, const Synthetic_Camera *cam) {
+
+    Rec = R;
+    Clock = clock;
+    Cam = cam;
+    Written = 0;
+    Consumed = 0;
+    MaxBacklog = 0;
+    LastWrite = 0;
+
+}
+
+void Pipeline_Sink::frame(QImage Img, qint64 t) {
+
+    MaxBacklog = qMax(MaxBacklog, (qint64) Cam->Produced.load() - Consumed);
+    Consumed++;
+
+    // A sample at the frame time, which releases it at once
+    Temperature_Sample T = { t, 25.0, 25.0, 0, 0 };
+    qint64 n = Rec->nFrame;
+    Rec->addTemperatures(T);
+    Rec->write(Img, t, t);
+    Written += Rec->nFrame-n;
+
+    LastWrite = Clock->nsecsElapsed();
+    Latency.append((LastWrite-t)/1e6);
+
+}
@@ -0,0 +1,78 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QObject>
+#include <QImage>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+
+#include "Recorder.h"
+
+/* =================================================================== *\
+|    Synthetic_Camera Class                                             |
+\* =================================================================== */
+
+// Stands for LowLevel_FLIR in its own thread: paces frames on absolute
+// deadlines and does the same per-frame work as grab() (mean, mirror,
+// palette) on pre-generated noise, with a fixed seed.
+
+class Synthetic_Camera : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Synthetic_Camera(int w, int h, double fps, double duration, const QElapsedTimer *clock);
+
+    QAtomicInteger<qint64> Produced;
+
+public slots:
+
+    void run();
+
+signals:
+
+    void frame(QImage, qint64);         // Image, time on the shared clock (ns)
+    void finished();
+
+private:
+
+    int W, H;
+    double Fps, Duration;
+    const QElapsedTimer *Clock;
+    QVector<QByteArray> Sources;
+
+};
+
+/* =================================================================== *\
+|    Pipeline_Sink Class                                                |
+\* =================================================================== */
+
+// Consumer side, in the main thread as in the GUI: every frame goes
+// through Recorder::write(), and the delivery latency is sampled.
+
+class Pipeline_Sink : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Pipeline_Sink(Recorder *R, const QElapsedTimer *clock, const Synthetic_Camera *cam);
+
+    qint64 Written, Consumed, MaxBacklog, LastWrite;
+    QVector<double> Latency;            // ms
+
+public slots:
+
+    void frame(QImage, qint64);
+
+private:
+
+    Recorder *Rec;
+    const QElapsedTimer *Clock;
+    const Synthetic_Camera *Cam;
+
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,622 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QSysInfo>
+#include <QThread>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QRegExp>
+#include <QVector>
+#include <QDebug>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "MsgHandler.h"
+#include "SerialParser.h"
+#include "FrameKernels.h"
+#include "TimeSeries.h"
+#include "MinMaxPyramid.h"
+#include "Recorder.h"
+#include "TemperatureBuffer.h"
+#include "ClockSync.h"
+#include "Tracker.h"
+#include "Pipeline.h"
+#include "Trace.h"
+#include "Metrics.h"
+
+using namespace std;
+
+/* =================================================================== *\
+|    Bench                                                              |
+\* =================================================================== */
+
+// Benchmarks of the ThermoMaster hot paths, and of the acquisition to
+// disk pipeline. Microbenchmarks report the cost per operation (ns), as
+// the median of Repeats runs; all inputs come from fixed seeds. Results
+// are also written as JSON, to compare builds.
+
+static const int nMsg = 200000;
+static int Repeats = 5;
+static QString Filter;
+static QJsonArray Results;
+
+static bool selected(const char *name) { return Filter.isEmpty() || QString(name).contains(Filter); }
+
+static void report(const char *name, qint64 ns, int n) {
+
+    cout << name << "\t" << (double) ns/n << " ns" << endl;
+
+    QJsonObject R;
+    R["name"] = name;
+    R["ns_per_op"] = (double) ns/n;
+    R["ops"] = n;
+    Results.append(R);
+
+}
+
+// Median of Repeats runs of f, after one warm-up run
+static void measure(const char *name, int n, const std::function<void()> &f) {
+
+    if (!selected(name)) { return; }
+
+    f();
+    QVector<qint64> T;
+    QElapsedTimer Timer;
+    for (int r=0; r<Repeats; r++) {
+        Timer.start();
+        f();
+        T.append(Timer.nsecsElapsed());
+    }
+    std::sort(T.begin(), T.end());
+    report(name, T[T.size()/2], n);
+
+}
+
+// The queue is drained regularly, as the GUI timer does
+static void drain() {
+
+    Message MSG;
+    while (Messages.pop(MSG)) {}
+
+}
+
+/* === Logging ======================================================= */
+
+// Former handler: one QRegExp per message, pushed in a QVector
+static QVector<Message> Legacy;
+
+static void legacyHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+
+    Message MSG;
+    MSG.type = type;
+
+    QRegExp rx("css\\{(.*)\\}(.*)");
+    if (rx.indexIn(msg)==-1) {
+        MSG.css = QString("p");
+        MSG.text = msg;
+    } else {
+        MSG.css = rx.cap(1);
+        MSG.text = rx.cap(2).trimmed();
+    }
+
+    Legacy.push_back(MSG);
+
+}
+
+static void benchLogging() {
+
+    if (!selected("log/")) { return; }
+
+    QElapsedTimer T;
+
+    // --- Legacy handler
+    qInstallMessageHandler(legacyHandler);
+    T.start();
+    for (int i=0; i<nMsg; i++) {
+        if (i%4) { qInfo() << "Frame" << i; }
+        else { qInfo() << TITLE_2 << "Step" << i; }
+        if (Legacy.size()>=1024) { Legacy.clear(); }
+    }
+    report("log/legacy_regex", T.nsecsElapsed(), nMsg);
+
+    // --- Current handler, same calls
+    qInstallMessageHandler(MsgHandler);
+    T.start();
+    for (int i=0; i<nMsg; i++) {
+        if (i%4) { qInfo() << "Frame" << i; }
+        else { qInfo() << TITLE_2 << "Step" << i; }
+        if (!(i & 1023)) { drain(); }
+    }
+    report("log/qinfo_queue", T.nsecsElapsed(), nMsg);
+
+    // --- Structured records
+    T.start();
+    for (int i=0; i<nMsg; i++) {
+        Log().text("Frame").field("index", i).field("mean", 0.5*i);
+        if (!(i & 1023)) { drain(); }
+    }
+    report("log/structured", T.nsecsElapsed(), nMsg);
+    drain();
+
+    // --- Deferred formatting, paid by the sinks only
+    Message M;
+    M.text = "Frame";
+    M.fields[0].key = "index";
+    M.fields[0].type = Log_Field::Int;
+    M.fields[0].i = 42;
+    M.nFields = 1;
+
+    int len = 0;
+    T.start();
+    for (int i=0; i<nMsg; i++) { len += M.html().size(); }
+    report("log/format_html", T.nsecsElapsed(), nMsg);
+
+    T.start();
+    for (int i=0; i<nMsg; i++) { len += M.json().size(); }
+    report("log/format_json", T.nsecsElapsed(), nMsg);
+
+    if (Messages.takeDropped()) { cerr << "Messages were dropped during the benchmark" << endl; }
+    if (!len) { cerr << "Empty output" << endl; }
+
+}
+
+/* === Tracing ======================================================= */
+
+static void benchTrace() {
+
+    const int n = 1000000;
+
+    measure("trace/span_off", n, [&]() {
+        for (int i=0; i<n; i++) { TRACE_SPAN("bench"); }
+    });
+
+    // Enabled spans, within the per-thread cap
+    Trace::MaxEvents = 1LL << 40;
+    Trace::start();
+    measure("trace/span_on", n, [&]() {
+        for (int i=0; i<n; i++) { TRACE_SPAN("bench"); }
+    });
+    Trace::stop();
+
+}
+
+/* === Metrics ======================================================= */
+
+static void benchMetrics() {
+
+    const int n = 1000000;
+    Metric_Counter *C = Metrics::counter("bench_total", "Benchmark counter");
+    Metric_Histogram *H = Metrics::histogram("bench_seconds", "Benchmark histogram", Metrics::exponential(0.0005, 2, 12));
+
+    measure("metrics/counter", n, [&]() {
+        for (int i=0; i<n; i++) { C->add(); }
+    });
+
+    measure("metrics/histogram", n, [&]() {
+        for (int i=0; i<n; i++) { H->observe((i & 1023)*1e-5); }
+    });
+
+    volatile int sink = 0;
+    measure("metrics/scrape", 1000, [&]() {
+        for (int i=0; i<1000; i++) { sink = sink + Metrics::text().size(); }
+    });
+
+}
+
+/* === Frames ======================================================== */
+
+static void benchFrames(int w, int h) {
+
+    std::mt19937 Gen(7);
+    std::uniform_int_distribution<int> Noise(0, 255);
+    QByteArray Raw(w*h, 0);
+    for (int i=0; i<Raw.size(); i++) { Raw[i] = (char) Noise(Gen); }
+    const uchar *p = (const uchar*) Raw.constData();
+
+    const int n = 200;
+    volatile double sink = 0;
+    uchar Lut[256];
+    QVector<QRgb> Colors(256);
+    QImage Img(w, h, QImage::Format_Indexed8);
+
+    measure("frame/mean", n, [&]() {
+        for (int i=0; i<n; i++) { sink = sink + frameMean(p, (qint64) w*h); }
+    });
+
+    measure("frame/palette", n, [&]() {
+        for (int i=0; i<n; i++) {
+            normalizationTable(Lut, 128, 100+i%50);
+            for (int k=0; k<256; k++) { Colors[k] = qRgb(Lut[k], Lut[k], Lut[k]); }
+            Img.setColorTable(Colors);
+        }
+    });
+
+    // Motion energy of both halves, against a shifted frame
+    measure("frame/sad", n, [&]() {
+        for (int i=0; i<n; i++) {
+            sink = sink + frameSad(p, p+w, w, w/2, h-1) + frameSad(p+w/2, p+w+w/2, w, w-w/2, h-1);
+        }
+    });
+
+    measure("frame/mirror", n, [&]() {
+        for (int i=0; i<n; i++) { mirrorFrame(p, w, Img.bits(), Img.bytesPerLine(), w, h); }
+    });
+
+    // Host-side binning, average of the blocks
+    QImage Binned(w/2, h/2, QImage::Format_Indexed8);
+    measure("frame/bin2", n, [&]() {
+        for (int i=0; i<n; i++) { binFrame(p, w, Binned.bits(), Binned.bytesPerLine(), w, h, 2, false); }
+    });
+
+    measure("frame/bin4", n, [&]() {
+        for (int i=0; i<n; i++) { binFrame(p, w, Binned.bits(), Binned.bytesPerLine(), w, h, 4, false); }
+    });
+
+    // What QPixmap::fromImage does on raster backends
+    measure("frame/display", n, [&]() {
+        for (int i=0; i<n; i++) { sink = sink + Img.convertToFormat(QImage::Format_RGB32).constBits()[i]; }
+    });
+
+    // --- 12-bit frames, from the packed layouts
+    QByteArray Packed(w*h*3/2, 0);
+    for (int i=0; i<Packed.size(); i++) { Packed[i] = (char) Noise(Gen); }
+    QVector<quint16> Levels(w*h);
+    QImage Deep(w, h, QImage::Format_Grayscale16);
+    QVector<uchar> Window(4096);
+    windowTable(Window.data(), 12, 200, 3000);
+    QByteArray Big(2*w*h, 0);
+
+    measure("frame/unpack12", n, [&]() {
+        for (int i=0; i<n; i++) { unpack12((const uchar*) Packed.constData(), Levels.data(), (qint64) w*h, i&1); }
+    });
+
+    measure("frame/mean16", n, [&]() {
+        for (int i=0; i<n; i++) { sink = sink + frameMean16(Levels.constData(), (qint64) w*h); }
+    });
+
+    measure("frame/sad16", n, [&]() {
+        const quint16 *q = Levels.constData();
+        for (int i=0; i<n; i++) {
+            sink = sink + frameSad16(q, q+w, w, w/2, h-1) + frameSad16(q+w/2, q+w+w/2, w, w-w/2, h-1);
+        }
+    });
+
+    measure("frame/mirror16", n, [&]() {
+        for (int i=0; i<n; i++) { mirrorFrame16(Levels.constData(), w, (quint16*) Deep.bits(), Deep.bytesPerLine()/2, w, h); }
+    });
+
+    measure("frame/window16", n, [&]() {
+        for (int i=0; i<n; i++) {
+            mapFrame16((const quint16*) Deep.constBits(), Deep.bytesPerLine()/2, Img.bits(), Img.bytesPerLine(), w, h, Window.constData(), 12);
+        }
+    });
+
+    measure("frame/big_endian16", n, [&]() {
+        for (int i=0; i<n; i++) { toBigEndian16(Levels.constData(), (uchar*) Big.data(), (qint64) w*h); }
+    });
+
+    measure("frame/bin2_16", n, [&]() {
+        for (int i=0; i<n; i++) { binFrame16(Levels.constData(), w, (quint16*) Big.data(), w/2, w, h, 2, false); }
+    });
+
+    measure("frame/bin4_16", n, [&]() {
+        for (int i=0; i<n; i++) { binFrame16(Levels.constData(), w, (quint16*) Big.data(), w/4, w, h, 4, false); }
+    });
+
+    (void) sink;
+
+}
+
+/* === Tracking ====================================================== */
+
+static void benchTracker(int w, int h) {
+
+    // Noisy background with 20 larvae: a head disk and a thin tail
+    std::mt19937 Gen(13);
+    std::uniform_int_distribution<int> Noise(190, 210), X(40, w-40), Y(40, h-40);
+    QByteArray Bg(w*h, 0), Frame;
+    for (int i=0; i<Bg.size(); i++) { Bg[i] = (char) Noise(Gen); }
+    Frame = Bg;
+    for (int k=0; k<20; k++) {
+        int cx = X(Gen), cy = Y(Gen);
+        for (int y=cy-4; y<=cy+4; y++) {
+            for (int x=cx-4; x<=cx+24; x++) {
+                if ((x-cx)*(x-cx)+(y-cy)*(y-cy)<=16 || (x>cx && qAbs(y-cy)<=1)) { Frame[y*w+x] = (char) 60; }
+            }
+        }
+    }
+
+    const int n = 200;
+    QVector<Larva_Blob> Blobs;
+    measure("tracker/detect", n, [&]() {
+        for (int i=0; i<n; i++) {
+            Tracker::detect((const uchar*) Frame.constData(), w, (const uchar*) Bg.constData(), w, h, 25, 20, 5000, Blobs);
+        }
+    });
+
+    // Same scene binned 2x2 for the analysis, binning included
+    int w2 = w/2, h2 = h/2;
+    QByteArray Bg2(w2*h2, 0), Frame2(w2*h2, 0);
+    binFrame((const uchar*) Bg.constData(), w, (uchar*) Bg2.data(), w2, w, h, 2, false);
+    measure("tracker/detect_bin2", n, [&]() {
+        for (int i=0; i<n; i++) {
+            binFrame((const uchar*) Frame.constData(), w, (uchar*) Frame2.data(), w2, w, h, 2, false);
+            Tracker::detect((const uchar*) Frame2.constData(), w2, (const uchar*) Bg2.constData(), w2, h2, 25, 5, 1250, Blobs);
+        }
+    });
+
+}
+
+/* === Serial ======================================================== */
+
+static void benchSerial() {
+
+    // Firmware output, read in chunks as they come from the port
+    QByteArray Stream;
+    std::mt19937 Gen(11);
+    std::uniform_real_distribution<double> T(15, 35);
+    const int nLines = 100000;
+    for (int i=0; i<nLines; i++) {
+        Stream += QString("Data %1 %2 %3\n").arg(i*20000).arg(T(Gen), 0, 'f', 2).arg(T(Gen), 0, 'f', 2).toLatin1();
+    }
+
+    measure("serial/parse", nLines, [&]() {
+        Line_Splitter Lines;
+        Serial_Sample S;
+        const char *begin, *end;
+        int ok = 0;
+        for (int i=0; i<Stream.size(); i+=64) {
+            Lines.append(Stream.mid(i, 64));
+            while (Lines.next(begin, end)) { ok += parseData(begin, end, S); }
+        }
+        if (ok!=nLines) { cerr << "serial/parse: " << ok << " samples parsed" << endl; }
+    });
+
+}
+
+/* === Temperatures ================================================== */
+
+static void benchTemperatures() {
+
+    // 50 Hz samples, frames at 100 Hz with the host jitter of a USB link
+    const int n = 1000000;
+    TemperatureBuffer Buffer(4096);
+    for (int i=0; i<4096; i++) {
+        Temperature_Sample S = { (qint64) i*20000000, 25+(i&255)/100.0, 30-(i&127)/100.0, 25, 30 };
+        Buffer.append(S);
+    }
+    qint64 t0 = Buffer.firstTime(), span = Buffer.lastTime()-t0;
+
+    measure("temperature/at", n, [&]() {
+        Temperature_Sample S;
+        double sum = 0;
+        for (int i=0; i<n; i++) { Buffer.at(t0 + (i*7919LL) % span, S); sum += S.TL; }
+        if (sum<=0) { cerr << "temperature/at" << endl; }
+    });
+
+    measure("temperature/next", n, [&]() {
+        Temperature_Sample S;
+        double sum = 0;
+        for (int i=0; i<n; i++) { Buffer.next(t0 + span*(double) i/n, S); sum += S.TL; }
+        if (sum<=0) { cerr << "temperature/next" << endl; }
+    });
+
+    std::mt19937 Gen(13);
+    std::exponential_distribution<double> Latency(1/200000.0);
+    measure("temperature/clock_sync", n, [&]() {
+        ClockSync Clock(1000, Q_INT64_C(4294967296));
+        qint64 offset = 0;
+        for (int i=0; i<n; i++) {
+            qint64 device = ((qint64) i*10000) % Q_INT64_C(4294967296);
+            offset = Clock.add(device, (qint64) i*10000000 + 1000000 + (qint64) Latency(Gen)) - (qint64) i*10000000;
+        }
+        if (qAbs(offset-1000000)>100000) { cerr << "temperature/clock_sync: offset " << offset << " ns" << endl; }
+    });
+
+}
+
+/* === Plots ========================================================= */
+
+static void benchPlots() {
+
+    const int n = 1000000;
+
+    measure("plot/timeseries_append", n, [&]() {
+        TimeSeries S(10000);
+        QSharedPointer<QCPGraphDataContainer> C(new QCPGraphDataContainer);
+        S.attach(C);
+        for (int i=0; i<n; i++) { S.append(i*0.02, 25+(i&255)/100.0); }
+    });
+
+    measure("plot/pyramid_append", n, [&]() {
+        MinMaxPyramid P;
+        for (int i=0; i<n; i++) { P.append(i*0.02, 25+(i&255)/100.0); }
+    });
+
+}
+
+/* === Pipeline ====================================================== */
+
+// Synthetic camera -> recorder -> disk, at increasing frame rates and
+// sizes. A configuration is sustained if the recorder keeps up: the
+// last frame is written within one period after the end of acquisition.
+
+static void benchPipeline(const QString &dir, const QStringList &sizes, const QStringList &rates, double duration,
+                          const QString &format, int encoders) {
+
+    QDir().mkpath(dir);
+
+    foreach (const QString &size, sizes) {
+        foreach (const QString &rate, rates) {
+
+            int w = size.section('x', 0, 0).toInt();
+            int h = size.section('x', 1, 1).toInt();
+            double fps = rate.toDouble();
+            QString stage = format=="pgm" && !encoders ? QString("pipeline") : QString("pipeline-%1-%2t").arg(format).arg(encoders);
+            QByteArray name = QString("%1/%2@%3").arg(stage).arg(size).arg(rate).toLatin1();
+            if (!selected(name.constData()) || w<=0 || h<=0 || fps<=0) { continue; }
+
+            // Fresh directory, files are never overwritten
+            QString path = dir + QDir::separator() + QString("%1_%2").arg(size).arg(rate) + QDir::separator();
+            QDir(path).removeRecursively();
+            QDir().mkpath(path);
+
+            Recorder Rec;
+            Rec.Signature = "Bench";
+            Rec.RunPath = path;
+            Rec.Encoders->setFormat(format);
+            Rec.Encoders->Threads = encoders;
+            Rec.start();
+
+            QElapsedTimer Clock;
+            Clock.start();
+
+            Synthetic_Camera *Cam = new Synthetic_Camera(w, h, fps, duration, &Clock);
+            Pipeline_Sink Sink(&Rec, &Clock, Cam);
+            QThread Thread;
+            Cam->moveToThread(&Thread);
+
+            QEventLoop Loop;
+            bool done = false;
+            QObject::connect(&Thread, SIGNAL(started()), Cam, SLOT(run()));
+            QObject::connect(Cam, SIGNAL(frame(QImage,qint64)), &Sink, SLOT(frame(QImage,qint64)));
+            QObject::connect(Cam, &Synthetic_Camera::finished, &Loop, [&]() { done = true; });
+
+            // Polls the end: all frames produced and consumed, or timeout
+            QTimer Poll;
+            qint64 tEnd = 0;
+            QObject::connect(&Poll, &QTimer::timeout, [&]() {
+                if (done && !tEnd) { tEnd = Clock.nsecsElapsed(); }
+                if ((done && Sink.Consumed==Cam->Produced.load()) || Clock.elapsed()>(duration*10+5)*1000) { Loop.quit(); }
+            });
+            Poll.start(5);
+
+            Thread.start();
+            Loop.exec();
+            Thread.quit();
+            Thread.wait();
+
+            qint64 produced = Cam->Produced.load();
+            delete Cam;
+
+            // Until the encoders are done
+            Rec.stop();
+            Sink.LastWrite = qMax(Sink.LastWrite, Clock.nsecsElapsed());
+
+            // --- Statistics
+            std::sort(Sink.Latency.begin(), Sink.Latency.end());
+            double p50 = Sink.Latency.isEmpty() ? 0 : Sink.Latency[Sink.Latency.size()/2];
+            double p99 = Sink.Latency.isEmpty() ? 0 : Sink.Latency[qMin(Sink.Latency.size()-1, (int) (Sink.Latency.size()*0.99))];
+            double elapsed = Sink.LastWrite/1e9;
+            double lag = tEnd ? (Sink.LastWrite-tEnd)/1e9 : 0;
+            bool sustained = Sink.Written==produced && lag<=1/fps;
+
+            cout << name.constData() << "\t" << Sink.Written << "/" << produced << " frames, "
+                 << Sink.Written/elapsed << " fps, " << Sink.Written*(double) w*h/elapsed/1e6 << " MB/s, latency p50 "
+                 << p50 << " ms p99 " << p99 << " ms, backlog " << Sink.MaxBacklog
+                 << (sustained ? "" : "  NOT SUSTAINED") << endl;
+
+            QJsonObject R;
+            R["name"] = QString(name);
+            R["width"] = w;
+            R["height"] = h;
+            R["fps_target"] = fps;
+            R["fps_achieved"] = Sink.Written/elapsed;
+            R["frames"] = produced;
+            R["written"] = Sink.Written;
+            R["MBps"] = Sink.Written*(double) w*h/elapsed/1e6;
+            R["latency_p50_ms"] = p50;
+            R["latency_p99_ms"] = p99;
+            R["max_backlog"] = Sink.MaxBacklog;
+            R["sustained"] = sustained;
+            Results.append(R);
+
+            QDir(path).removeRecursively();
+
+        }
+    }
+
+}
+
+/* === Main ========================================================== */
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("Bench");
+
+    QCommandLineParser Parser;
+    Parser.setApplicationDescription("Benchmarks of the ThermoMaster hot paths and recording pipeline.");
+    Parser.addHelpOption();
+
+    QCommandLineOption oOutput(QStringList() << "o" << "output", "JSON results file.", "file", "bench-results.json");
+    QCommandLineOption oLabel(QStringList() << "l" << "label", "Label of the build (commit, options), stored with the results.", "text");
+    QCommandLineOption oFilter(QStringList() << "f" << "filter", "Only the benchmarks whose name contains this text.", "text");
+    QCommandLineOption oRepeats(QStringList() << "n" << "repeats", "Runs per microbenchmark (median).", "n", "5");
+    QCommandLineOption oDir(QStringList() << "d" << "dir", "Directory of the pipeline benchmarks (default: temporary).", "dir");
+    QCommandLineOption oSizes("sizes", "Frame sizes of the pipeline benchmarks.", "WxH,...", "640x480,1280x600,1280x1024");
+    QCommandLineOption oRates("rates", "Frame rates of the pipeline benchmarks (Hz).", "fps,...", "25,50,100,200");
+    QCommandLineOption oDuration(QStringList() << "t" << "duration", "Duration of each pipeline benchmark (s).", "s", "2");
+    QCommandLineOption oFormat("format", "Frame files of the pipeline benchmarks: pgm, png or tiff.", "format", "pgm");
+    QCommandLineOption oEncoders("encoders", "Encoder threads of the pipeline benchmarks (0: main thread).", "n", "0");
+    Parser.addOption(oOutput);
+    Parser.addOption(oLabel);
+    Parser.addOption(oFilter);
+    Parser.addOption(oRepeats);
+    Parser.addOption(oDir);
+    Parser.addOption(oSizes);
+    Parser.addOption(oRates);
+    Parser.addOption(oDuration);
+    Parser.addOption(oFormat);
+    Parser.addOption(oEncoders);
+    Parser.process(a);
+
+    Filter = Parser.value(oFilter);
+    Repeats = qMax(1, Parser.value(oRepeats).toInt());
+
+    // --- Microbenchmarks
+    benchLogging();
+    benchTrace();
+    benchMetrics();
+    benchFrames(1280, 600);
+    benchTracker(1280, 600);
+    benchSerial();
+    benchTemperatures();
+    benchPlots();
+
+    // --- End-to-end
+    QTemporaryDir Tmp;
+    QString dir = Parser.isSet(oDir) ? Parser.value(oDir) : Tmp.path();
+    benchPipeline(dir, Parser.value(oSizes).split(","), Parser.value(oRates).split(","), Parser.value(oDuration).toDouble(),
+                  Parser.value(oFormat), qMax(0, Parser.value(oEncoders).toInt()));
+
+    // --- Results
+    QJsonObject Doc;
+    Doc["label"] = Parser.value(oLabel);
+    Doc["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    Doc["host"] = QSysInfo::machineHostName();
+    Doc["cpu"] = QSysInfo::currentCpuArchitecture();
+    Doc["qt"] = qVersion();
+    Doc["repeats"] = Repeats;
+    Doc["results"] = Results;
+
+    QFile File(Parser.value(oOutput));
+    if (!File.open(QIODevice::WriteOnly)) {
+        cerr << "Unable to write " << File.fileName().toStdString() << endl;
+        return 1;
+    }
+    File.write(QJsonDocument(Doc).toJson());
+    cout << "Results written to " << File.fileName().toStdString() << endl;
+
+    return 0;
+
+}
@@ -0,0 +1,384 @@
+#include "Runner.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSettings>
+#include <QRegExp>
+#include <QDir>
+#include <QtNumeric>
+#include <csignal>
+
+static volatile sig_atomic_t Interrupted = 0;
+
+static QString hms(qint64 ms) {
+
+    qint64 s = ms/1000;
+    return QString("%1:%2:%3").arg(s/3600, 2, 10, QChar('0')).arg((s/60)%60, 2, 10, QChar('0')).arg(s%60, 2, 10, QChar('0'));
+
+}
+
+/* === Constructor =================================================== */
+
+Runner::Runner(QObject *parent) : QObject(parent), Out(stdout) {
+
+    SetupName = "ThermoMaster";
+    Version = "1.0.1";
+    UseCamera = true;
+    Tracking = false;
+    StoreImages = true;
+    Encoders = -1;
+    Bin = 0;
+    Every = 0;
+    Exposure = 40;
+    X1 = 0; X2 = 0; Y1 = 0; Y2 = 0;
+    SaveRate = 10;
+    ClipPre = 5;
+    ClipPost = 10;
+    StatusInterval = 10000;
+    Verbose = false;
+    MetricsPort = 0;
+    StreamSlots = 16;
+
+    TL = 0;
+    TR = 0;
+    BoardClock.Scale = 1000;    // Board micros, 32 bits
+    BoardClock.Wrap = Q_INT64_C(4294967296);
+    Regulating = false;
+    Stopping = false;
+    Buffering = false;
+    Camera = 0;
+
+    Session = new LogSink(this);
+    Link = new SerialLink(this);
+    Rec = new Recorder(this);
+    Clips = new ClipRecorder(this);
+    Monitor = new MetricsServer(this);
+    Stream = new FrameStream;
+
+    mErrorLeft = Metrics::gauge("thermo_temperature_error_celsius", "Measured minus target temperature, NaN without regulation", "zone=\"left\"");
+    mErrorRight = Metrics::gauge("thermo_temperature_error_celsius", "Measured minus target temperature, NaN without regulation", "zone=\"right\"");
+
+    Engine = new ProtocolEngine(this);
+    Engine->RampPeriod = 1000;
+
+    Drain = new QTimer(this);
+    Status = new QTimer(this);
+
+    connect(Drain, SIGNAL(timeout()), this, SLOT(drain()));
+    connect(Status, SIGNAL(timeout()), this, SLOT(status()));
+
+    connect(Link, SIGNAL(sample(Serial_Sample)), this, SLOT(sample(Serial_Sample)));
+    connect(Link, SIGNAL(line(QByteArray)), this, SLOT(line(QByteArray)));
+
+    connect(Engine, SIGNAL(print(QString)), this, SLOT(print(QString)));
+    connect(Engine, SIGNAL(createDirectory()), this, SLOT(createDirectory()));
+    connect(Engine, SIGNAL(camera(bool)), this, SLOT(camera(bool)));
+    connect(Engine, SIGNAL(clip(QString)), this, SLOT(clip(QString)));
+    connect(Engine, SIGNAL(regulation(bool)), this, SLOT(regulation(bool)));
+    connect(Engine, SIGNAL(targets(double,double)), this, SLOT(targets(double,double)));
+    connect(Engine, SIGNAL(ramp(double,double,qint64)), this, SLOT(ramp(double,double,qint64)));
+    connect(Engine, SIGNAL(finished()), this, SLOT(finished()));
+
+}
+
+Runner::~Runner() {
+
+    delete Camera;
+    delete Stream;
+    drain();
+    Session->stop();
+
+}
+
+void Runner::interrupt() { Interrupted = 1; }
+
+/* === Startup ======================================================= */
+
+void Runner::start() {
+
+    Drain->start(50);
+    if (!TracePath.isEmpty()) {
+        Trace::setThreadName("Main");
+        Trace::start();
+    }
+    if (!LogPath.isEmpty()) { Session->setDirectory(LogPath); }
+    if (MetricsPort>0) { Monitor->listen(MetricsPort); }
+
+    qInfo() << TITLE_1 << qPrintable(SetupName) << qPrintable(Version) << "(headless)";
+
+    // --- Protocol, validated as a whole before touching the rig
+
+    if (!Program.load(ProtocolPath)) {
+        foreach (const QString &e, Program.Errors) { qCritical() << qPrintable(e); }
+        qCritical() << "Protocol rejected:" << qPrintable(ProtocolPath);
+        quit(Exit_Protocol);
+        return;
+    }
+    qInfo().noquote() << "Protocol" << ProtocolPath << "-" << Program.Program.size()
+                      << "instructions, planned duration" << hms(Program.duration());
+
+    // --- Camera, only if the protocol records
+
+    bool record = false;
+    for (int i=0; i<Program.Program.size(); i++) {
+        if (Program.Program[i].op==Instruction::CameraStart) { record = true; }
+        if (Program.Program[i].op==Instruction::Clip) { record = true; Buffering = true; }
+    }
+
+    QSettings Settings(SettingsPath, QSettings::IniFormat);
+
+    if (UseCamera && record) {
+
+        qInfo() << TITLE_2 << "Camera";
+
+        if (!Camera_FLIR::available()) {
+            qCritical() << "No camera detected";
+            quit(Exit_Camera);
+            return;
+        }
+
+        if (!StreamName.isEmpty()) {
+            Stream->Signature = SetupName + " " + Version;
+            Stream->open(StreamName, StreamSlots);
+        }
+
+        Camera = new Camera_FLIR(0);
+        Camera->Stream = Stream;
+        Camera->load(Settings);
+        Camera->Exposure = Exposure;
+        Camera->X1 = X1;
+        Camera->X2 = X2;
+        Camera->Y1 = Y1;
+        Camera->Y2 = Y2;
+        connect(Camera, SIGNAL(newFrame(Image_FLIR)), this, SLOT(frame(Image_FLIR)));
+        Camera->newCamera();
+
+    }
+
+    Rec->Signature = SetupName + " " + Version;
+    Rec->Rate = SaveRate;
+    Rec->StoreImages = StoreImages;
+    Rec->Track->load(Settings);
+    if (Tracking) { Rec->Track->Enabled = true; }
+    if (!StoreImages && !Rec->Track->Enabled) { qWarning() << "Neither images nor positions will be recorded"; }
+    Rec->Encoders->load(Settings);
+    if (!Format.isEmpty()) { Rec->Encoders->setFormat(Format); }
+    if (Encoders>=0) { Rec->Encoders->Threads = Encoders; }
+    Rec->load(Settings);
+    if (Bin>0) { Rec->Storage.Bin = Bin; }
+    if (Every>0) { Rec->Storage.Every = Every; }
+    if (!Rec->Storage.isIdentity()) { qInfo() << "Frame files:" << qPrintable(Rec->Storage.describe()); }
+    if (!Rec->Analysis.isIdentity()) { qInfo() << "Tracked frames:" << qPrintable(Rec->Analysis.describe()); }
+    Clips->Signature = Rec->Signature;
+    Clips->PreTrigger = ClipPre;
+    Clips->PostTrigger = ClipPost;
+    Clips->setDirectory(DataPath + "Clips" + QDir::separator());
+
+    // --- Serial link
+
+    qInfo() << TITLE_2 << "Serial connections";
+
+    if (!Link->open(Port)) {
+        qCritical() << "No regulation board available";
+        quit(Exit_Serial);
+        return;
+    }
+
+    // The board resets when the port opens
+    QTimer::singleShot(2500, this, SLOT(begin()));
+
+}
+
+void Runner::begin() {
+
+    if (Stopping) { return; }
+
+    // --- Saved gains
+    QSettings Settings(SettingsPath, QSettings::IniFormat);
+    Settings.beginGroup("Rig_" + Link->RigId);
+    if (Settings.contains("P")) {
+        Link->send("P " + Settings.value("P").toString());
+        Link->send("I " + Settings.value("I").toString());
+        Link->send("D " + Settings.value("D").toString());
+        qInfo() << "PID gains loaded for rig" << qPrintable(Link->RigId);
+    }
+    Settings.endGroup();
+
+    // --- Run
+    qInfo() << TITLE_2 << "Protocol";
+    Engine->load(Program);
+    Engine->Left = TL;
+    Engine->Right = TR;
+    Engine->start();
+    Status->start(StatusInterval);
+
+}
+
+/* === Output ======================================================== */
+
+void Runner::drain() {
+
+    TRACE_SPAN("drain");
+
+    if (Interrupted && !Stopping) {
+        qWarning() << "Interrupted";
+        quit(Exit_Interrupted);
+    }
+
+    unsigned dropped = Messages.takeDropped();
+    if (dropped) {
+        static Metric_Counter *mDropped = Metrics::counter("thermo_log_dropped_total", "Log records dropped, by stage (queue: log queue full, sink: session writer behind)", "stage=\"queue\"");
+        mDropped->add(dropped);
+        qWarning() << dropped << "message(s) dropped: the log queue was full";
+    }
+
+    static const QRegExp Tags("<[^>]*>");
+    Message M;
+
+    while (Messages.pop(M)) {
+
+        Session->write(M);
+        if (M.type==QtDebugMsg && !Verbose) { continue; }
+
+        QString S = QDateTime::fromMSecsSinceEpoch(M.time).toString("hh:mm:ss.zzz");
+        S += QString(" %1 ").arg(Message::severity(M.type), -8);
+        S += QString(M.text).remove(Tags);
+        for (int k=0; k<M.nFields; k++) { S += QString(" %1=%2").arg(M.fields[k].key).arg(M.fields[k].value()); }
+        cerr << S.toStdString() << endl;
+
+    }
+
+}
+
+void Runner::status() {
+
+    Out << "[" << hms(Engine->elapsed()) << "] line " << Engine->line()
+        << "  TL " << QString::number(TL, 'f', 2) << "  TR " << QString::number(TR, 'f', 2)
+        << "  targets " << Engine->Left << " " << Engine->Right;
+    if (Rec->isRecording()) {
+        Out << "  run " << QString("%1").arg(Rec->nRun, 2, 10, QLatin1Char('0')) << " frames " << Rec->nFrame;
+    }
+    Out << "  left " << hms(Engine->remaining()) << endl;
+
+}
+
+void Runner::quit(int code) {
+
+    if (Stopping) { return; }
+    Stopping = true;
+
+    // The board interpolates the ramps: freeze it on the current targets
+    if (Engine->isRamping()) {
+        double left, right;
+        Engine->current(left, right);
+        targets(left, right);
+    }
+
+    // Never leave the Peltiers driven on an unattended rig
+    if (Regulating || code!=Exit_Success) {
+        Link->send("stop");
+        Regulating = false;
+    }
+    Link->flush();
+
+    Engine->stop();
+    Status->stop();
+    Rec->stop();
+    Clips->finish();
+
+    if (Trace::isEnabled()) {
+        qint64 n = Trace::write(TracePath);
+        if (n<0) { qWarning() << "Unable to write" << qPrintable(TracePath); }
+        else { qInfo() << "Trace:" << n << "events written to" << qPrintable(TracePath); }
+    }
+
+    QCoreApplication::exit(code);
+
+}
+
+/* === Rig =========================================================== */
+
+void Runner::sample(Serial_Sample S) {
+
+    TL = S.TL;
+    TR = S.TR;
+    Stream->setTemperatures(TL, TR);
+
+    double left, right;
+    Engine->current(left, right);
+    mErrorLeft->set(Regulating ? TL-left : qQNaN());
+    mErrorRight->set(Regulating ? TR-right : qQNaN());
+
+    // Frames of the run get the temperatures of their exposure
+    Temperature_Sample T = { BoardClock.add((qint64) S.t, S.host), TL, TR, Regulating ? left : 0, Regulating ? right : 0 };
+    Rec->addTemperatures(T);
+
+}
+
+void Runner::line(QByteArray l) { qDebug() << l.constData(); }
+
+void Runner::frame(Image_FLIR FImg) {
+
+    qint64 time = CameraClock.add(FImg.timestamp, FImg.host);
+    if (Buffering) { Clips->push(FImg.Img, FImg.timestamp, TL, TR); }
+    Rec->write(FImg.Img, FImg.timestamp, time, FImg.Raw);
+    Rec->writeMotion(FImg.timestamp, FImg.motionLeft, FImg.motionRight, FImg.motionRoi);
+
+}
+
+/* === Protocol actions ============================================== */
+
+void Runner::print(QString text) {
+
+    qInfo() << qPrintable(text);
+    Out << "[" << hms(Engine->elapsed()) << "] " << text << endl;
+
+}
+
+void Runner::createDirectory() {
+
+    if (Rec->createRun(DataPath, Program.Path, Parameters)) {
+        Clips->setDirectory(Rec->RunPath + "Clips" + QDir::separator());
+        Out << "[" << hms(Engine->elapsed()) << "] run " << Rec->RunPath << endl;
+    }
+
+}
+
+void Runner::camera(bool b) {
+
+    if (b && !Camera) { qWarning() << "Camera disabled: no frame will be recorded"; }
+
+    if (b) { Rec->start(); }
+    else { Rec->stop(); }
+
+}
+
+void Runner::clip(QString label) {
+
+    Clips->trigger(label);
+    Out << "[" << hms(Engine->elapsed()) << "] clip " << Clips->ClipPath << endl;
+
+}
+
+void Runner::regulation(bool b) {
+
+    Regulating = b;
+    Link->send(b ? "start" : "stop");
+
+}
+
+void Runner::targets(double left, double right) { Link->send(QString("set %1 %2").arg(left).arg(right)); }
+
+void Runner::ramp(double left, double right, qint64 ms) { Link->send(QString("ramp %1 %2 %3").arg(left).arg(right).arg(ms)); }
+
+void Runner::finished() {
+
+    status();
+    Out << "Protocol finished: " << Engine->Steps << " steps, worst lateness "
+        << QString::number(Engine->WorstLateness, 'f', 1) << " ms";
+    if (Rec->nRun) { Out << ", " << Rec->nFrame << " frames in " << Rec->RunPath; }
+    Out << endl;
+
+    quit(Exit_Success);
+
+}
@@ -0,0 +1,117 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QTextStream>
+
+#include "MsgHandler.h"
+#include "LogSink.h"
+#include "SerialLink.h"
+#include "Recorder.h"
+#include "ClipRecorder.h"
+#include "ClockSync.h"
+#include "Camera_FLIR.h"
+#include "Protocol.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+
+/* =================================================================== *\
+|    Runner Class                                                       |
+\* =================================================================== */
+
+// Headless counterpart of the main window: runs one protocol on the rig,
+// records the frames, streams the status on stdout and the log on
+// stderr, and quits with an exit code.
+
+enum Runner_Exit { Exit_Success = 0, Exit_Usage = 1, Exit_Protocol = 2, Exit_Serial = 3,
+                   Exit_Camera = 4, Exit_Interrupted = 130 };
+
+class Runner : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Runner(QObject *parent = 0);
+    ~Runner();
+
+    // Settings, before start()
+    QString SetupName, Version;
+    QString ProtocolPath;
+    QString DataPath;           // Day directory, where runs are created
+    QString LogPath;
+    QString SettingsPath;
+    QString TracePath;          // Chrome trace of the run, if set
+    int MetricsPort;            // Prometheus endpoint on localhost, 0 for none
+    QString StreamName;         // Shared-memory frame ring, empty for none
+    int StreamSlots;
+    QString Port;               // Empty: first Arduino
+    Run_Parameters Parameters;
+    bool UseCamera;
+    bool Tracking;              // Online tracking, also enabled by Tracking/Enabled
+    bool StoreImages;
+    QString Format;             // Frame files, empty for Recording/Format
+    int Encoders;               // Encoder threads, -1 for Recording/Encoders
+    int Bin;                    // Binning of the frame files, 0 for Recording/Bin
+    int Every;                  // Decimation of the frame files, 0 for Recording/Every
+    float Exposure;             // ms
+    int X1, X2, Y1, Y2;
+    double SaveRate;            // Hz
+    double ClipPre, ClipPost;   // s
+    int StatusInterval;         // ms
+    bool Verbose;
+
+    static void interrupt();
+
+public slots:
+
+    void start();
+
+private slots:
+
+    void drain();
+    void status();
+    void begin();
+
+    void sample(Serial_Sample);
+    void line(QByteArray);
+    void frame(Image_FLIR);
+
+    void print(QString);
+    void createDirectory();
+    void camera(bool);
+    void clip(QString);
+    void regulation(bool);
+    void targets(double, double);
+    void ramp(double, double, qint64);
+    void finished();
+
+private:
+
+    Protocol Program;
+    ProtocolEngine *Engine;
+    SerialLink *Link;
+    Recorder *Rec;
+    ClipRecorder *Clips;
+    bool Buffering;             // Frames kept for the clips
+    Camera_FLIR *Camera;
+    FrameStream *Stream;
+    LogSink *Session;
+    QTimer *Drain, *Status;
+    QTextStream Out;
+    MetricsServer *Monitor;
+    Metric_Gauge *mErrorLeft, *mErrorRight;
+
+    double TL, TR;
+    ClockSync BoardClock, CameraClock;
+    bool Regulating;
+    bool Stopping;
+
+    void quit(int code);
+
+};
+
+#endif // RUNNER_H
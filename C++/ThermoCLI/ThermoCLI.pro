@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Headless protocol runner
+#
+#-------------------------------------------------
+
+QT       += core
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = thermomaster-cli
+TEMPLATE = app
+
+include(../ThermoMaster/ThermoRig.pri)
+
+SOURCES += main.cpp \
+    Runner.cpp
+
+HEADERS  += Runner.h
@@ -0,0 +1,178 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <iostream>
+#include <csignal>
+
+#include "Runner.h"
+
+using namespace std;
+
+/* =================================================================== *\
+|    thermomaster-cli                                                   |
+\* =================================================================== */
+
+// Runs a protocol on the rig without a display. Status lines go to
+// stdout, the log to stderr and to the session log. Exit codes:
+//
+//   0      protocol completed
+//   1      invalid arguments
+//   2      protocol rejected
+//   3      no regulation board
+//   4      no camera, while the protocol records
+//   130    interrupted (SIGINT, SIGTERM)
+
+static void onSignal(int) { Runner::interrupt(); }
+
+/* === Main ========================================================== */
+
+int main(int argc, char *argv[]) {
+
+    // Message handler
+    qInstallMessageHandler(MsgHandler);
+
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("thermomaster-cli");
+
+    QCommandLineParser Parser;
+    Parser.setApplicationDescription("Headless protocol runner of the ThermoMaster rig.");
+    Parser.addHelpOption();
+    Parser.addPositionalArgument("protocol", "Protocol file.");
+
+    QCommandLineOption oProject(QStringList() << "d" << "project", "Project directory, data go to <project>/Data/<date>/.", "dir", QDir::currentPath());
+    QCommandLineOption oPort(QStringList() << "p" << "port", "Serial port (default: first Arduino).", "port");
+    QCommandLineOption oSettings(QStringList() << "s" << "settings", "Rig settings (PID gains).", "file", "Settings.conf");
+    QCommandLineOption oRate(QStringList() << "r" << "rate", "Image saving rate (Hz, 0 for all frames).", "Hz", "10");
+    QCommandLineOption oExposure(QStringList() << "e" << "exposure", "Exposure time (ms).", "ms", "40");
+    QCommandLineOption oRoi("roi", "Region of interest, x1,y1,x2,y2 (sensor pixels).", "roi", "0,140,1280,740");
+    QCommandLineOption oNoCamera("no-camera", "Do not open the camera.");
+    QCommandLineOption oClip("clip", "Clip window around the triggers: before,after (s).", "s", "5,10");
+    QCommandLineOption oStatus("status", "Status interval (s).", "s", "10");
+    QCommandLineOption oStrain("strain", "Strain, for the parameters file.", "name");
+    QCommandLineOption oSpawning("spawning", "Spawning date (yyyy-MM-dd), for the parameters file.", "date");
+    QCommandLineOption oCheck("check", "Compile the protocol, print its duration and exit.");
+    QCommandLineOption oTrace("trace", "Write a Chrome trace of the run (chrome://tracing, Perfetto).", "file");
+    QCommandLineOption oMetrics("metrics", "Prometheus endpoint on localhost (port, 0 to disable).", "port", "9464");
+    QCommandLineOption oStream("stream", "Shared-memory frame ring for external readers (POSIX name).", "name", THERMOSTREAM_NAME);
+    QCommandLineOption oNoStream("no-stream", "Do not publish the frames in shared memory.");
+    QCommandLineOption oTrack("track", "Track the larvae online, positions in <run>/Tracking.tsv.");
+    QCommandLineOption oNoImages("no-images", "Do not save the frames of the runs (positions and clips only).");
+    QCommandLineOption oFormat("format", "Frame files: pgm, png or tiff (default: Recording/Format).", "format");
+    QCommandLineOption oEncoders("encoders", "Encoder threads, 0 to encode on the main thread (default: Recording/Encoders).", "n");
+    QCommandLineOption oBin("bin", "Bin the saved frames in n x n blocks, 1, 2 or 4 (default: Recording/Bin).", "n");
+    QCommandLineOption oEvery("every", "Save one frame out of n, before the rate (default: Recording/Every).", "n");
+    QCommandLineOption oVerbose(QStringList() << "V" << "verbose", "Print debug messages.");
+    Parser.addOption(oProject);
+    Parser.addOption(oPort);
+    Parser.addOption(oSettings);
+    Parser.addOption(oRate);
+    Parser.addOption(oExposure);
+    Parser.addOption(oRoi);
+    Parser.addOption(oNoCamera);
+    Parser.addOption(oClip);
+    Parser.addOption(oStatus);
+    Parser.addOption(oStrain);
+    Parser.addOption(oSpawning);
+    Parser.addOption(oCheck);
+    Parser.addOption(oTrace);
+    Parser.addOption(oMetrics);
+    Parser.addOption(oStream);
+    Parser.addOption(oNoStream);
+    Parser.addOption(oTrack);
+    Parser.addOption(oNoImages);
+    Parser.addOption(oFormat);
+    Parser.addOption(oEncoders);
+    Parser.addOption(oBin);
+    Parser.addOption(oEvery);
+    Parser.addOption(oVerbose);
+    Parser.process(a);
+
+    if (Parser.positionalArguments().size()!=1) {
+        cerr << "One protocol file expected" << endl;
+        return Exit_Usage;
+    }
+
+    // --- Dry run
+
+    QString protocol = Parser.positionalArguments().at(0);
+
+    if (Parser.isSet(oCheck)) {
+
+        Protocol Prog;
+        bool ok = Prog.load(protocol);
+        foreach (const QString &e, Prog.Errors) { cerr << e.toStdString() << endl; }
+        if (!ok) { return Exit_Protocol; }
+        cout << Prog.Program.size() << " instructions, planned duration " << Prog.duration()/1000.0 << " s" << endl;
+        return Exit_Success;
+
+    }
+
+    // --- Settings
+
+    QString sep = QDir::separator();
+    QString project = QDir(Parser.value(oProject)).absolutePath() + sep;
+
+    QStringList roi = Parser.value(oRoi).split(",");
+    if (roi.size()!=4) {
+        cerr << "Invalid region of interest" << endl;
+        return Exit_Usage;
+    }
+
+    QStringList clip = Parser.value(oClip).split(",");
+    if (clip.size()!=2) {
+        cerr << "Invalid clip window" << endl;
+        return Exit_Usage;
+    }
+
+    int bin = Parser.isSet(oBin) ? Parser.value(oBin).toInt() : 0;
+    if (Parser.isSet(oBin) && bin!=1 && bin!=2 && bin!=4) {
+        cerr << "Invalid binning" << endl;
+        return Exit_Usage;
+    }
+
+    Runner R;
+    R.ProtocolPath = protocol;
+    R.DataPath = project + "Data" + sep + QDate::currentDate().toString("yyyy-MM-dd") + sep;
+    R.LogPath = project + "Data" + sep + "Logs" + sep;
+    R.SettingsPath = Parser.value(oSettings);
+    R.Port = Parser.value(oPort);
+    R.SaveRate = Parser.value(oRate).toDouble();
+    R.Exposure = Parser.value(oExposure).toFloat();
+    R.X1 = roi[0].toInt();
+    R.Y1 = roi[1].toInt();
+    R.X2 = roi[2].toInt();
+    R.Y2 = roi[3].toInt();
+    R.ClipPre = clip[0].toDouble();
+    R.ClipPost = clip[1].toDouble();
+    R.UseCamera = !Parser.isSet(oNoCamera);
+    R.Tracking = Parser.isSet(oTrack);
+    R.StoreImages = !Parser.isSet(oNoImages);
+    R.Format = Parser.value(oFormat);
+    R.Encoders = Parser.isSet(oEncoders) ? qMax(0, Parser.value(oEncoders).toInt()) : -1;
+    R.Bin = bin;
+    R.Every = Parser.isSet(oEvery) ? qMax(1, Parser.value(oEvery).toInt()) : 0;
+    R.StatusInterval = qRound(1000*Parser.value(oStatus).toDouble());
+    R.Verbose = Parser.isSet(oVerbose);
+    R.TracePath = Parser.value(oTrace);
+    R.MetricsPort = Parser.value(oMetrics).toInt();
+    R.StreamName = Parser.isSet(oNoStream) ? QString() : Parser.value(oStream);
+
+    if (Parser.isSet(oStrain)) {
+        R.Parameters << qMakePair(QString("Strain"), Parser.value(oStrain));
+    }
+    if (Parser.isSet(oSpawning)) {
+        QDate D = QDate::fromString(Parser.value(oSpawning), "yyyy-MM-dd");
+        R.Parameters << qMakePair(QString("Spawning_date"), D.toString("yyyy-MM-dd"));
+        R.Parameters << qMakePair(QString("Age"), QString::number(D.daysTo(QDate::currentDate())));
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    QTimer::singleShot(0, &R, SLOT(start()));
+    return a.exec();
+
+}
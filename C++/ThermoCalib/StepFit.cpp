@@ -0,0 +1,217 @@
+#include "StepFit.h"
+
+/* =================================================================== *\
+|    Columns Class                                                      |
+\* =================================================================== */
+
+Columns::Columns() {
+
+    Width = 0;
+    Rows = 0;
+    Capacity = 0;
+
+}
+
+void Columns::reserve(size_t rows) {
+
+    Capacity = rows;
+    for (size_t i=0; i<C.size(); i++) { C[i].reserve(rows); }
+
+}
+
+void Columns::append(const double *values, int n) {
+
+    // The first row sets the width; malformed rows are skipped
+    if (!Width) {
+        Width = n;
+        C.assign(n, std::vector<double>());
+        reserve(Capacity);
+    }
+    if (n!=Width) { return; }
+
+    for (int i=0; i<n; i++) { C[i].push_back(values[i]); }
+    Rows++;
+
+}
+
+/* =================================================================== *\
+|    Fit_Stats                                                          |
+\* =================================================================== */
+
+Fit_Stats::Fit_Stats() {
+
+    n = 0;
+    for (int i=0; i<4; i++) { mean[i] = 0; m2[i] = 0; }
+
+}
+
+// Welford's running mean and variance
+void Fit_Stats::add(const double v[4]) {
+
+    n++;
+    for (int i=0; i<4; i++) {
+        double d = v[i] - mean[i];
+        mean[i] += d/n;
+        m2[i] += d*(v[i] - mean[i]);
+    }
+
+}
+
+// Chan et al. pairwise combination, to pool several captures
+void Fit_Stats::merge(const Fit_Stats &o) {
+
+    if (!o.n) { return; }
+    int N = n + o.n;
+    for (int i=0; i<4; i++) {
+        double d = o.mean[i] - mean[i];
+        mean[i] += d*o.n/N;
+        m2[i] += o.m2[i] + d*d*n*o.n/N;
+    }
+    n = N;
+
+}
+
+double Fit_Stats::sd(int i) const { return n>1 ? sqrt(m2[i]/(n-1)) : 0; }
+
+/* =================================================================== *\
+|    StepFit Class                                                      |
+\* =================================================================== */
+
+/* === Constructor =================================================== */
+
+StepFit::StepFit(const Columns &Data, int stimColumn) : D(Data) {
+
+    Stim = stimColumn;
+    Next = 0;
+    inPulse = false;
+    Onset = -1;
+    Offset = -1;
+    Floor = 0;
+
+}
+
+/* === Incremental update ============================================ */
+
+void StepFit::update() {
+
+    if (Stim>=D.Width) { Next = D.Rows; return; }
+
+    const std::vector<double> &S = D.C[Stim];
+
+    for (; Next<D.Rows; Next++) {
+
+        if (!inPulse && S[Next]!=0) {
+
+            // New onset: the previous pulse window is complete
+            if (Onset>=0 && Offset>=0) {
+                fit(Onset, Offset, Next);
+                Floor = Offset;
+            }
+            Onset = Next;
+            Offset = -1;
+            inPulse = true;
+
+        } else if (inPulse && S[Next]==0) {
+
+            Offset = Next;
+            inPulse = false;
+
+        }
+    }
+
+}
+
+/* === End of capture ================================================ */
+
+void StepFit::finish() {
+
+    update();
+    if (Onset>=0 && Offset>=0) { fit(Onset, Offset, D.Rows); }
+    Onset = -1;
+
+}
+
+/* === Single pulse fit ============================================== */
+
+void StepFit::fit(long onset, long offset, long end) {
+
+    const std::vector<double> &T = D.C[0];
+    double t0 = T[0];
+
+    // --- Baseline window
+    long b0 = std::max(Floor, onset-50);
+    if (onset-b0<3) { return; }
+
+    for (int c=1; c<Stim; c++) {
+
+        const std::vector<double> &X = D.C[c];
+
+        Pulse_Fit F;
+        F.channel = c;
+        F.onset = (T[onset]-t0)*1e-6;
+        F.duration = (T[offset]-T[onset])*1e-3;
+        F.deadTime = -1;
+        F.tau = -1;
+        F.overshoot = 0;
+
+        // --- Baseline level and noise
+        double m = 0, v = 0;
+        for (long i=b0; i<onset; i++) { m += X[i]; }
+        m /= onset-b0;
+        for (long i=b0; i<onset; i++) { v += (X[i]-m)*(X[i]-m); }
+        double sd = sqrt(v/(onset-b0));
+        F.baseline = m;
+
+        // --- Peak excursion
+        long ip = onset;
+        for (long i=onset; i<end; i++) {
+            if (fabs(X[i]-m)>fabs(X[ip]-m)) { ip = i; }
+        }
+        F.peak = X[ip]-m;
+        double s = F.peak<0 ? -1 : 1;
+        double A = fabs(F.peak);
+        double thr = std::max(std::max(3*sd, 0.1*A), 0.01);
+
+        if (A>thr) {
+
+            // --- Dead time
+            for (long i=onset; i<=ip; i++) {
+                if (s*(X[i]-m)>thr) {
+                    F.deadTime = (T[i]-T[onset])*1e-6;
+                    break;
+                }
+            }
+
+            // --- Relaxation: weighted log-linear fit from the peak down to 10%
+            double Sw = 0, St = 0, Sy = 0, Stt = 0, Sty = 0;
+            long i = ip;
+            int np = 0;
+            for (; i<end && s*(X[i]-m)>0.1*A; i++) {
+                double y = s*(X[i]-m);
+                double t = (T[i]-T[ip])*1e-6;
+                double w = y*y;
+                double ly = log(y);
+                Sw += w; St += w*t; Sy += w*ly; Stt += w*t*t; Sty += w*t*ly;
+                np++;
+            }
+            double den = Sw*Stt - St*St;
+            if (np>=3 && den>0) {
+                double slope = (Sw*Sty - St*Sy)/den;
+                if (slope<0) { F.tau = -1/slope; }
+            }
+
+            // --- Overshoot past baseline after the relaxation
+            for (; i<end; i++) { F.overshoot = std::max(F.overshoot, -s*(X[i]-m)); }
+
+        }
+
+        Pulses.push_back(F);
+
+        // --- Summary per channel and duration
+        if (F.deadTime>=0 && F.tau>0) {
+            double vals[4] = { F.deadTime, F.tau, F.peak, F.overshoot };
+            Summary[std::make_pair(c, (int) round(F.duration/10))].add(vals);
+        }
+    }
+
+}
@@ -0,0 +1,92 @@
+#ifndef STEPFIT_H
+#define STEPFIT_H
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+/* =================================================================== *\
+|    Columns Class                                                      |
+\* =================================================================== */
+
+// Preallocated columnar storage of a capture. Column 0 is the board time
+// (µs), followed by the temperatures and the stimulus column.
+
+class Columns {
+
+public:
+
+    Columns();
+
+    void reserve(size_t rows);
+    void append(const double *values, int n);
+
+    int Width;
+    size_t Rows;
+    size_t Capacity;
+    std::vector< std::vector<double> > C;
+
+};
+
+/* =================================================================== *\
+|    StepFit Class                                                      |
+\* =================================================================== */
+
+struct Pulse_Fit {
+
+    int channel;
+    double onset;       // Stimulus onset (s, from capture start)
+    double duration;    // Stimulus duration (ms)
+    double baseline;    // Temperature before onset (°C)
+    double deadTime;    // Onset to first significant excursion (s)
+    double tau;         // Relaxation time constant (s), -1 if not fitted
+    double peak;        // Signed peak excursion (°C)
+    double overshoot;   // Excursion past baseline on the way back (°C)
+
+};
+
+struct Fit_Stats {
+
+    int n;
+    double mean[4];     // Dead time, tau, peak, overshoot
+    double m2[4];
+
+    Fit_Stats();
+    void add(const double v[4]);
+    void merge(const Fit_Stats&);
+    double sd(int i) const;
+
+};
+
+// Fits each pulse as soon as the next one starts, so that the summary is
+// available while the capture is still running.
+
+class StepFit {
+
+public:
+
+    StepFit(const Columns &Data, int stimColumn);
+
+    void update();
+    void finish();
+
+    std::vector<Pulse_Fit> Pulses;
+    std::map< std::pair<int, int>, Fit_Stats > Summary;    // (channel, duration in 10 ms)
+
+private:
+
+    const Columns &D;
+    int Stim;
+
+    size_t Next;        // First row not yet scanned
+    bool inPulse;
+    long Onset, Offset; // Rows of the current pulse, -1 if none
+    long Floor;         // First row usable as baseline
+
+    void fit(long onset, long offset, long end);
+
+};
+
+#endif // STEPFIT_H
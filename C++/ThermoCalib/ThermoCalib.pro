@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Step-response calibration of the Peltier zones
+#
+#-------------------------------------------------
+
+QT       += core serialport
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = ThermoCalib
+TEMPLATE = app
+
+include(../ThermoMaster/ThermoCore.pri)
+
+SOURCES += main.cpp \
+    StepFit.cpp
+
+HEADERS  += StepFit.h
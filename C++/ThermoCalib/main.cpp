@@ -0,0 +1,244 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QSerialPort>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <iostream>
+#include <cstring>
+
+#include "SerialParser.h"
+#include "StepFit.h"
+
+using namespace std;
+
+/* =================================================================== *\
+|    ThermoCalib                                                        |
+\* =================================================================== */
+
+// Step-response calibration of the Peltier zones. Captures are either
+// read from files (MATLAB dlmwrite or raw serial dumps) or streamed from
+// the serial port, and pulses are fitted as they complete.
+
+typedef std::map< std::pair<int, int>, Fit_Stats > Summary_Map;
+
+static QString channelName(int c) {
+
+    static const char* Names[] = { "t", "TL", "TR", "TL_dye", "TR_dye" };
+    return c<5 ? QString(Names[c]) : QString("C%1").arg(c);
+
+}
+
+/* === Capture file ================================================== */
+
+static bool loadFile(const QString &path, Columns &D, StepFit &F) {
+
+    QFile File(path);
+    if (!File.open(QIODevice::ReadOnly)) {
+        cerr << "Unable to open " << path.toStdString() << endl;
+        return false;
+    }
+
+    // Map the whole capture; fall back on a plain read
+    QByteArray Content;
+    const char *p = (const char*) File.map(0, File.size());
+    if (!p) {
+        Content = File.readAll();
+        p = Content.constData();
+    }
+    const char *end = p + File.size();
+
+    // Preallocate from the length of the first line
+    const char *nl = (const char*) memchr(p, '\n', end-p);
+    if (nl) { D.reserve((size_t) (1.1*(end-p)/(nl-p+1)) + 16); }
+
+    double v[SERIAL_MAX_COLUMNS];
+    while (p<end) {
+
+        nl = (const char*) memchr(p, '\n', end-p);
+        if (!nl) { nl = end; }
+
+        int n = parseColumns(p, nl, v, SERIAL_MAX_COLUMNS);
+        if (n>0) { D.append(v, n); }
+        p = nl+1;
+
+        // Fit pulses as they complete
+        if (!(D.Rows & 0xFFFF)) { F.update(); }
+
+    }
+
+    F.finish();
+    return true;
+
+}
+
+/* === Serial capture ================================================ */
+
+static bool capture(const QString &port, double duration, Columns &D, StepFit &F) {
+
+    QSerialPort Serial;
+    Serial.setPortName(port);
+    Serial.setBaudRate(115200);
+    Serial.setDataBits(QSerialPort::Data8);
+    Serial.setParity(QSerialPort::NoParity);
+    Serial.setStopBits(QSerialPort::OneStop);
+    Serial.setFlowControl(QSerialPort::NoFlowControl);
+
+    if (!Serial.open(QIODevice::ReadOnly)) {
+        cerr << "Failed to open port " << port.toStdString() << endl;
+        return false;
+    }
+
+    cout << "The serial connection is established." << endl;
+
+    // A bit more than one hour at 100 Hz before any reallocation
+    D.reserve(400000);
+
+    Line_Splitter Lines;
+    double v[SERIAL_MAX_COLUMNS];
+
+    QObject::connect(&Serial, &QSerialPort::readyRead, [&]() {
+
+        Lines.append(Serial.readAll());
+
+        const char *b, *e;
+        while (Lines.next(b, e)) {
+            int n = parseColumns(b, e, v, SERIAL_MAX_COLUMNS);
+            if (n>0) { D.append(v, n); }
+        }
+        F.update();
+
+    });
+
+    QTimer::singleShot((int) (duration*1000), QCoreApplication::instance(), SLOT(quit()));
+    QCoreApplication::exec();
+
+    Serial.close();
+    F.finish();
+    cout << "The serial connection is closed." << endl;
+
+    return true;
+
+}
+
+/* === Outputs ======================================================= */
+
+static void writeRaw(const QString &path, const Columns &D) {
+
+    QFile File(path);
+    if (!File.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        cerr << "Unable to write " << path.toStdString() << endl;
+        return;
+    }
+
+    QTextStream out(&File);
+    out.setRealNumberPrecision(10);
+    for (size_t i=0; i<D.Rows; i++) {
+        for (int c=0; c<D.Width; c++) {
+            if (c) { out << ','; }
+            out << D.C[c][i];
+        }
+        out << '\n';
+    }
+
+}
+
+static void writeSummary(QTextStream &out, const Summary_Map &Summary) {
+
+    out << "channel\tduration_ms\tn\tdead_time_s\tdead_time_sd\ttau_s\ttau_sd\tpeak_C\tpeak_sd\tovershoot_C\tovershoot_sd\n";
+
+    for (Summary_Map::const_iterator it=Summary.begin(); it!=Summary.end(); ++it) {
+        const Fit_Stats &S = it->second;
+        out << channelName(it->first.first) << '\t' << it->first.second*10 << '\t' << S.n;
+        for (int i=0; i<4; i++) {
+            out << '\t' << QString::number(S.mean[i], 'f', 4) << '\t' << QString::number(S.sd(i), 'f', 4);
+        }
+        out << '\n';
+    }
+
+}
+
+/* === Main ========================================================== */
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("ThermoCalib");
+
+    QCommandLineParser Parser;
+    Parser.setApplicationDescription("Step-response calibration of the ThermoMaster Peltier zones.");
+    Parser.addHelpOption();
+    Parser.addPositionalArgument("files", "Capture files (comma or space separated columns).", "[files...]");
+
+    QCommandLineOption oPort(QStringList() << "p" << "port", "Capture from a serial port.", "port");
+    QCommandLineOption oDuration(QStringList() << "d" << "duration", "Serial capture duration (s).", "seconds", "150");
+    QCommandLineOption oStim(QStringList() << "s" << "stim", "Stimulus column (0-based).", "column", "5");
+    QCommandLineOption oOutput(QStringList() << "o" << "output", "Summary file (default: stdout).", "file");
+    QCommandLineOption oRaw(QStringList() << "r" << "raw", "Save the serial capture as CSV.", "file");
+    Parser.addOption(oPort);
+    Parser.addOption(oDuration);
+    Parser.addOption(oStim);
+    Parser.addOption(oOutput);
+    Parser.addOption(oRaw);
+    Parser.process(a);
+
+    int stim = Parser.value(oStim).toInt();
+    Summary_Map Summary;
+    size_t nRows = 0, nPulses = 0;
+
+    QElapsedTimer Timer;
+    Timer.start();
+
+    // --- Serial capture
+    if (Parser.isSet(oPort)) {
+
+        Columns D;
+        StepFit F(D, stim);
+        if (!capture(Parser.value(oPort), Parser.value(oDuration).toDouble(), D, F)) { return 1; }
+        if (Parser.isSet(oRaw)) { writeRaw(Parser.value(oRaw), D); }
+
+        Summary = F.Summary;
+        nRows += D.Rows;
+        nPulses += F.Pulses.size();
+        Timer.restart();
+
+    }
+
+    // --- Capture files, pooled in a single summary
+    foreach (const QString &path, Parser.positionalArguments()) {
+
+        Columns D;
+        StepFit F(D, stim);
+        if (!loadFile(path, D, F)) { return 1; }
+
+        for (Summary_Map::const_iterator it=F.Summary.begin(); it!=F.Summary.end(); ++it) {
+            Summary[it->first].merge(it->second);
+        }
+        nRows += D.Rows;
+        nPulses += F.Pulses.size();
+
+    }
+
+    if (!nRows) { Parser.showHelp(1); }
+
+    cerr << nRows << " rows, " << nPulses << " pulse fits in " << Timer.elapsed() << " ms" << endl;
+
+    // --- Summary
+    if (Parser.isSet(oOutput)) {
+        QFile File(Parser.value(oOutput));
+        if (!File.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            cerr << "Unable to write " << Parser.value(oOutput).toStdString() << endl;
+            return 1;
+        }
+        QTextStream out(&File);
+        writeSummary(out, Summary);
+    } else {
+        QTextStream out(stdout);
+        writeSummary(out, Summary);
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Session log reader
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = ThermoLog
+TEMPLATE = app
+
+include(../ThermoMaster/ThermoCore.pri)
+
+SOURCES += main.cpp
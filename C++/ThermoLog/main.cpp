@@ -0,0 +1,132 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <iostream>
+#include <limits>
+
+#include "LogReader.h"
+
+using namespace std;
+
+/* =================================================================== *\
+|    ThermoLog                                                          |
+\* =================================================================== */
+
+// Prints the records of ThermoMaster session logs in a time range and
+// above a severity, without loading whole files.
+
+static qint64 parseTime(const QString &s, bool &ok) {
+
+    // Epoch in ms, or ISO 8601 local date and time
+    qint64 t = s.toLongLong(&ok);
+    if (ok) { return t; }
+
+    QDateTime D = QDateTime::fromString(s, Qt::ISODate);
+    ok = D.isValid();
+    return D.toMSecsSinceEpoch();
+
+}
+
+static QString format(const Log_Line &L) {
+
+    static const char* Levels[] = { "debug", "info", "warning", "critical", "fatal" };
+
+    QJsonObject O = QJsonDocument::fromJson(QByteArray(L.begin, L.end-L.begin)).object();
+
+    QString S = QDateTime::fromMSecsSinceEpoch(L.time).toString("yyyy-MM-dd hh:mm:ss.zzz");
+    S += QString(" %1 ").arg(L.rank>=0 ? Levels[L.rank] : "?", -8);
+    S += O.value("text").toString();
+
+    QJsonObject F = O.value("fields").toObject();
+    for (QJsonObject::const_iterator it=F.begin(); it!=F.end(); ++it) {
+        S += " " + it.key() + "=";
+        S += it.value().isString() ? it.value().toString() : QString::number(it.value().toDouble(), 'g', 10);
+    }
+
+    return S;
+
+}
+
+/* === Main ========================================================== */
+
+int main(int argc, char *argv[]) {
+
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("ThermoLog");
+
+    QCommandLineParser Parser;
+    Parser.setApplicationDescription("Reader of the ThermoMaster session logs.");
+    Parser.addHelpOption();
+    Parser.addPositionalArgument("paths", "Session logs, or directories of session logs.", "paths...");
+
+    QCommandLineOption oFrom(QStringList() << "f" << "from", "Start of the time range (ISO date and time, or ms since epoch).", "time");
+    QCommandLineOption oTo(QStringList() << "t" << "to", "End of the time range.", "time");
+    QCommandLineOption oLevel(QStringList() << "l" << "level", "Minimal severity (debug, info, warning, critical, fatal).", "level", "debug");
+    QCommandLineOption oJson(QStringList() << "j" << "json", "Print the raw JSON records.");
+    Parser.addOption(oFrom);
+    Parser.addOption(oTo);
+    Parser.addOption(oLevel);
+    Parser.addOption(oJson);
+    Parser.process(a);
+
+    // --- Filters
+    qint64 from = std::numeric_limits<qint64>::min();
+    qint64 to = std::numeric_limits<qint64>::max();
+    bool ok = true;
+    if (Parser.isSet(oFrom)) { from = parseTime(Parser.value(oFrom), ok); }
+    if (ok && Parser.isSet(oTo)) { to = parseTime(Parser.value(oTo), ok); }
+    if (!ok) {
+        cerr << "Invalid time" << endl;
+        return 1;
+    }
+
+    QByteArray level = Parser.value(oLevel).toLatin1();
+    int rank = LogReader::rankOf(level.constData(), level.size());
+    if (rank<0) {
+        cerr << "Invalid level " << level.constData() << endl;
+        return 1;
+    }
+    static const QtMsgType Types[] = { QtDebugMsg, QtInfoMsg, QtWarningMsg, QtCriticalMsg, QtFatalMsg };
+
+    // --- Files, in name (hence time) order
+    QStringList Files;
+    foreach (const QString &path, Parser.positionalArguments()) {
+        if (QFileInfo(path).isDir()) {
+            QDir D(path);
+            foreach (const QString &f, D.entryList(QStringList() << "Session_*.jsonl", QDir::Files, QDir::Name)) {
+                Files << D.filePath(f);
+            }
+        } else { Files << path; }
+    }
+    if (Files.isEmpty()) { Parser.showHelp(1); }
+
+    // --- Records
+    QTextStream out(stdout);
+    bool json = Parser.isSet(oJson);
+
+    foreach (const QString &path, Files) {
+
+        LogReader R;
+        R.setRange(from, to);
+        R.setMinLevel(Types[rank]);
+        if (!R.open(path)) {
+            cerr << "Unable to open " << path.toStdString() << endl;
+            continue;
+        }
+
+        Log_Line L;
+        while (R.next(L)) {
+            if (json) { out << QString::fromUtf8(L.begin, L.end-L.begin) << '\n'; }
+            else { out << format(L) << '\n'; }
+        }
+
+    }
+
+    return 0;
+
+}
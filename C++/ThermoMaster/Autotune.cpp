@@ -0,0 +1,228 @@
+#include "Autotune.h"
+
+/* =================================================================== *\
+|    Autotune Class                                                     |
+\* =================================================================== */
+
+/* === Tuning rules ================================================== */
+
+// Kp/Ku, Ti/Tu and Td/Tu, ordered from aggressive to conservative
+static const double RuleCoeffs[Autotune::nRules][3] = {
+    { 0.60, 0.50, 0.125 },      // Ziegler–Nichols (~25% overshoot)
+    { 0.70, 0.40, 0.150 },      // Pessen integral rule
+    { 0.33, 0.50, 0.330 },      // Some overshoot
+    { 0.20, 0.50, 0.330 },      // No overshoot
+    { 0.45, 2.20, 0.159 }       // Tyreus–Luyben
+};
+
+static const char* RuleNames[Autotune::nRules] = {
+    "Ziegler-Nichols",
+    "Pessen integral",
+    "Some overshoot",
+    "No overshoot",
+    "Tyreus-Luyben"
+};
+
+const char* Autotune::ruleName(int rule) { return RuleNames[rule]; }
+
+const double Autotune::DerivativeLimit = 4;
+
+/* === Constructor =================================================== */
+
+Autotune::Autotune() {
+
+    Zone = 'L';
+    Cycles = 4;
+    SkipCycles = 2;
+    start('L', 28, 150, 0.1);
+
+}
+
+/* === Start experiment ============================================== */
+
+void Autotune::start(char zone, double target, double amplitude, double hysteresis) {
+
+    Zone = zone;
+    Target = target;
+    Amplitude = amplitude;
+    Hysteresis = hysteresis;
+
+    Relay = 0;
+    tSwitch = 0;
+    seekPeak = false;
+
+    t.clear();
+    Temp.clear();
+    tUp.clear();
+    Lags.clear();
+    Highs.clear();
+    Lows.clear();
+    Ups.clear();
+    Downs.clear();
+
+}
+
+/* === New sample ==================================================== */
+
+void Autotune::addSample(double ts, double T, int relay, bool fromBoard) {
+
+    t.push_back(ts);
+    Temp.push_back(T);
+
+    // --- Track the extremum following the last switch
+    if (seekPeak) {
+        if ((Relay>0 && T<=TPeak) || (Relay<0 && T>=TPeak)) {
+            TPeak = T;
+            tPeak = ts;
+        } else {
+            // Direction reversed: the previous sample was the extremum
+            Lags.push_back(tPeak - tSwitch);
+            if (Relay>0) { Lows.push_back(TPeak); } else { Highs.push_back(TPeak); }
+            seekPeak = false;
+        }
+    }
+
+    // --- Relay of the firmware, or with hysteresis as in the firmware
+    int prev = Relay;
+    if (fromBoard) { Relay = relay; }
+    else {
+        double err = Target - T;
+        if (err>Hysteresis) { Relay = 1; }
+        else if (err<-Hysteresis) { Relay = -1; }
+    }
+
+    if (Relay!=prev && prev!=0) {
+        tSwitch = ts;
+        seekPeak = true;
+        TPeak = T;
+        tPeak = ts;
+        if (Relay>0) { tUp.push_back(ts); Ups.push_back(T); }
+        else { Downs.push_back(T); }
+    }
+
+}
+
+/* === Completion ==================================================== */
+
+bool Autotune::done() const {
+
+    return (int) tUp.size() > SkipCycles + Cycles
+        && (int) Highs.size() > SkipCycles + Cycles
+        && (int) Lows.size() > SkipCycles + Cycles;
+
+}
+
+/* === Identification ================================================ */
+
+Relay_Result Autotune::result() const {
+
+    Relay_Result R;
+    R.valid = false;
+
+    if (!done()) { return R; }
+
+    // --- Ultimate period
+    int i0 = SkipCycles;
+    R.Tu = (tUp[i0+Cycles] - tUp[i0])/Cycles;
+
+    // --- Oscillation amplitude
+    double hi = 0, lo = 0, su = 0, sd = 0, L = 0;
+    for (int i=i0; i<i0+Cycles; i++) {
+        hi += Highs[i];
+        lo += Lows[i];
+        su += Ups[i];
+        sd += Downs[i];
+    }
+    R.a = (hi - lo)/Cycles/2;
+
+    // Dead time: after a switch the output keeps going for L before turning
+    int nL = 0;
+    for (unsigned int i=2*i0; i<Lags.size(); i++) { L += Lags[i]; nL++; }
+    L = nL ? L/nL : 0;
+
+    // --- Loop period (median of sample intervals)
+    std::vector<double> dts;
+    for (unsigned int i=1; i<t.size(); i++) { dts.push_back(t[i]-t[i-1]); }
+    std::nth_element(dts.begin(), dts.begin() + dts.size()/2, dts.end());
+    R.dt = dts[dts.size()/2];
+
+    if (R.a<=Hysteresis || R.Tu<=0 || R.dt<=0) { return R; }
+
+    // --- Describing function of the relay
+    R.Ku = 4*Amplitude/(M_PI*R.a);
+
+    // --- FOPDT model
+    // During the dead time after a switch, the zone keeps relaxing towards
+    // the asymptote of the previous relay state. Peaks then give these
+    // asymptotes (hence K and the ambient temperature) for a given tau, and
+    // tau is the one for which the predicted period matches Tu. Switching
+    // levels are taken from the data rather than the nominal hysteresis, as
+    // the relay only switches on the first sample beyond the threshold.
+    double ah = hi/Cycles - Target;
+    double al = lo/Cycles - Target;
+    double eh = sd/Cycles - Target;
+    double el = su/Cycles - Target;
+
+    double la = log(std::max(L, 0.01*R.dt)/50);
+    double lb = log(1e5);
+    double H = 0, C = 0;
+
+    for (int it=0; it<100; it++) {
+
+        double lt = (la+lb)/2;
+        double tau = exp(lt);
+        double E = exp(-L/tau);
+
+        H = (ah - eh*E)/(1-E);
+        C = (al - el*E)/(1-E);
+
+        // Predicted period: cooling half plus heating half
+        double Tp = 2*L + tau*(log((ah - C)/(el - C)) + log((H - al)/(H - eh)));
+
+        if (Tp>R.Tu) { lb = lt; } else { la = lt; }
+
+    }
+
+    R.Model.tau = exp((la+lb)/2);
+    R.Model.L = L;
+    R.Model.K = (H - C)/2/Amplitude;
+    R.Model.ambient = Target + (H + C)/2;
+
+    if (!(R.Model.K>0) || !(R.Model.tau>0)) { return R; }
+
+    R.valid = true;
+    return R;
+
+}
+
+/* === Gains proposal ================================================ */
+
+PID_Gains Autotune::gains(const Relay_Result &R, int rule) {
+
+    double Kp = RuleCoeffs[rule][0]*R.Ku;
+    double Ti = RuleCoeffs[rule][1]*R.Tu;
+    double Td = RuleCoeffs[rule][2]*R.Tu;
+
+    // Continuous gains to the per-iteration form used by the firmware:
+    // the derivative term multiplies the change of the error over one
+    // iteration, unfiltered
+    PID_Gains G;
+    G.P = Kp;
+    G.I = Kp*R.dt/Ti;
+    G.D = std::min(Kp*Td/R.dt, DerivativeLimit*Kp);
+
+    G.Step = validate(R, G);
+
+    return G;
+
+}
+
+/* === Validation ==================================================== */
+
+Step_Response Autotune::validate(const Relay_Result &R, const PID_Gains &G) {
+
+    // 2°C step on the identified plant, with the firmware PID replica
+    double T0 = std::max(R.Model.ambient + 4, 26.0);
+    return simulateStep(R.Model, G.P, G.I, G.D, R.dt, T0, T0+2);
+
+}
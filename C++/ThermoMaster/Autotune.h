@@ -0,0 +1,83 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "PlantModel.h"
+
+/* =================================================================== *\
+|    Relay-feedback autotuning                                          |
+\* =================================================================== */
+
+// Åström–Hägglund relay experiment on one zone. The firmware drives the
+// zone with ±Amplitude around its target (see "tune" in ThermoMaster.ino)
+// and the host feeds the same temperature samples here, with the relay
+// state the firmware applied after each of them (last column of the Data
+// line). Without it (older firmware), the relay is reproduced from the
+// temperatures, which may switch a sample off when they are rounded.
+//
+// The firmware has no derivative filter: D is bounded to DerivativeLimit
+// times P, the gain at high frequencies of a filtered derivative.
+
+struct Relay_Result {
+
+    bool valid;
+    double Ku;          // Ultimate gain (PWM units per °C)
+    double Tu;          // Ultimate period (s)
+    double a;           // Oscillation amplitude (°C)
+    double dt;          // Firmware loop period (s)
+    Plant_Params Model; // FOPDT model consistent with (Ku, Tu) and the dead time
+
+};
+
+struct PID_Gains {
+
+    double P, I, D;     // Firmware units (per loop iteration)
+    Step_Response Step; // Predicted response to a 2°C step
+
+};
+
+class Autotune {
+
+public:
+
+    enum Rule { ZieglerNichols, PessenIntegral, SomeOvershoot, NoOvershoot, TyreusLuyben, nRules };
+
+    Autotune();
+
+    void start(char zone, double target, double amplitude, double hysteresis);
+    void addSample(double t, double T, int relay, bool fromBoard);     // t monotonic, in s
+    bool done() const;
+
+    char Zone;
+    int Cycles;         // Cycles kept for identification
+    int SkipCycles;     // Transient cycles discarded at start
+
+    Relay_Result result() const;
+
+    static const double DerivativeLimit;
+
+    static const char* ruleName(int);
+    static PID_Gains gains(const Relay_Result&, int rule);
+    static Step_Response validate(const Relay_Result&, const PID_Gains&);
+
+private:
+
+    double Target, Amplitude, Hysteresis;
+
+    int Relay;
+    double tSwitch;
+    bool seekPeak;
+    double tPeak, TPeak;
+
+    std::vector<double> t, Temp;
+    std::vector<double> tUp;        // Times of switches to heating
+    std::vector<double> Lags;       // Switch-to-extremum delays
+    std::vector<double> Highs, Lows;
+    std::vector<double> Ups, Downs;  // Temperatures at switches
+
+};
+
+#endif // AUTOTUNE_H
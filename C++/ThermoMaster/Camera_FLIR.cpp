@@ -1,4 +1,7 @@
 #include "Camera_FLIR.h"
+#include "FrameKernels.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 /* =================================================================== *\
 |    LowLevel_FLIR Class                                                |
@@ -16,6 +19,10 @@ LowLevel_FLIR::LowLevel_FLIR(int CamIdx) {
     CamId = CamIdx;
     grabState = false;
     CstAvg = -1;
+    Stream = 0;
+    PixelFormat = "Mono8";
+    WindowLow = 0;
+    WindowHigh = 0;
 
     // Camera initialization
     FLIR_system = System::GetInstance();
@@ -90,6 +97,7 @@ void LowLevel_FLIR::grab() {
 
     // Thread info
     qInfo().nospace() << THREAD << qPrintable(CamName) << " lives in thread: " << QThread::currentThreadId();
+    Trace::setThreadName("Camera " + CamName);
 
     // --- Camera & nodemaps definitions -----------------------------------
 
@@ -189,6 +197,17 @@ void LowLevel_FLIR::grab() {
     ExposureTime->SetValue(Exposure);
     qInfo() << "Exposure time set to " << Exposure/1000 << "ms";
 
+    // === Pixel format =========================
+
+    CEnumerationPtr ptrPixelFormat = nodeMap.GetNode("PixelFormat");
+    if (IsAvailable(ptrPixelFormat) && IsWritable(ptrPixelFormat)) {
+        CEnumEntryPtr ptrFormat = ptrPixelFormat->GetEntryByName(PixelFormat.toLatin1().constData());
+        if (IsAvailable(ptrFormat) && IsReadable(ptrFormat)) {
+            ptrPixelFormat->SetIntValue(ptrFormat->GetValue());
+            qInfo() << "Pixel format set to" << qPrintable(PixelFormat);
+        } else { qWarning() << "Pixel format" << qPrintable(PixelFormat) << "not available"; }
+    }
+
     // === Image size ===========================
 
     CIntegerPtr pWidth = nodeMap.GetNode("Width");
@@ -203,6 +222,30 @@ void LowLevel_FLIR::grab() {
     CIntegerPtr pOffsetY = nodeMap.GetNode("OffsetY");
     if (IsAvailable(pOffsetY) && IsWritable(pOffsetY)) { pOffsetY->SetValue(OffsetY); }
 
+    // --- Metrics ---------------------------------------------------------
+
+    QString Cam = QString("camera=\"%1\"").arg(CamId);
+    Metric_Counter *mFrames = Metrics::counter("thermo_camera_frames_total", "Frames received from the camera", Cam);
+    Metric_Counter *mIncomplete = Metrics::counter("thermo_camera_incomplete_total", "Incomplete frames discarded", Cam);
+    Metric_Counter *mSkipped = Metrics::counter("thermo_camera_skipped_total", "Frames missing from the frame ID sequence", Cam);
+    Metric_Histogram *mInterval = Metrics::histogram("thermo_camera_frame_interval_seconds",
+        "Time between consecutive frames, camera clock", Metrics::exponential(0.002, 2, 10), Cam);
+    Metric_Gauge *mMean = Metrics::gauge("thermo_camera_mean_level", "Mean sensor level of the last frame", Cam);
+    Metric_Gauge *mMotion[3];
+    const char* Regions[] = { "left", "right", "roi" };
+    for (int i=0; i<3; i++) {
+        mMotion[i] = Metrics::gauge("thermo_motion_level", "Mean absolute difference to the previous frame",
+                                    Cam + QString(",region=\"%1\"").arg(Regions[i]));
+    }
+    qint64 lastTimestamp = -1, lastFrameId = -1;
+    QImage Previous;
+
+    // High bit-depth formats: unpacked pixels and display window
+    QVector<quint16> Unpacked;
+    QVector<uchar> Window;
+    int windowBits = 0, low = 0, high = 255;
+    bool unsupported = false;
+
     // --- Acquire images --------------------------------------------------
 
     grabState = true;
@@ -213,44 +256,149 @@ void LowLevel_FLIR::grab() {
     while (grabState) {
 
         ImagePtr pImg = pCam->GetNextImage();
+        qint64 host = Trace::now();
+        TRACE_SPAN("grab");
+
+        // --- Sensor levels: 8 bits, 16-bit words, or packed
+        int bits = 8;
+        const quint16 *Px = 0;
+        const uchar* Raw = (const uchar*) pImg->GetData();
+        int w = pImg->GetWidth();
+        int h = pImg->GetHeight();
+        qint64 n = (qint64) w*h;
+
+        if (!pImg->IsIncomplete()) {
+            PixelFormatEnums Format = pImg->GetPixelFormat();
+            switch (Format) {
+            case PixelFormat_Mono8: break;
+            case PixelFormat_Mono10: bits = 10; Px = (const quint16*) Raw; break;
+            case PixelFormat_Mono12: bits = 12; Px = (const quint16*) Raw; break;
+            case PixelFormat_Mono16: bits = 16; Px = (const quint16*) Raw; break;
+            case PixelFormat_Mono10Packed:
+            case PixelFormat_Mono10p:
+                bits = 10;
+                Unpacked.resize(n);
+                unpack10(Raw, Unpacked.data(), n, Format==PixelFormat_Mono10p);
+                Px = Unpacked.constData();
+                break;
+            case PixelFormat_Mono12Packed:
+            case PixelFormat_Mono12p:
+                bits = 12;
+                Unpacked.resize(n);
+                unpack12(Raw, Unpacked.data(), n, Format==PixelFormat_Mono12p);
+                Px = Unpacked.constData();
+                break;
+            default:
+                bits = 0;
+                if (!unsupported) { qWarning() << "Unsupported pixel format" << pImg->GetPixelFormatName().c_str(); }
+                unsupported = true;
+            }
+        }
 
         if (pImg->IsIncomplete()) {
 
-            qWarning() << "Image incomplete with image status " << pImg->GetImageStatus();
+            Log(QtWarningMsg).text("Image incomplete").field("status", (int) pImg->GetImageStatus());
+            mIncomplete->add();
 
-        } else {
+        } else if (bits) {
 
             Image_FLIR FImg;
+            FImg.bits = bits;
+
+            if (Px) {
+
+                // Sensor levels, mirrored, for the recorder
+                FImg.Raw = QImage(w, h, QImage::Format_Grayscale16);
+                FImg.Raw.setText("Bits", QString::number(bits));
+                quint16 *R16 = (quint16*) FImg.Raw.bits();
+                int stride = FImg.Raw.bytesPerLine()/2;
+                mirrorFrame16(Px, w, R16, stride, w, h);
+                FImg.rawMean = frameMean16(Px, n);
+
+                // Display levels through the window, rebuilt with the depth
+                if (bits!=windowBits) {
+                    windowBits = bits;
+                    low = WindowHigh>WindowLow ? WindowLow : 0;
+                    high = WindowHigh>WindowLow ? WindowHigh : (1 << bits) - 1;
+                    Window.resize(1 << bits);
+                    windowTable(Window.data(), bits, low, high);
+                }
+                FImg.Img = QImage(w, h, QImage::Format_Indexed8);
+                mapFrame16(R16, stride, FImg.Img.bits(), FImg.Img.bytesPerLine(), w, h, Window.constData(), bits);
+                FImg.avgval = qBound(0.0, (FImg.rawMean-low)*255.0/(high-low), 255.0);
 
-            // --- Get image and convert to QImage
-            unsigned char* Raw = (unsigned char*)pImg->GetData();
-            FImg.Img = QImage(Raw, pImg->GetWidth(), pImg->GetHeight(), QImage::Format_Indexed8);
+            } else {
+
+                // Get average value
+                FImg.avgval = frameMean(Raw, n);
+                FImg.rawMean = FImg.avgval;
 
-            // Get average value
-            int count = sizeof(Raw)/sizeof(Raw[0]);
-            int sum = std::accumulate<unsigned char*, int>(Raw,Raw + count,0);
-            FImg.avgval = (double)sum/count;
+                // Mirror the image, straight into the QImage
+                FImg.Img = QImage(w, h, QImage::Format_Indexed8);
+                mirrorFrame(Raw, w, FImg.Img.bits(), FImg.Img.bytesPerLine(), w, h);
+
+            }
 
             // Set colors of the QImage
-            if (CstAvg<0) {
-                for (unsigned int i=0 ; i<=255; i++) { FImg.Img.setColor(i, qRgb(i,i,i)); }
-            } else {
-                for (unsigned int i=0 ; i<=255; i++) {
-                    int j = round(max(0.0,min(255.0,double(i)*CstAvg/FImg.avgval)));
-                    FImg.Img.setColor(i, qRgb(j,j,j));
+            uchar Lut[256];
+            normalizationTable(Lut, CstAvg, FImg.avgval);
+            QVector<QRgb> Colors(256);
+            for (int i=0; i<256; i++) { Colors[i] = qRgb(Lut[i], Lut[i], Lut[i]); }
+            FImg.Img.setColorTable(Colors);
+
+            // --- Motion energy, against the previous frame (sensor levels)
+            FImg.motionLeft = FImg.motionRight = FImg.motionRoi = qQNaN();
+            const QImage &Current = Px ? FImg.Raw : FImg.Img;
+            if (Previous.size()==Current.size() && Previous.format()==Current.format()) {
+
+                int half = w/2;
+                QRect R = MotionRoi & Current.rect();
+                quint64 left, right, roi = 0;
+
+                if (Px) {
+                    const quint16 *a = (const quint16*) Previous.constBits(), *b = (const quint16*) Current.constBits();
+                    int stride = Current.bytesPerLine()/2;
+                    qint64 o = (qint64) R.y()*stride + R.x();
+                    left = frameSad16(a, b, stride, half, h);
+                    right = frameSad16(a+half, b+half, stride, w-half, h);
+                    if (!R.isEmpty()) { roi = frameSad16(a+o, b+o, stride, R.width(), R.height()); }
+                } else {
+                    const uchar *a = Previous.constBits(), *b = Current.constBits();
+                    int stride = Current.bytesPerLine();
+                    qint64 o = (qint64) R.y()*stride + R.x();
+                    left = frameSad(a, b, stride, half, h);
+                    right = frameSad(a+half, b+half, stride, w-half, h);
+                    if (!R.isEmpty()) { roi = frameSad(a+o, b+o, stride, R.width(), R.height()); }
                 }
-            }
 
-            // Mirror the image
-            FImg.Img = FImg.Img.mirrored(true, true);
+                FImg.motionLeft = (double) left/qMax(1, half*h);
+                FImg.motionRight = (double) right/qMax(1, (w-half)*h);
+                if (!R.isEmpty()) { FImg.motionRoi = (double) roi/(R.width()*R.height()); }
+
+                mMotion[0]->set(FImg.motionLeft);
+                mMotion[1]->set(FImg.motionRight);
+                mMotion[2]->set(FImg.motionRoi);
+            }
+            Previous = Current;
 
             // --- Get ChunkData
             ChunkData chunkData = pImg->GetChunkData();
             FImg.CameraName = CamName;
             FImg.timestamp = (qint64) chunkData.GetTimestamp();
+            FImg.host = host;
             FImg.frameId = (qint64) chunkData.GetFrameID();
             FImg.gain = (qint64) chunkData.GetGain();
 
+            mFrames->add();
+            mMean->set(FImg.rawMean);
+            if (lastTimestamp>=0) { mInterval->observe((FImg.timestamp-lastTimestamp)*1e-9); }
+            if (lastFrameId>=0 && FImg.frameId>lastFrameId+1) { mSkipped->add(FImg.frameId-lastFrameId-1); }
+            lastTimestamp = FImg.timestamp;
+            lastFrameId = FImg.frameId;
+
+            // External readers get the frame before the event loops
+            if (Stream) { Stream->publish(FImg.Img, FImg.timestamp, FImg.frameId, FImg.avgval); }
+
             emit newImage(FImg);
 
         }
@@ -275,6 +423,10 @@ Camera_FLIR::Camera_FLIR(int CamIdx) {
     // Initialisation
     CamId = CamIdx;
     DisplayRate = 25;
+    Stream = 0;
+    PixelFormat = "Mono8";
+    WindowLow = 0;
+    WindowHigh = 0;
 
 }
 
@@ -286,6 +438,40 @@ Camera_FLIR::~Camera_FLIR() {
     t_Cam->wait();
 }
 
+/* === Connected cameras ============================================= */
+
+int Camera_FLIR::available() {
+
+    SystemPtr FLIR_system = System::GetInstance();
+    CameraList FLIR_camList = FLIR_system->GetCameras();
+    int n = FLIR_camList.GetSize();
+    FLIR_camList.Clear();
+    return n;
+
+}
+
+/* === Settings ====================================================== */
+
+void Camera_FLIR::load(const QSettings &Settings) {
+
+    PixelFormat = Settings.value("Camera/PixelFormat", "Mono8").toString();
+
+    // Display window of the high bit-depth formats, low,high in sensor levels
+    QStringList W = Settings.value("Camera/Window").toString().split(",");
+    if (W.size()==2) {
+        WindowLow = W[0].toInt();
+        WindowHigh = W[1].toInt();
+    }
+
+    // Region of interest of the motion energy, x,y,w,h in image pixels
+    QStringList Roi = Settings.value("Motion/Roi").toString().split(",");
+    if (Roi.size()==4) { MotionRoi = QRect(Roi[0].toInt(), Roi[1].toInt(), Roi[2].toInt(), Roi[3].toInt()); }
+
+    // Displayed frames only: recording, motion and stream keep every pixel
+    Display.load(Settings, "Display");
+
+}
+
 /* === New Camera ==================================================== */
 
 void Camera_FLIR::newCamera() {
@@ -298,8 +484,12 @@ void Camera_FLIR::newCamera() {
     Camera->Width = X2-X1;
     Camera->Height = Y2-Y1;
     Camera->CstAvg = -1;
+    Camera->Stream = Stream;
+    Camera->MotionRoi = MotionRoi;
+    Camera->PixelFormat = PixelFormat;
+    Camera->WindowLow = WindowLow;
+    Camera->WindowHigh = WindowHigh;
     tRefDisp = -1;
-    tRefSave = -1;
 
     // Change camera thread
     t_Cam = new QThread;
@@ -326,23 +516,22 @@ void Camera_FLIR::display_info() { Camera->display_info(); }
 
 void Camera_FLIR::newImage(Image_FLIR FImg) {
 
-    // --- Initialize time references
-    if (tRefDisp==-1) { tRefDisp = FImg.timestamp; }
-    if (tRefSave==-1) { tRefSave = FImg.timestamp; }
-
-    // --- Get image
-    QPixmap Pixmap = QPixmap::fromImage(FImg.Img);
+    TRACE_SPAN("newImage");
 
     // Update timestamp and average value
     timestamp = FImg.timestamp;
     avgval = FImg.avgval;
 
-    // --- Save image ? -------------------------------------------------
+    // --- Every frame, for recording -----------------------------------
+
+    emit newFrame(FImg);
 
     // --- Display image ? ----------------------------------------------
 
-    if (FImg.timestamp-tRefDisp >= 1e9/DisplayRate) {
-        emit newImageForDisplay(Pixmap);
+    if (!Display.take()) { return; }
+    if (tRefDisp==-1 || FImg.timestamp-tRefDisp >= 1e9/DisplayRate) {
+        tRefDisp = FImg.timestamp;
+        emit newImageForDisplay(Display.apply(FImg.Img));
     }
 
 }
@@ -5,30 +5,47 @@
 #include <QThread>
 #include <QString>
 #include <QImage>
-#include <QPixmap>
+#include <QRect>
 #include <QDebug>
 
 #include <QTime>
 #include <QTimer>
+#include <QRegExp>
+#include <QSettings>
+#include <QVector>
 
 #include "Spinnaker.h"
 #include "SpinGenApi/SpinnakerGenApi.h"
 
 #include "MsgHandler.h"
+#include "FrameStream.h"
+#include "FrameStage.h"
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
 using namespace Spinnaker::GenICam;
 using namespace std;
 
+// Frames of the high bit-depth formats (Mono10, Mono12, Mono16 and the
+// packed variants) are kept in Raw, unpacked to 16 bits; Img shows them
+// through the display window, and the statistics (mean, motion) are in
+// sensor levels.
+
 struct Image_FLIR {
 
     QString CameraName;
     qint64 frameId;
     qint64 timestamp;
+    qint64 host;            // Host clock at reception (ns, Trace::now())
     qint64 gain;
-    double avgval;
-    QImage Img;
+    double avgval;          // Display levels (0-255)
+    double rawMean;         // Sensor levels
+    int bits;               // Significant bits of the sensor levels
+    double motionLeft;      // Mean absolute difference to the previous frame,
+    double motionRight;     // per pixel, on each half and in the region of
+    double motionRoi;       // interest (NaN without one)
+    QImage Img;             // Display levels (Indexed8)
+    QImage Raw;             // Sensor levels (Grayscale16), null for Mono8
 
 };
 
@@ -57,6 +74,10 @@ public:
     int64_t Height;
     bool grabState;
     double CstAvg;
+    FrameStream *Stream;        // Every frame, from the acquisition thread
+    QRect MotionRoi;            // Image coordinates, empty for none
+    QString PixelFormat;        // GenICam name: Mono8, Mono12, Mono12Packed, Mono12p...
+    int WindowLow, WindowHigh;  // Sensor levels shown as 0-255, full range if empty
 
 public slots:
 
@@ -91,12 +112,19 @@ public:
     Camera_FLIR(int);
     ~Camera_FLIR();
 
+    static int available();
+    void load(const QSettings&);        // Camera/PixelFormat, Camera/Window, Motion/Roi, Display/*
     void newCamera();
     void setCstAvg(double);
 
     float DisplayRate;
     float Exposure;
     int X1, X2, Y1, Y2;
+    FrameStream *Stream;        // Shared-memory ring, if set
+    QRect MotionRoi;            // Motion energy region (image coordinates)
+    QString PixelFormat;
+    int WindowLow, WindowHigh;
+    FrameStage Display;         // Binning and decimation of the displayed frames
     qint64 timestamp;
     double avgval;
 
@@ -111,7 +139,8 @@ public slots:
 
 signals:
 
-    void newImageForDisplay(QPixmap);
+    void newFrame(Image_FLIR);
+    void newImageForDisplay(QImage);
 
 private:
 
@@ -120,7 +149,6 @@ private:
 
     Image_FLIR Image;
     qint64 tRefDisp;
-    qint64 tRefSave;
 
 };
 
@@ -0,0 +1,184 @@
+#include "ClipRecorder.h"
+#include "Recorder.h"
+#include "MsgHandler.h"
+#include "Trace.h"
+#include "Metrics.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QDebug>
+
+/* === Constructor =================================================== */
+
+ClipRecorder::ClipRecorder(QObject *parent) : QObject(parent) {
+
+    PreTrigger = 5;
+    PostTrigger = 10;
+    MaxBytes = 512 << 20;
+    MaxPendingBytes = 512 << 20;
+    WriteBatch = 4;
+
+    nClip = 0;
+    RingBytes = 0;
+    Capturing = false;
+    tEnd = -1;
+    nFrame = 0;
+    PendingBytes = 0;
+    nQueued = 0;
+    nWritten = 0;
+
+    Writer = new QTimer(this);
+    Writer->setInterval(0);
+    connect(Writer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    mClips = Metrics::counter("thermo_clips_total", "Clips triggered");
+    mDropped = Metrics::counter("thermo_clip_dropped_total", "Clip frames dropped while the writer was behind");
+    mPending = Metrics::gauge("thermo_clip_pending_frames", "Clip frames waiting to be written");
+    mRing = Metrics::gauge("thermo_clip_ring_bytes", "Memory held by the pre-trigger ring");
+
+}
+
+/* === Directory ===================================================== */
+
+void ClipRecorder::setDirectory(const QString &dir) {
+
+    if (dir==Dir) { return; }
+    Dir = dir;
+
+    // Last clip index, scanned once per directory
+    nClip = 0;
+    QFileInfoList FIL = QDir(Dir).entryInfoList(QStringList() << "Clip_*", QDir::Dirs | QDir::NoDotAndDotDot);
+    foreach(const QFileInfo &elm, FIL) { nClip = qMax(nClip, elm.fileName().section('_', 1, 1).toInt()); }
+
+}
+
+/* === Frames ======================================================== */
+
+void ClipRecorder::push(const QImage &Img, qint64 timestamp, double TL, double TR) {
+
+    Clip_Frame F = { Img, timestamp, TL, TR };
+
+    // --- Post-trigger window
+    if (Capturing) {
+
+        if (tEnd<0) { tEnd = timestamp + qRound64(PostTrigger*1e9); }
+
+        if (timestamp<=tEnd) { enqueue(F); }
+        else { close(); }
+
+    }
+
+    // --- Pre-trigger ring
+    Ring.enqueue(F);
+    RingBytes += Img.byteCount();
+
+    qint64 span = qRound64(PreTrigger*1e9);
+    while (!Ring.isEmpty() && (timestamp-Ring.head().timestamp>span || RingBytes>MaxBytes)) {
+        RingBytes -= Ring.head().Img.byteCount();
+        Ring.dequeue();
+    }
+
+    mRing->set(RingBytes);
+    mPending->set(Pending.size());
+
+}
+
+/* === Trigger ======================================================= */
+
+void ClipRecorder::trigger(QString label) {
+
+    if (Dir.isEmpty()) {
+        qWarning() << "No clip directory";
+        return;
+    }
+
+    qint64 last = Ring.isEmpty() ? -1 : Ring.last().timestamp;
+
+    // --- Extend the clip in progress
+    if (Capturing) {
+        if (last>=0) { tEnd = last + qRound64(PostTrigger*1e9); }
+        Log(QtInfoMsg).text("Clip extended").field("clip", nClip).field("label", label);
+        return;
+    }
+
+    // --- New clip
+    label.replace(QRegExp("[^A-Za-z0-9_-]+"), "-");
+    ClipPath = Dir + QString("Clip_%1").arg(++nClip, 4, 10, QLatin1Char('0'));
+    if (!label.isEmpty()) { ClipPath += "_" + label; }
+    ClipPath += QDir::separator();
+
+    if (!QDir().mkpath(ClipPath)) {
+        qWarning() << "Unable to create" << qPrintable(ClipPath);
+        return;
+    }
+
+    Capturing = true;
+    tEnd = last>=0 ? last + qRound64(PostTrigger*1e9) : -1;
+    nFrame = 0;
+
+    // Pre-trigger frames, oldest first
+    for (int i=0; i<Ring.size(); i++) { enqueue(Ring[i]); }
+    Writer->start();
+    mClips->add();
+    mPending->set(Pending.size());
+
+    Log(QtInfoMsg).text("Clip triggered").field("clip", nClip).field("label", label).field("pre_frames", Ring.size());
+
+}
+
+bool ClipRecorder::enqueue(const Clip_Frame &F) {
+
+    qint64 bytes = F.Img.byteCount();
+    if (PendingBytes+bytes>MaxPendingBytes) {
+        mDropped->add();
+        return false;
+    }
+
+    Pending.enqueue(qMakePair(QString(ClipPath + "Frame_%1.pgm").arg(nFrame++, 6, 10, QLatin1Char('0')), F));
+    PendingBytes += bytes;
+    nQueued++;
+    Writer->start();
+    return true;
+
+}
+
+void ClipRecorder::close() {
+
+    Capturing = false;
+    Clip_Closed C = { ClipPath, nFrame, nQueued };
+    Closed.enqueue(C);
+    Writer->start();
+
+}
+
+void ClipRecorder::finish() {
+
+    if (Capturing) { close(); }
+    while (Writer->isActive()) { flush(); }
+
+}
+
+/* === Writer ======================================================== */
+
+void ClipRecorder::flush() {
+
+    TRACE_SPAN("clip write");
+
+    for (int k=0; k<WriteBatch && !Pending.isEmpty(); k++) {
+        QPair<QString, Clip_Frame> P = Pending.dequeue();
+        Recorder::writeFrame(P.first, P.second.Img, Signature, P.second.timestamp, P.second.TL, P.second.TR, Buffer);
+        PendingBytes -= P.second.Img.byteCount();
+        nWritten++;
+    }
+    mPending->set(Pending.size());
+
+    // Clips whose last frame is on disk
+    while (!Closed.isEmpty() && Closed.head().end<=nWritten) {
+        Clip_Closed C = Closed.dequeue();
+        emit clipSaved(C.path, C.frames);
+    }
+
+    if (Pending.isEmpty()) { Writer->stop(); }
+
+}
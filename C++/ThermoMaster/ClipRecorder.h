@@ -0,0 +1,102 @@
+#ifndef CLIPRECORDER_H
+#define CLIPRECORDER_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QQueue>
+#include <QPair>
+#include <QTimer>
+#include <QByteArray>
+
+#include "Metrics.h"
+
+/* =================================================================== *\
+|    ClipRecorder Class                                                 |
+\* =================================================================== */
+
+// Event clips around a trigger. Every frame is kept in memory for the
+// last PreTrigger seconds (camera time, and at most MaxBytes); a trigger
+// saves these frames and the ones of the next PostTrigger seconds in a
+// new Clip_<n>[_<label>] folder. A trigger during a clip extends it.
+//
+// Frames share their data with the camera images, so the ring costs no
+// copy. Files are written a few at a time from the event loop, so that
+// saving the pre-trigger frames does not stall the acquisition. Frames
+// waiting to be written are bounded by MaxPendingBytes: beyond, frames
+// are dropped (and counted) rather than filling the memory. clipSaved is
+// emitted for each clip once all its frames are written.
+
+struct Clip_Frame {
+
+    QImage Img;
+    qint64 timestamp;   // Camera time (ns)
+    double TL, TR;
+
+};
+
+class ClipRecorder : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    ClipRecorder(QObject *parent = 0);
+
+    void setDirectory(const QString&);
+    void push(const QImage&, qint64 timestamp, double TL, double TR);
+    bool isCapturing() const { return Capturing; }
+    void finish();          // Closes the clip in progress and writes everything
+
+    QString Signature;      // "<setup> <version>"
+    double PreTrigger;      // s
+    double PostTrigger;     // s
+    qint64 MaxBytes;        // Memory bound of the ring
+    qint64 MaxPendingBytes; // Memory bound of the frames waiting to be written
+    int WriteBatch;         // Frames written per pass of the event loop
+
+    int nClip;
+    QString ClipPath;
+
+public slots:
+
+    void trigger(QString label = QString());
+
+signals:
+
+    void clipSaved(QString, int);
+
+private slots:
+
+    void flush();
+
+private:
+
+    QString Dir;
+    QQueue<Clip_Frame> Ring;
+    qint64 RingBytes;
+
+    bool Capturing;
+    qint64 tEnd;            // End of the post-trigger window, -1 until the next frame
+    int nFrame;
+
+    QQueue< QPair<QString, Clip_Frame> > Pending;
+    qint64 PendingBytes;
+    qint64 nQueued, nWritten;
+
+    // Clips to report once their frames are written
+    struct Clip_Closed { QString path; int frames; qint64 end; };
+    QQueue<Clip_Closed> Closed;
+
+    QTimer *Writer;
+    QByteArray Buffer;
+
+    Metric_Counter *mClips, *mDropped;
+    Metric_Gauge *mPending, *mRing;
+
+    bool enqueue(const Clip_Frame&);
+    void close();
+
+};
+
+#endif // CLIPRECORDER_H
@@ -0,0 +1,36 @@
+#include "ClockSync.h"
+
+/* === Constructor =================================================== */
+
+ClockSync::ClockSync(double scale, qint64 wrap) : Scale(scale), Wrap(wrap), Window(10) { reset(); }
+
+void ClockSync::reset() {
+
+    Unwrap = 0;
+    Last = -1;
+    Offsets.clear();
+
+}
+
+/* === Events ======================================================== */
+
+qint64 ClockSync::add(qint64 device, qint64 host) {
+
+    // --- Unwrapped device time
+    qint64 d = device + Unwrap;
+    if (Last>=0 && d<Last) {
+        if (Wrap>0 && Last-d > Wrap/2) { Unwrap += Wrap; d += Wrap; }
+        else { reset(); d = device; }
+    }
+    Last = d;
+
+    // --- Running minimum of the offset over the window (monotonic queue)
+    qint64 t = (qint64) (d*Scale);
+    qint64 offset = host - t;
+    while (!Offsets.isEmpty() && Offsets.last().second>=offset) { Offsets.removeLast(); }
+    Offsets.append(qMakePair(t, offset));
+    while (Offsets.first().first < t - (qint64) (Window*1e9)) { Offsets.removeFirst(); }
+
+    return t + Offsets.first().second;
+
+}
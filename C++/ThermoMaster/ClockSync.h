@@ -0,0 +1,49 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <QtGlobal>
+#include <QList>
+#include <QPair>
+
+/* =================================================================== *\
+|    ClockSync Class                                                    |
+\* =================================================================== */
+
+// Maps the time of a device (camera ticks, board micros) to the host
+// monotonic clock (Trace::now(), ns). Each event is stamped twice: by
+// the device, and by the host when it is received. The host stamp is
+// late by a latency that varies from event to event but is never
+// negative, so the offset between the clocks is estimated by the
+// smallest difference host - device over the last Window seconds; the
+// window follows the drift of the device oscillator.
+//
+// Device clocks that wrap (32-bit micros of the board) are unwrapped
+// with a period of Wrap; any other backward step is a reset of the
+// device, which restarts the estimation.
+
+class ClockSync {
+
+public:
+
+    ClockSync(double scale = 1, qint64 wrap = 0);
+
+    void reset();
+
+    // Adds an event, returns its device time on the host clock (ns)
+    qint64 add(qint64 device, qint64 host);
+    bool isValid() const { return !Offsets.isEmpty(); }
+
+    double Scale;           // ns per device unit
+    qint64 Wrap;            // Period of the device clock (device units), 0 if it never wraps
+    double Window;          // s
+
+private:
+
+    qint64 Unwrap, Last;
+
+    // Increasing offsets, and the device times they were seen at (ns)
+    QList< QPair<qint64, qint64> > Offsets;
+
+};
+
+#endif // CLOCKSYNC_H
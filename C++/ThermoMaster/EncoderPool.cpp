@@ -0,0 +1,202 @@
+#include "EncoderPool.h"
+#include "Recorder.h"
+#include "Trace.h"
+
+#include <QCoreApplication>
+#include <QImageWriter>
+#include <QBuffer>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QDebug>
+
+/* === Worker ======================================================== */
+
+class Encoder_Job : public QRunnable {
+
+public:
+
+    Encoder_Job(EncoderPool *P, QSemaphore *Free, qint64 seq, const QString &path, const QImage &Img,
+                qint64 timestamp, const Temperature_Sample &T) :
+        P(P), Free(Free), Seq(seq), Path(path), Img(Img), Format(P->Format), Signature(P->Signature),
+        Timestamp(timestamp), T(T) {}
+
+    void run() {
+
+        TRACE_SPAN("encode");
+
+        QByteArray Buffer;
+        bool ok = EncoderPool::encode(Path + ".part", Img, Format, Signature, Timestamp, T, Buffer);
+
+        // The slot is free before the file is renamed, on the pool's thread
+        Free->release();
+        QMetaObject::invokeMethod(P, "done", Qt::QueuedConnection, Q_ARG(qint64, Seq), Q_ARG(bool, ok));
+
+    }
+
+private:
+
+    EncoderPool *P;
+    QSemaphore *Free;
+    qint64 Seq;
+    QString Path;
+    QImage Img;
+    QString Format, Signature;
+    qint64 Timestamp;
+    Temperature_Sample T;
+
+};
+
+/* === Constructor =================================================== */
+
+EncoderPool::EncoderPool(QObject *parent) : QObject(parent) {
+
+    Format = "pgm";
+    Threads = 0;
+    MaxPending = 32;
+    nCommitted = 0;
+    Capacity = 0;
+    nSubmitted = 0;
+    nNext = 0;
+
+    mPending = Metrics::gauge("thermo_encoder_pending_frames", "Frames submitted to the encoders and not yet on disk");
+    mFiles = Metrics::counter("thermo_encoder_files_total", "Frame files completed by the encoders");
+    mWaits = Metrics::counter("thermo_encoder_waits_total", "Frames that waited for a free encoder");
+    mWait = Metrics::histogram("thermo_encoder_wait_seconds", "Time waited for a free encoder",
+                               Metrics::exponential(0.0005, 2, 12));
+
+}
+
+EncoderPool::~EncoderPool() { Pool.waitForDone(); }
+
+void EncoderPool::load(const QSettings &Settings) {
+
+    setFormat(Settings.value("Recording/Format", "pgm").toString());
+    Threads = Settings.value("Recording/Encoders", 0).toInt();
+    MaxPending = qMax(1, Settings.value("Recording/Queue", 32).toInt());
+
+}
+
+bool EncoderPool::setFormat(const QString &format) {
+
+    Format = format.toLower();
+    if (Format=="tif") { Format = "tiff"; }
+    if (Format!="pgm" && Format!="png" && Format!="tiff") { Format.clear(); }
+
+    // TIFF needs the plugin of Qt Image Formats
+    if (Format.isEmpty() || (Format!="pgm" && !QImageWriter::supportedImageFormats().contains(Format.toLatin1()))) {
+        qWarning() << "Image format" << format << "not available, frames saved as PGM";
+        Format = "pgm";
+        return false;
+    }
+    return true;
+
+}
+
+/* === Frames ======================================================== */
+
+bool EncoderPool::submit(const QString &path, const QImage &Img, qint64 timestamp, const Temperature_Sample &T) {
+
+    if (Threads<=0) {
+        bool ok = encode(path + ".part", Img, Format, Signature, timestamp, T, Buffer);
+        commit(path, ok);
+        return ok;
+    }
+
+    // Queue resized between runs only, when all slots are free
+    if (Capacity!=MaxPending && Paths.isEmpty()) {
+        Free.acquire(Capacity);
+        Capacity = MaxPending;
+        Free.release(Capacity);
+    }
+    if (Pool.maxThreadCount()!=Threads) { Pool.setMaxThreadCount(Threads); }
+
+    // --- Backpressure: wait for a worker rather than drop the frame
+    if (!Free.tryAcquire()) {
+        mWaits->add();
+        QElapsedTimer W;
+        W.start();
+        Free.acquire();
+        mWait->observe(W.nsecsElapsed()*1e-9);
+    }
+
+    qint64 seq = nSubmitted++;
+    Paths.insert(seq, path);
+    mPending->set(Paths.size());
+    Pool.start(new Encoder_Job(this, &Free, seq, path, Img, timestamp, T));
+    return true;
+
+}
+
+void EncoderPool::done(qint64 seq, bool ok) {
+
+    // Files appear in submission order
+    Done.insert(seq, ok);
+    while (Done.contains(nNext)) {
+        commit(Paths.take(nNext), Done.take(nNext));
+        nNext++;
+    }
+    mPending->set(Paths.size());
+
+}
+
+void EncoderPool::commit(const QString &path, bool ok) {
+
+    QString part = path + ".part";
+    if (ok) {
+        QFile::remove(path);
+        ok = QFile::rename(part, path);
+        if (!ok) { qWarning() << "Unable to rename" << qPrintable(part); }
+    }
+    if (!ok) {
+        QFile::remove(part);
+        return;
+    }
+
+    nCommitted++;
+    mFiles->add();
+    emit committed(path);
+
+}
+
+void EncoderPool::finish() {
+
+    Pool.waitForDone();
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+
+}
+
+/* === Encoding ====================================================== */
+
+bool EncoderPool::encode(const QString &path, const QImage &Img, const QString &format, const QString &signature,
+                         qint64 timestamp, const Temperature_Sample &T, QByteArray &Buffer) {
+
+    if (format=="pgm") {
+        return Recorder::writeFrame(path, Img, signature, timestamp, T.TL, T.TR, Buffer, T.targetLeft, T.targetRight);
+    }
+
+    QElapsedTimer Clock;
+    Clock.start();
+
+    // Gray levels, through the color table of indexed images; sensor
+    // levels of high bit-depth frames stay on 16 bits
+    bool keep = Img.format()==QImage::Format_Grayscale8 || Img.format()==QImage::Format_Grayscale16;
+    QImage G = keep ? Img : Img.convertToFormat(QImage::Format_Grayscale8);
+    G.setText("Description", signature + "\n" + Recorder::metadata(timestamp, T.TL, T.TR, T.targetLeft, T.targetRight));
+
+    // Encoded in memory, then written at once
+    Buffer.reserve(G.bytesPerLine()*G.height() + 4096);
+    Buffer.resize(0);
+    QBuffer Device(&Buffer);
+    Device.open(QIODevice::WriteOnly);
+
+    QImageWriter W(&Device, format.toLatin1());
+    if (format=="tiff") { W.setCompression(1); }       // LZW
+    if (!W.write(G)) {
+        qWarning() << "Unable to encode" << qPrintable(path) << "-" << qPrintable(W.errorString());
+        return false;
+    }
+    Device.close();
+
+    return Recorder::writeFile(path, Buffer, Clock);
+
+}
@@ -0,0 +1,87 @@
+#ifndef ENCODERPOOL_H
+#define ENCODERPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QMap>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QSettings>
+
+#include "Metrics.h"
+#include "TemperatureBuffer.h"
+
+/* =================================================================== *\
+|    EncoderPool Class                                                  |
+\* =================================================================== */
+
+// Frame files of the runs, in PGM, PNG or TIFF (Recording/* keys). With
+// Threads at 0, frames are encoded on the caller's thread; otherwise
+// each frame is encoded and written by a worker of the pool, so that
+// PNG and TIFF (deflate, LZW) scale with the cores.
+//
+// Files are written under a temporary name (<path>.part) and renamed in
+// submission order once complete: a reader of the run folder never sees
+// a partial file, nor a frame before the previous ones.
+//
+// At most MaxPending frames are in the workers. When they are all busy,
+// submit() waits for one of them (backpressure on the acquisition,
+// rather than dropping frames of the run); waits are counted and timed.
+
+class EncoderPool : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    EncoderPool(QObject *parent = 0);
+    ~EncoderPool();
+
+    void load(const QSettings&);        // Recording/Format, Recording/Encoders, Recording/Queue
+    bool setFormat(const QString&);     // Falls back to PGM
+
+    // Returns false if the frame could not be queued (or written, without workers)
+    bool submit(const QString &path, const QImage&, qint64 timestamp, const Temperature_Sample&);
+
+    // Waits for the workers and renames the last files
+    void finish();
+
+    static bool encode(const QString &path, const QImage&, const QString &format, const QString &signature,
+                       qint64 timestamp, const Temperature_Sample&, QByteArray &Buffer);
+
+    QString Format;             // pgm, png or tiff; also the file extension
+    int Threads;                // 0 for the caller's thread
+    int MaxPending;
+    QString Signature;          // "<setup> <version>"
+
+    qint64 nCommitted;
+
+signals:
+
+    void committed(QString);
+
+private slots:
+
+    void done(qint64 seq, bool ok);
+
+private:
+
+    QThreadPool Pool;
+    QSemaphore Free;
+    int Capacity;               // Slots of Free
+
+    QMap<qint64, QString> Paths;        // Submitted, not renamed yet
+    QMap<qint64, bool> Done;
+    qint64 nSubmitted, nNext;
+    QByteArray Buffer;
+
+    Metric_Gauge *mPending;
+    Metric_Counter *mFiles, *mWaits;
+    Metric_Histogram *mWait;
+
+    void commit(const QString &path, bool ok);
+
+};
+
+#endif // ENCODERPOOL_H
@@ -0,0 +1,445 @@
+#include "FrameKernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// SSSE3 (byte shuffles) is not in the x86-64 baseline: compiled for the
+// kernels that need it and chosen at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMEKERNELS_SSSE3
+#include <tmmintrin.h>
+#endif
+
+/* === Statistics ==================================================== */
+
+double frameMean(const uchar *p, qint64 n) {
+
+    if (n<=0) { return 0; }
+
+    // 32-bit partial sums, flushed before they can overflow
+    quint64 sum = 0;
+    const qint64 block = 1 << 23;
+    for (qint64 i=0; i<n; i+=block) {
+        const uchar *q = p + i;
+        qint64 m = std::min(block, n-i);
+        quint32 s = 0;
+        for (qint64 j=0; j<m; j++) { s += q[j]; }
+        sum += s;
+    }
+
+    return (double) sum/n;
+
+}
+
+/* === Motion ======================================================== */
+
+quint64 frameSad(const uchar *a, const uchar *b, int stride, int w, int h) {
+
+    quint64 sum = 0;
+
+    for (int y=0; y<h; y++) {
+
+        const uchar *p = a + (qint64) y*stride;
+        const uchar *q = b + (qint64) y*stride;
+        int x = 0;
+
+#ifdef __SSE2__
+        // 16 pixels at a time, into two 64-bit lanes
+        __m128i acc = _mm_setzero_si128();
+        for (; x+16<=w; x+=16) {
+            __m128i u = _mm_loadu_si128((const __m128i*) (p+x));
+            __m128i v = _mm_loadu_si128((const __m128i*) (q+x));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(u, v));
+        }
+        sum += (quint64) _mm_cvtsi128_si32(acc) + (quint64) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+
+        for (; x<w; x++) { sum += std::abs(p[x]-q[x]); }
+
+    }
+
+    return sum;
+
+}
+
+/* === Palette ======================================================= */
+
+void normalizationTable(uchar *lut, double cstAvg, double mean) {
+
+    if (cstAvg<0 || mean<=0) {
+        for (int i=0; i<256; i++) { lut[i] = i; }
+        return;
+    }
+
+    double g = cstAvg/mean;
+    for (int i=0; i<256; i++) { lut[i] = (uchar) std::round(std::max(0.0, std::min(255.0, i*g))); }
+
+}
+
+/* === Geometry ====================================================== */
+
+void mirrorFrame(const uchar *src, int srcStride, uchar *dst, int dstStride, int w, int h) {
+
+    for (int y=0; y<h; y++) {
+        const uchar *s = src + (qint64) (h-1-y)*srcStride;
+        uchar *d = dst + (qint64) y*dstStride;
+        std::reverse_copy(s, s+w, d);
+    }
+
+}
+
+
+/* === 16-bit frames ================================================= */
+
+#ifdef FRAMEKERNELS_SSSE3
+
+// 8 pixels from 12 bytes per iteration; returns the pixels done
+__attribute__((target("ssse3")))
+static qint64 unpack12Ssse3(const uchar *src, quint16 *dst, qint64 n, bool lsb) {
+
+    // Each 16-bit lane gets the two bytes of its pixel: even pixels
+    // (b0, b1) or (b1, b0) depending on the layout, odd pixels (b1, b2)
+    alignas(16) uchar Shuffle[16];
+    alignas(16) quint16 KeepLow[8], KeepShifted[8];
+    for (int k=0; k<4; k++) {
+        Shuffle[4*k] = lsb ? 3*k : 3*k+1;
+        Shuffle[4*k+1] = lsb ? 3*k+1 : 3*k;
+        Shuffle[4*k+2] = 3*k+1;
+        Shuffle[4*k+3] = 3*k+2;
+        KeepLow[2*k] = lsb ? 0x0FFF : 0x000F;
+        KeepShifted[2*k] = lsb ? 0 : 0x0FF0;
+        KeepLow[2*k+1] = 0;
+        KeepShifted[2*k+1] = 0x0FFF;
+    }
+    const __m128i S = _mm_load_si128((const __m128i*) Shuffle);
+    const __m128i L = _mm_load_si128((const __m128i*) KeepLow);
+    const __m128i H = _mm_load_si128((const __m128i*) KeepShifted);
+
+    // 16-byte loads, stopping before the end of the source
+    qint64 i = 0;
+    for (; i+8<=n && (i/2)*3+16<=(n/2)*3; i+=8) {
+        __m128i w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src + (i/2)*3)), S);
+        __m128i p = _mm_or_si128(_mm_and_si128(w, L), _mm_and_si128(_mm_srli_epi16(w, 4), H));
+        _mm_storeu_si128((__m128i*) (dst+i), p);
+    }
+    return i;
+
+}
+
+static bool hasSsse3() {
+
+    static const bool b = __builtin_cpu_supports("ssse3");
+    return b;
+
+}
+
+#endif
+
+void unpack12(const uchar *src, quint16 *dst, qint64 n, bool lsb) {
+
+    qint64 i = 0;
+
+#ifdef FRAMEKERNELS_SSSE3
+    if (hasSsse3()) { i = unpack12Ssse3(src, dst, n, lsb); }
+#endif
+
+    for (; i+2<=n; i+=2) {
+        const uchar *b = src + (i/2)*3;
+        if (lsb) {
+            dst[i] = b[0] | (b[1] & 0x0F) << 8;
+            dst[i+1] = b[1] >> 4 | b[2] << 4;
+        } else {
+            dst[i] = b[0] << 4 | (b[1] & 0x0F);
+            dst[i+1] = b[2] << 4 | b[1] >> 4;
+        }
+    }
+
+}
+
+void unpack10(const uchar *src, quint16 *dst, qint64 n, bool lsb) {
+
+    if (lsb) {
+        for (qint64 i=0; i+4<=n; i+=4) {
+            const uchar *b = src + (i/4)*5;
+            dst[i] = b[0] | (b[1] & 0x03) << 8;
+            dst[i+1] = b[1] >> 2 | (b[2] & 0x0F) << 6;
+            dst[i+2] = b[2] >> 4 | (b[3] & 0x3F) << 4;
+            dst[i+3] = b[3] >> 6 | b[4] << 2;
+        }
+    } else {
+        for (qint64 i=0; i+2<=n; i+=2) {
+            const uchar *b = src + (i/2)*3;
+            dst[i] = b[0] << 2 | (b[1] & 0x03);
+            dst[i+1] = b[2] << 2 | (b[1] >> 4 & 0x03);
+        }
+    }
+
+}
+
+double frameMean16(const quint16 *p, qint64 n) {
+
+    if (n<=0) { return 0; }
+
+    quint64 sum = 0;
+    qint64 i = 0;
+
+#ifdef __SSE2__
+    // 32-bit lanes, two pixels each per step, flushed every 2^17 pixels
+    const __m128i zero = _mm_setzero_si128();
+    while (i+8<=n) {
+        qint64 end = std::min(n - n%8, i + ((qint64) 1 << 17));
+        __m128i acc = _mm_setzero_si128();
+        for (; i<end; i+=8) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (p+i));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+        }
+        alignas(16) quint32 lanes[4];
+        _mm_store_si128((__m128i*) lanes, acc);
+        sum += (quint64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i<n; i++) { sum += p[i]; }
+
+    return (double) sum/n;
+
+}
+
+quint64 frameSad16(const quint16 *a, const quint16 *b, int stride, int w, int h) {
+
+    quint64 sum = 0;
+
+    for (int y=0; y<h; y++) {
+
+        const quint16 *p = a + (qint64) y*stride;
+        const quint16 *q = b + (qint64) y*stride;
+        int x = 0;
+
+#ifdef __SSE2__
+        // |u-v| as the sum of both saturated differences, in 32-bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; x+8<=w; x+=8) {
+            __m128i u = _mm_loadu_si128((const __m128i*) (p+x));
+            __m128i v = _mm_loadu_si128((const __m128i*) (q+x));
+            __m128i d = _mm_or_si128(_mm_subs_epu16(u, v), _mm_subs_epu16(v, u));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(d, zero), _mm_unpackhi_epi16(d, zero)));
+        }
+        alignas(16) quint32 lanes[4];
+        _mm_store_si128((__m128i*) lanes, acc);
+        sum += (quint64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+        for (; x<w; x++) { sum += std::abs(p[x]-q[x]); }
+
+    }
+
+    return sum;
+
+}
+
+void mirrorFrame16(const quint16 *src, int srcStride, quint16 *dst, int dstStride, int w, int h) {
+
+    for (int y=0; y<h; y++) {
+        const quint16 *s = src + (qint64) (h-1-y)*srcStride;
+        quint16 *d = dst + (qint64) y*dstStride;
+        std::reverse_copy(s, s+w, d);
+    }
+
+}
+
+void windowTable(uchar *lut, int bits, int low, int high) {
+
+    if (high<=low) { high = low+1; }
+
+    double g = 255.0/(high-low);
+    for (int v=0; v < (1 << bits); v++) {
+        lut[v] = v<=low ? 0 : v>=high ? 255 : (uchar) std::round((v-low)*g);
+    }
+
+}
+
+void mapFrame16(const quint16 *src, int srcStride, uchar *dst, int dstStride, int w, int h,
+                const uchar *lut, int bits) {
+
+    // Stray high bits stay within the table
+    const quint16 mask = (quint16) ((1 << bits) - 1);
+
+    for (int y=0; y<h; y++) {
+        const quint16 *s = src + (qint64) y*srcStride;
+        uchar *d = dst + (qint64) y*dstStride;
+        for (int x=0; x<w; x++) { d[x] = lut[s[x] & mask]; }
+    }
+
+}
+
+void toBigEndian16(const quint16 *src, uchar *dst, qint64 n) {
+
+    qint64 i = 0;
+
+#ifdef __SSE2__
+    for (; i+8<=n; i+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src+i));
+        _mm_storeu_si128((__m128i*) (dst+2*i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+
+    for (; i<n; i++) {
+        dst[2*i] = src[i] >> 8;
+        dst[2*i+1] = src[i] & 0xFF;
+    }
+
+}
+
+/* === Binning ======================================================= */
+
+// Block of one output pixel, in full
+static inline quint32 blockSum8(const uchar *p, int stride, int f) {
+
+    quint32 s = 0;
+    for (int j=0; j<f; j++) { for (int i=0; i<f; i++) { s += p[(qint64) j*stride + i]; } }
+    return s;
+
+}
+
+static inline quint32 blockSum16(const quint16 *p, int stride, int f) {
+
+    quint32 s = 0;
+    for (int j=0; j<f; j++) { for (int i=0; i<f; i++) { s += p[(qint64) j*stride + i]; } }
+    return s;
+
+}
+
+void binFrame(const uchar *src, int srcStride, uchar *dst, int dstStride, int w, int h,
+              int factor, bool sum) {
+
+    const int f = factor==4 ? 4 : 2;
+    const int shift = f==4 ? 4 : 2;
+    const int W = w/f, H = h/f;
+
+    for (int Y=0; Y<H; Y++) {
+
+        const uchar *s = src + (qint64) Y*f*srcStride;
+        uchar *d = dst + (qint64) Y*dstStride;
+        int X = 0;
+
+#ifdef __SSE2__
+        // Sums of pairs of pixels in 16-bit lanes, over the rows of the block
+        const __m128i low = _mm_set1_epi16(0x00FF);
+
+        if (f==2) {
+            const __m128i round16 = _mm_set1_epi16(2);
+            for (; X+8<=W; X+=8) {
+                __m128i u = _mm_loadu_si128((const __m128i*) (s + 2*X));
+                __m128i v = _mm_loadu_si128((const __m128i*) (s + srcStride + 2*X));
+                __m128i p = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(u, low), _mm_srli_epi16(u, 8)),
+                                          _mm_add_epi16(_mm_and_si128(v, low), _mm_srli_epi16(v, 8)));
+                if (!sum) { p = _mm_srli_epi16(_mm_add_epi16(p, round16), 2); }
+                _mm_storel_epi64((__m128i*) (d+X), _mm_packus_epi16(p, p));
+            }
+        } else {
+            const __m128i ones = _mm_set1_epi16(1);
+            const __m128i round = _mm_set1_epi32(8);
+            for (; X+8<=W; X+=8) {
+                __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128();
+                for (int j=0; j<4; j++) {
+                    const uchar *r = s + (qint64) j*srcStride + 4*X;
+                    __m128i u = _mm_loadu_si128((const __m128i*) r);
+                    __m128i v = _mm_loadu_si128((const __m128i*) (r+16));
+                    a = _mm_add_epi16(a, _mm_add_epi16(_mm_and_si128(u, low), _mm_srli_epi16(u, 8)));
+                    b = _mm_add_epi16(b, _mm_add_epi16(_mm_and_si128(v, low), _mm_srli_epi16(v, 8)));
+                }
+                // Adjacent pairs to 32-bit lanes: one block each
+                a = _mm_madd_epi16(a, ones);
+                b = _mm_madd_epi16(b, ones);
+                if (!sum) {
+                    a = _mm_srli_epi32(_mm_add_epi32(a, round), 4);
+                    b = _mm_srli_epi32(_mm_add_epi32(b, round), 4);
+                }
+                __m128i p = _mm_packs_epi32(a, b);
+                _mm_storel_epi64((__m128i*) (d+X), _mm_packus_epi16(p, p));
+            }
+        }
+#endif
+
+        for (; X<W; X++) {
+            quint32 b = blockSum8(s + X*f, srcStride, f);
+            d[X] = sum ? (uchar) std::min(b, 255u) : (uchar) ((b + (1u << (shift-1))) >> shift);
+        }
+
+    }
+
+}
+
+void binFrame16(const quint16 *src, int srcStride, quint16 *dst, int dstStride, int w, int h,
+                int factor, bool sum) {
+
+    const int f = factor==4 ? 4 : 2;
+    const int shift = f==4 ? 4 : 2;
+    const int W = w/f, H = h/f;
+
+    for (int Y=0; Y<H; Y++) {
+
+        const quint16 *s = src + (qint64) Y*f*srcStride;
+        quint16 *d = dst + (qint64) Y*dstStride;
+        int X = 0;
+
+#ifdef __SSE2__
+        // Sums of pairs of pixels in 32-bit lanes, over the rows of the
+        // block; unsigned saturation through the signed pack, offset by 2^15
+        const __m128i low = _mm_set1_epi32(0xFFFF);
+        const __m128i round = _mm_set1_epi32(1 << (shift-1));
+        const __m128i bias = _mm_set1_epi32(0x8000);
+        const __m128i flip = _mm_set1_epi16((short) 0x8000);
+
+        for (; X+8<=W; X+=8) {
+            __m128i a, b;
+            if (f==2) {
+                a = b = _mm_setzero_si128();
+                for (int j=0; j<2; j++) {
+                    const quint16 *r = s + (qint64) j*srcStride + 2*X;
+                    __m128i u = _mm_loadu_si128((const __m128i*) r);
+                    __m128i v = _mm_loadu_si128((const __m128i*) (r+8));
+                    a = _mm_add_epi32(a, _mm_add_epi32(_mm_and_si128(u, low), _mm_srli_epi32(u, 16)));
+                    b = _mm_add_epi32(b, _mm_add_epi32(_mm_and_si128(v, low), _mm_srli_epi32(v, 16)));
+                }
+            } else {
+                // Two pair sums per block: even and odd lanes of two vectors
+                __m128i q[4];
+                for (int k=0; k<4; k++) { q[k] = _mm_setzero_si128(); }
+                for (int j=0; j<4; j++) {
+                    const quint16 *r = s + (qint64) j*srcStride + 4*X;
+                    for (int k=0; k<4; k++) {
+                        __m128i u = _mm_loadu_si128((const __m128i*) (r + 8*k));
+                        q[k] = _mm_add_epi32(q[k], _mm_add_epi32(_mm_and_si128(u, low), _mm_srli_epi32(u, 16)));
+                    }
+                }
+                a = _mm_add_epi32(
+                    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(q[0]), _mm_castsi128_ps(q[1]), _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(q[0]), _mm_castsi128_ps(q[1]), _MM_SHUFFLE(3, 1, 3, 1))));
+                b = _mm_add_epi32(
+                    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(q[2]), _mm_castsi128_ps(q[3]), _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(q[2]), _mm_castsi128_ps(q[3]), _MM_SHUFFLE(3, 1, 3, 1))));
+            }
+            if (!sum) {
+                a = _mm_srli_epi32(_mm_add_epi32(a, round), shift);
+                b = _mm_srli_epi32(_mm_add_epi32(b, round), shift);
+            }
+            __m128i p = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+            _mm_storeu_si128((__m128i*) (d+X), _mm_xor_si128(p, flip));
+        }
+#endif
+
+        for (; X<W; X++) {
+            quint32 b = blockSum16(s + X*f, srcStride, f);
+            d[X] = sum ? (quint16) std::min(b, 65535u) : (quint16) ((b + (1u << (shift-1))) >> shift);
+        }
+
+    }
+
+}
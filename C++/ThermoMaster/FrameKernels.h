@@ -0,0 +1,73 @@
+#ifndef FRAMEKERNELS_H
+#define FRAMEKERNELS_H
+
+#include <QtGlobal>
+
+/* =================================================================== *\
+|    Frame kernels                                                      |
+\* =================================================================== */
+
+// Per-frame operations of the acquisition thread, on raw 8-bit buffers
+// and on 16-bit buffers for the high bit-depth formats (Mono10, Mono12,
+// Mono16, little-endian, significant bits at the bottom), shared by the
+// camera and the benchmarks.
+
+// Mean gray level of n pixels
+double frameMean(const uchar *p, qint64 n);
+
+// Gray levels of the display palette: identity if cstAvg<0, otherwise
+// scaled so that the frame mean maps to cstAvg.
+void normalizationTable(uchar *lut, double cstAvg, double mean);
+
+// Sum of absolute differences between two w x h regions with the same
+// stride (SSE2 when available)
+quint64 frameSad(const uchar *a, const uchar *b, int stride, int w, int h);
+
+// Rotates a w x h frame by 180° (mirrored horizontally and vertically),
+// rows being strided in both buffers
+void mirrorFrame(const uchar *src, int srcStride, uchar *dst, int dstStride, int w, int h);
+
+/* === 16-bit frames ================================================= */
+
+// Packed 12-bit pixels to 16 bits, n pixels (even). lsb: PFNC Mono12p,
+// low bits first; otherwise GigE Vision Mono12Packed, where each pixel
+// keeps its 8 high bits in a byte of its own (SSSE3 when available).
+void unpack12(const uchar *src, quint16 *dst, qint64 n, bool lsb);
+
+// Packed 10-bit pixels to 16 bits. lsb: PFNC Mono10p, 4 pixels in 5
+// bytes (n multiple of 4); otherwise Mono10Packed, 2 pixels in 3 bytes.
+void unpack10(const uchar *src, quint16 *dst, qint64 n, bool lsb);
+
+double frameMean16(const quint16 *p, qint64 n);
+
+// As frameSad, strides in pixels
+quint64 frameSad16(const quint16 *a, const quint16 *b, int stride, int w, int h);
+
+// As mirrorFrame, strides in pixels
+void mirrorFrame16(const quint16 *src, int srcStride, quint16 *dst, int dstStride, int w, int h);
+
+// Display window: levels low..high of a bits-deep frame mapped linearly
+// on 0..255, clamped outside (table of 1 << bits entries)
+void windowTable(uchar *lut, int bits, int low, int high);
+
+// 16 to 8 bits through a window table, strides in pixels and bytes
+void mapFrame16(const quint16 *src, int srcStride, uchar *dst, int dstStride, int w, int h,
+                const uchar *lut, int bits);
+
+// n 16-bit pixels in big-endian order (16-bit PGM samples)
+void toBigEndian16(const quint16 *src, uchar *dst, qint64 n);
+
+/* === Binning ======================================================= */
+
+// factor x factor blocks (2 or 4) of a w x h frame to single pixels, the
+// output being w/factor x h/factor (partial blocks dropped). sum: sum of
+// the block, saturated at the top of the type; otherwise its mean,
+// rounded (SSE2 when available).
+void binFrame(const uchar *src, int srcStride, uchar *dst, int dstStride, int w, int h,
+              int factor, bool sum);
+
+// As binFrame, strides in pixels
+void binFrame16(const quint16 *src, int srcStride, quint16 *dst, int dstStride, int w, int h,
+                int factor, bool sum);
+
+#endif // FRAMEKERNELS_H
@@ -0,0 +1,76 @@
+#include "FrameStage.h"
+#include "FrameKernels.h"
+#include "Trace.h"
+
+#include <QStringList>
+#include <QDebug>
+
+/* === Constructor =================================================== */
+
+FrameStage::FrameStage() : Bin(1), Sum(false), Every(1), nSeen(0) {}
+
+/* === Settings ====================================================== */
+
+void FrameStage::load(const QSettings &Settings, const QString &group) {
+
+    Bin = Settings.value(group + "/Bin", 1).toInt();
+    if (Bin!=1 && Bin!=2 && Bin!=4) {
+        qWarning() << "Binning" << Bin << "not supported for" << qPrintable(group) << "- frames kept at full resolution";
+        Bin = 1;
+    }
+    Sum = Settings.value(group + "/BinMode", "average").toString().toLower()=="sum";
+    Every = qMax(1, Settings.value(group + "/Every", 1).toInt());
+    nSeen = 0;
+
+}
+
+QString FrameStage::describe() const {
+
+    QStringList L;
+    if (Bin>1) { L << QString("%1x%1 %2").arg(Bin).arg(Sum ? "sum" : "average"); }
+    if (Every>1) { L << QString("1/%1").arg(Every); }
+    return L.isEmpty() ? QString("full") : L.join(", ");
+
+}
+
+/* === Frames ======================================================== */
+
+bool FrameStage::take() { return nSeen++ % Every==0; }
+
+QImage FrameStage::apply(const QImage &Img) const {
+
+    if (Bin<=1 || Img.isNull()) { return Img; }
+
+    int w = Img.width()/Bin, h = Img.height()/Bin;
+    if (w<1 || h<1) { return Img; }
+
+    TRACE_SPAN("bin frame");
+
+    switch (Img.format()) {
+
+    case QImage::Format_Indexed8:
+    case QImage::Format_Grayscale8: {
+        QImage Out(w, h, Img.format());
+        binFrame(Img.constBits(), Img.bytesPerLine(), Out.bits(), Out.bytesPerLine(),
+                 Img.width(), Img.height(), Bin, Sum);
+        if (Img.format()==QImage::Format_Indexed8) { Out.setColorTable(Img.colorTable()); }
+        return Out;
+    }
+
+    case QImage::Format_Grayscale16: {
+        QImage Out(w, h, QImage::Format_Grayscale16);
+        binFrame16((const quint16*) Img.constBits(), Img.bytesPerLine()/2, (quint16*) Out.bits(), Out.bytesPerLine()/2,
+                   Img.width(), Img.height(), Bin, Sum);
+        int bits = Img.text("Bits").toInt();
+        if (bits<=0) { bits = 16; }
+        if (Sum) { bits = qMin(16, bits + (Bin==4 ? 4 : 2)); }
+        Out.setText("Bits", QString::number(bits));
+        return Out;
+    }
+
+    default:
+        return Img;
+
+    }
+
+}
@@ -0,0 +1,51 @@
+#ifndef FRAMESTAGE_H
+#define FRAMESTAGE_H
+
+#include <QString>
+#include <QImage>
+#include <QSettings>
+
+/* =================================================================== *\
+|    FrameStage Class                                                   |
+\* =================================================================== */
+
+// Host-side reduction of the frames for one consumer (display, recording
+// or analysis), so that each gets the resolution and rate it needs while
+// the camera keeps its configuration. Keys of the <group>:
+//
+//   Bin        1, 2 or 4: pixels binned in Bin x Bin blocks
+//   BinMode    average (default) or sum, saturated at the top of the
+//              depth; the depth of 16-bit frames grows by 2 (2x2) or 4
+//              bits (4x4), up to 16
+//   Every      one frame out of Every is kept
+//
+// Frames of other formats than 8-bit gray or indexed and Grayscale16 are
+// passed as they are.
+
+class FrameStage {
+
+public:
+
+    FrameStage();
+
+    void load(const QSettings&, const QString &group);
+    bool isIdentity() const { return Bin<=1 && Every<=1; }
+    QString describe() const;           // "2x2 average, 1/3"
+
+    // Decimation: true for the frames to keep
+    bool take();
+    void reset() { nSeen = 0; }
+
+    QImage apply(const QImage&) const;
+
+    int Bin;
+    bool Sum;
+    int Every;
+
+private:
+
+    qint64 nSeen;
+
+};
+
+#endif // FRAMESTAGE_H
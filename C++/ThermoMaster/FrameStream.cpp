@@ -0,0 +1,175 @@
+#include "FrameStream.h"
+
+#include <QDebug>
+#include <QtNumeric>
+#include <cstring>
+#include <cerrno>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* === Constructor =================================================== */
+
+FrameStream::FrameStream() : Slots(0), Header(0), Size(0), Next(0), TL(qQNaN()), TR(qQNaN()) {
+
+    mFrames = Metrics::counter("thermo_stream_frames_total", "Frames published to the shared-memory ring");
+
+}
+
+FrameStream::~FrameStream() { close(); }
+
+/* === Object ======================================================== */
+
+bool FrameStream::open(const QString &name, int slots) {
+
+    close();
+
+#ifdef Q_OS_UNIX
+    Name = name.startsWith('/') ? name : "/" + name;
+    Slots = qMax(2, slots);
+    qInfo() << "Frames streamed to" << qPrintable(Name);
+    return true;
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(slots);
+    qWarning() << "Shared-memory frame stream not available on this platform";
+    return false;
+#endif
+
+}
+
+void FrameStream::close() {
+
+    if (Name.isEmpty()) { return; }
+
+    unmap();
+#ifdef Q_OS_UNIX
+    shm_unlink(Name.toLocal8Bit().constData());
+#endif
+    Name.clear();
+
+}
+
+bool FrameStream::map(quint64 capacity) {
+
+    unmap();
+
+#ifdef Q_OS_UNIX
+
+    // A fresh object, so that attached readers keep a consistent (closed) view
+    QByteArray N = Name.toLocal8Bit();
+    shm_unlink(N.constData());
+
+    int fd = shm_open(N.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd<0) {
+        qWarning() << "Unable to create the shared memory" << qPrintable(Name) << "-" << strerror(errno);
+        return false;
+    }
+
+    // Page-aligned header, 64-byte aligned slots and pixels
+    quint64 headerSize = 4096;
+    quint64 slotSize = (sizeof(ThermoStream_Slot) + capacity + 63) & ~(quint64) 63;
+    Size = headerSize + Slots*slotSize;
+
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, Size)==0) { p = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); }
+    ::close(fd);
+
+    if (p==MAP_FAILED) {
+        qWarning() << "Unable to map the shared memory" << qPrintable(Name) << "-" << strerror(errno);
+        shm_unlink(N.constData());
+        return false;
+    }
+
+    // The object is zero-filled: every slot starts with sequence 0
+    Header = (ThermoStream_Header*) p;
+    Header->Magic = THERMOSTREAM_MAGIC;
+    Header->Version = THERMOSTREAM_VERSION;
+    Header->HeaderSize = headerSize;
+    Header->Slots = Slots;
+    Header->SlotSize = slotSize;
+    Header->Capacity = capacity;
+    Header->WriterPid = getpid();
+    strncpy(Header->Setup, Signature.toUtf8().constData(), sizeof(Header->Setup)-1);
+    __atomic_store_n(&Header->State, 1, __ATOMIC_RELEASE);
+
+    Next = 0;
+    return true;
+
+#else
+    Q_UNUSED(capacity);
+    return false;
+#endif
+
+}
+
+void FrameStream::unmap() {
+
+    if (!Header) { return; }
+
+#ifdef Q_OS_UNIX
+    __atomic_store_n(&Header->State, 0, __ATOMIC_RELEASE);
+    munmap(Header, Size);
+#endif
+    Header = 0;
+    Size = 0;
+
+}
+
+/* === Frames ======================================================== */
+
+void FrameStream::setTemperatures(double left, double right) {
+
+    TL.store(left, std::memory_order_relaxed);
+    TR.store(right, std::memory_order_relaxed);
+
+}
+
+void FrameStream::publish(const QImage &Img, qint64 timestamp, qint64 frameId, double mean) {
+
+    if (Name.isEmpty() || Img.depth()!=8) { return; }
+
+    int w = Img.width(), h = Img.height();
+    quint64 bytes = (quint64) w*h;
+
+    // Created with the first frame, again for larger frames
+    if ((!Header || bytes>Header->Capacity) && !map(bytes)) {
+        Name.clear();
+        return;
+    }
+
+    // --- Seqlock write: odd while the slot is inconsistent
+    quint64 n = Next++;
+    ThermoStream_Slot *S = (ThermoStream_Slot*) ((char*) Header + Header->HeaderSize + (n % Header->Slots)*Header->SlotSize);
+
+    __atomic_store_n(&S->Sequence, 2*n+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    S->Frame = n;
+    S->Timestamp = timestamp;
+    S->FrameId = frameId;
+    S->Width = w;
+    S->Height = h;
+    S->Stride = w;
+    S->Format = THERMOSTREAM_GRAY8;
+    S->TempLeft = TL.load(std::memory_order_relaxed);
+    S->TempRight = TR.load(std::memory_order_relaxed);
+    S->Mean = mean;
+
+    // Indices of the image: sensor levels for Mono8, window-mapped display
+    // levels for the deeper formats; the normalization (color table) is
+    // not applied
+    uchar *dst = (uchar*) (S + 1);
+    if (Img.bytesPerLine()==w) { memcpy(dst, Img.constBits(), bytes); }
+    else { for (int y=0; y<h; y++) { memcpy(dst + (quint64) y*w, Img.constScanLine(y), w); } }
+
+    __atomic_store_n(&S->Sequence, 2*(n+1), __ATOMIC_RELEASE);
+    __atomic_store_n(&Header->Published, n+1, __ATOMIC_RELEASE);
+
+    mFrames->add();
+
+}
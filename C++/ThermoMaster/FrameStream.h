@@ -0,0 +1,57 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <QString>
+#include <QImage>
+#include <atomic>
+
+#include "ThermoStream.h"
+#include "Metrics.h"
+
+/* =================================================================== *\
+|    FrameStream Class                                                  |
+\* =================================================================== */
+
+// Writer side of the shared-memory frame ring (layout in ThermoStream.h).
+// publish() is called from the acquisition thread, for every frame: it
+// copies the pixels into the next slot and never waits for the readers.
+// The object is created with the first frame, and again only if a frame
+// outgrows the slot capacity. Temperatures come from another thread and are attached
+// to the next frames.
+//
+// POSIX only; elsewhere open() fails and frames are not published.
+
+class FrameStream {
+
+public:
+
+    FrameStream();
+    ~FrameStream();
+
+    bool open(const QString &name, int slots);
+    void close();
+    bool isOpen() const { return Name.size()>0; }
+
+    void publish(const QImage&, qint64 timestamp, qint64 frameId, double mean);
+    void setTemperatures(double TL, double TR);
+
+    QString Signature;      // "<setup> <version>"
+
+private:
+
+    QString Name;
+    int Slots;
+    ThermoStream_Header *Header;
+    size_t Size;
+    quint64 Next;
+
+    std::atomic<double> TL, TR;
+
+    Metric_Counter *mFrames;
+
+    bool map(quint64 capacity);
+    void unmap();
+
+};
+
+#endif // FRAMESTREAM_H
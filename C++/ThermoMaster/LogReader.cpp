@@ -0,0 +1,159 @@
+#include "LogReader.h"
+
+#include <cstring>
+#include <limits>
+
+/* === Constructor =================================================== */
+
+LogReader::LogReader() {
+
+    Begin = End = P = 0;
+    From = std::numeric_limits<qint64>::min();
+    To = std::numeric_limits<qint64>::max();
+    MinRank = 0;
+
+}
+
+/* === Settings ====================================================== */
+
+bool LogReader::open(const QString &path) {
+
+    File.close();
+    Content.clear();
+    File.setFileName(path);
+    if (!File.open(QIODevice::ReadOnly)) { return false; }
+
+    // Map the file; fall back on a plain read
+    Begin = (const char*) File.map(0, File.size());
+    if (!Begin) {
+        Content = File.readAll();
+        Begin = Content.constData();
+    }
+    End = Begin + File.size();
+    P = seek(From);
+
+    return true;
+
+}
+
+void LogReader::setRange(qint64 from, qint64 to) {
+
+    From = from;
+    To = to;
+    if (Begin) { P = seek(From); }
+
+}
+
+void LogReader::setMinLevel(QtMsgType type) { MinRank = Message::rank(type); }
+
+/* === Record header ================================================= */
+
+int LogReader::rankOf(const char *level, int n) {
+
+    static const char* Levels[] = { "debug", "info", "warning", "critical", "fatal" };
+    for (int k=0; k<5; k++) {
+        if ((int) strlen(Levels[k])==n && !strncmp(level, Levels[k], n)) { return k; }
+    }
+    return -1;
+
+}
+
+// Records start with {"time":<ms>,"level":"<level>"
+bool LogReader::parse(const char *begin, const char *end, Log_Line &L) {
+
+    static const char Time[] = "{\"time\":";
+    static const char Level[] = ",\"level\":\"";
+
+    const char *p = begin;
+    if (end-p<(int) sizeof(Time) || strncmp(p, Time, sizeof(Time)-1)) { return false; }
+    p += sizeof(Time)-1;
+
+    bool neg = p<end && *p=='-';
+    if (neg) { p++; }
+    qint64 t = 0;
+    const char *d = p;
+    for (; p<end && *p>='0' && *p<='9'; p++) { t = 10*t + (*p-'0'); }
+    if (p==d) { return false; }
+
+    if (end-p<(int) sizeof(Level) || strncmp(p, Level, sizeof(Level)-1)) { return false; }
+    p += sizeof(Level)-1;
+    const char *q = (const char*) memchr(p, '"', end-p);
+    if (!q) { return false; }
+
+    L.time = neg ? -t : t;
+    L.rank = rankOf(p, q-p);
+    L.begin = begin;
+    L.end = end;
+    return true;
+
+}
+
+/* === Bisection ===================================================== */
+
+const char* LogReader::lineStart(const char *p) const {
+
+    while (p>Begin && p[-1]!='\n') { p--; }
+    return p;
+
+}
+
+// First line whose time is >= time
+const char* LogReader::seek(qint64 time) const {
+
+    const char *lo = Begin, *hi = End;
+    Log_Line L;
+
+    while (hi-lo>1) {
+
+        // Line start near the middle, strictly after lo
+        const char *mid = lineStart(lo + (hi-lo)/2);
+        if (mid<=lo) {
+            mid = (const char*) memchr(lo, '\n', hi-lo);
+            if (!mid || mid+1>=hi) { break; }
+            mid++;
+        }
+
+        // Time of the first parseable line at or after mid
+        const char *p = mid;
+        bool found = false;
+        while (p<hi) {
+            const char *nl = (const char*) memchr(p, '\n', End-p);
+            if (!nl) { nl = End; }
+            if (parse(p, nl, L)) { found = true; break; }
+            p = nl+1;
+        }
+
+        if (!found || L.time>=time) { hi = mid; }
+        else { lo = mid; }
+
+    }
+
+    // lo is the last line known to be before time, unless at the start
+    if (lo==Begin && hi!=Begin) {
+        const char *nl = (const char*) memchr(lo, '\n', End-lo);
+        if (parse(lo, nl ? nl : End, L) && L.time>=time) { return lo; }
+    }
+    return hi;
+
+}
+
+/* === Iteration ===================================================== */
+
+bool LogReader::next(Log_Line &L) {
+
+    while (P && P<End) {
+
+        const char *nl = (const char*) memchr(P, '\n', End-P);
+        if (!nl) { nl = End; }
+        const char *b = P;
+        P = nl+1;
+
+        if (!parse(b, nl, L)) { continue; }
+        if (L.time>To) { P = End; return false; }
+        if (L.time>=From && L.rank>=MinRank) { return true; }
+
+    }
+
+    return false;
+
+}
@@ -0,0 +1,55 @@
+#ifndef LOGREADER_H
+#define LOGREADER_H
+
+#include <QFile>
+#include <QByteArray>
+
+#include "MsgHandler.h"
+
+/* =================================================================== *\
+|    LogReader Class                                                    |
+\* =================================================================== */
+
+// Reads session logs written by LogSink. The file is memory-mapped and
+// the start of the time range is found by bisection on the byte offset,
+// since records are written in time order; only the lines in the range
+// are then scanned and filtered by severity.
+
+struct Log_Line {
+
+    qint64 time;        // ms since epoch
+    int rank;           // Message::rank of the level
+    const char *begin;  // Raw JSON record, without the newline
+    const char *end;
+
+};
+
+class LogReader {
+
+public:
+
+    LogReader();
+
+    bool open(const QString &path);
+    void setRange(qint64 from, qint64 to);
+    void setMinLevel(QtMsgType);
+
+    bool next(Log_Line&);
+
+    static bool parse(const char *begin, const char *end, Log_Line&);
+    static int rankOf(const char *level, int n);
+
+private:
+
+    QFile File;
+    QByteArray Content;
+    const char *Begin, *End, *P;
+    qint64 From, To;
+    int MinRank;
+
+    const char* lineStart(const char *p) const;
+    const char* seek(qint64 time) const;
+
+};
+
+#endif // LOGREADER_H
@@ -0,0 +1,163 @@
+#include "LogSink.h"
+#include "Trace.h"
+#include "Metrics.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+
+/* === Constructor =================================================== */
+
+LogSink::LogSink(QObject *parent) : QThread(parent) {
+
+    MaxSize = 64 << 20;
+    FlushInterval = 1000;
+    MaxPending = 100000;
+
+    Running = false;
+    Urgent = false;
+    Reopen = false;
+    Dropped = 0;
+
+}
+
+LogSink::~LogSink() { stop(); }
+
+/* === Settings ====================================================== */
+
+void LogSink::setDirectory(const QString &dir) {
+
+    QMutexLocker Lock(&Mutex);
+    if (dir==Dir) { return; }
+    Dir = dir;
+    Reopen = true;
+
+    if (!Running) {
+        Running = true;
+        start(QThread::LowPriority);
+    }
+
+}
+
+/* === Producer side ================================================= */
+
+void LogSink::write(const Message &M) {
+
+    QMutexLocker Lock(&Mutex);
+
+    if (Pending.size()>=MaxPending) {
+        Dropped++;
+        return;
+    }
+    Pending.append(M);
+
+    if (Message::rank(M.type)>=Message::rank(QtWarningMsg)) {
+        Urgent = true;
+        Wake.wakeOne();
+    }
+
+}
+
+void LogSink::stop() {
+
+    {
+        QMutexLocker Lock(&Mutex);
+        if (!Running) { return; }
+        Running = false;
+        Wake.wakeOne();
+    }
+    wait();
+
+}
+
+/* === Writer thread ================================================= */
+
+void LogSink::run() {
+
+    Trace::setThreadName("Session log");
+
+    Metric_Counter *mRecords = Metrics::counter("thermo_log_records_total", "Records written to the session log");
+    Metric_Counter *mDropped = Metrics::counter("thermo_log_dropped_total", "Log records dropped, by stage (queue: log queue full, sink: session writer behind)", "stage=\"sink\"");
+    Metric_Counter *mBytes = Metrics::counter("thermo_log_bytes_total", "Bytes written to the session log");
+
+    QVector<Message> Batch;
+    QString dir;
+    bool running = true;
+
+    while (running) {
+
+        unsigned dropped;
+        bool reopen;
+
+        // --- Take the pending records
+        {
+            QMutexLocker Lock(&Mutex);
+            if (Running && !Urgent) { Wake.wait(&Mutex, FlushInterval); }
+            Batch.swap(Pending);
+            running = Running;
+            Urgent = false;
+            reopen = Reopen;
+            Reopen = false;
+            dir = Dir;
+            dropped = Dropped;
+            Dropped = 0;
+        }
+
+        if (reopen) { File.close(); }
+        if (Batch.isEmpty() && !dropped) { continue; }
+
+        // --- Format the batch in a single buffer
+        TRACE_SPAN("log write");
+        QByteArray Buffer;
+        for (int i=0; i<Batch.size(); i++) {
+            Buffer += Batch[i].json().toUtf8();
+            Buffer += '\n';
+        }
+        if (dropped) {
+            Message M;
+            M.type = QtWarningMsg;
+            M.time = QDateTime::currentMSecsSinceEpoch();
+            M.text = QString("%1 record(s) dropped by the session log").arg(dropped);
+            Buffer += M.json().toUtf8() + '\n';
+        }
+
+        // --- Write
+        qint64 time = Batch.isEmpty() ? QDateTime::currentMSecsSinceEpoch() : Batch.first().time;
+        if (rotate(dir, time)) {
+            File.write(Buffer);
+            File.flush();
+            mBytes->add(Buffer.size());
+        }
+        mRecords->add(Batch.size());
+        mDropped->add(dropped);
+
+        Batch.clear();
+
+    }
+
+    File.close();
+
+}
+
+/* === Rotation ====================================================== */
+
+bool LogSink::rotate(const QString &dir, qint64 time) {
+
+    QDateTime Now = QDateTime::fromMSecsSinceEpoch(time);
+
+    if (File.isOpen() && File.size()<MaxSize && Now.date()==Day) { return true; }
+    File.close();
+
+    if (!QDir().mkpath(dir)) { return false; }
+
+    Day = Now.date();
+
+    // Same second: keep appending, unless the file is full
+    QString base = QDir(dir).filePath("Session_" + Now.toString("yyyy-MM-dd_hhmmss"));
+    QString name = base + ".jsonl";
+    for (int n=1; QFileInfo(name).size()>=MaxSize; n++) { name = QString("%1_%2.jsonl").arg(base).arg(n); }
+    File.setFileName(name);
+
+    return File.open(QIODevice::WriteOnly | QIODevice::Append);
+
+}
@@ -0,0 +1,64 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QFile>
+#include <QDate>
+
+#include "MsgHandler.h"
+
+/* =================================================================== *\
+|    LogSink Class                                                      |
+\* =================================================================== */
+
+// Persistent session log. Records handed over by the message drain are
+// written as JSON lines by a background thread, in batches: the writer
+// wakes up every FlushInterval, or immediately for warnings and above,
+// and flushes the file after each batch.
+//
+// Files are named Session_<date>_<time>.jsonl and rotated when they
+// exceed MaxSize or when the day changes; a file filled up within the
+// second of its name continues in Session_<date>_<time>_<n>.jsonl.
+
+class LogSink : public QThread {
+
+    Q_OBJECT
+
+public:
+
+    LogSink(QObject *parent = 0);
+    ~LogSink();
+
+    void setDirectory(const QString&);
+    void write(const Message&);
+    void stop();
+
+    qint64 MaxSize;         // bytes
+    int FlushInterval;      // ms
+    int MaxPending;         // Records kept while the disk is busy
+
+protected:
+
+    void run();
+
+private:
+
+    QMutex Mutex;
+    QWaitCondition Wake;
+    QVector<Message> Pending;
+    QString Dir;
+    bool Running, Urgent, Reopen;
+    unsigned Dropped;
+
+    // Writer thread only
+    QFile File;
+    QDate Day;
+
+    bool rotate(const QString &dir, qint64 time);
+
+};
+
+#endif // LOGSINK_H
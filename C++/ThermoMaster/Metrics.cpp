@@ -0,0 +1,183 @@
+#include "Metrics.h"
+
+#include <QMutex>
+#include <QPointer>
+#include <QThread>
+#include <QList>
+#include <QPair>
+#include <cmath>
+#include <algorithm>
+
+static QMutex Registry;
+static QVector<Metric*> All;
+static QList< QPair<QPointer<QObject>, std::function<void()> > > Collectors;
+
+/* === Histogram ===================================================== */
+
+Metric_Histogram::Metric_Histogram(const QVector<double> &bounds) : Bounds(bounds), Sum(0) {
+
+    Buckets = new std::atomic<quint64>[Bounds.size()+1];
+    for (int i=0; i<=Bounds.size(); i++) { Buckets[i].store(0, std::memory_order_relaxed); }
+
+}
+
+Metric_Histogram::~Metric_Histogram() { delete[] Buckets; }
+
+void Metric_Histogram::observe(double v) {
+
+    int i = std::lower_bound(Bounds.constBegin(), Bounds.constEnd(), v) - Bounds.constBegin();
+    Buckets[i].fetch_add(1, std::memory_order_relaxed);
+
+    double s = Sum.load(std::memory_order_relaxed);
+    while (!Sum.compare_exchange_weak(s, s+v, std::memory_order_relaxed)) {}
+
+}
+
+/* === Registration ================================================== */
+
+template <typename T>
+static T* find(Metric::Type type, const QString &name, const QString &labels) {
+
+    foreach (Metric *M, All) {
+        if (M->type==type && M->name==name && M->labels==labels) { return static_cast<T*>(M); }
+    }
+    return 0;
+
+}
+
+static void init(Metric *M, Metric::Type type, const QString &name, const QString &help, const QString &labels) {
+
+    M->type = type;
+    M->name = name;
+    M->help = help;
+    M->labels = labels;
+    All.append(M);
+
+}
+
+Metric_Counter* Metrics::counter(const QString &name, const QString &help, const QString &labels) {
+
+    QMutexLocker Lock(&Registry);
+    Metric_Counter *M = find<Metric_Counter>(Metric::Counter, name, labels);
+    if (!M) { init(M = new Metric_Counter, Metric::Counter, name, help, labels); }
+    return M;
+
+}
+
+Metric_Gauge* Metrics::gauge(const QString &name, const QString &help, const QString &labels) {
+
+    QMutexLocker Lock(&Registry);
+    Metric_Gauge *M = find<Metric_Gauge>(Metric::Gauge, name, labels);
+    if (!M) { init(M = new Metric_Gauge, Metric::Gauge, name, help, labels); }
+    return M;
+
+}
+
+Metric_Histogram* Metrics::histogram(const QString &name, const QString &help, const QVector<double> &bounds, const QString &labels) {
+
+    QMutexLocker Lock(&Registry);
+    Metric_Histogram *M = find<Metric_Histogram>(Metric::Histogram, name, labels);
+    if (!M) { init(M = new Metric_Histogram(bounds), Metric::Histogram, name, help, labels); }
+    return M;
+
+}
+
+void Metrics::collect(QObject *owner, std::function<void()> fn) {
+
+    QMutexLocker Lock(&Registry);
+    Collectors.append(qMakePair(QPointer<QObject>(owner), fn));
+
+}
+
+QVector<double> Metrics::exponential(double start, double factor, int count) {
+
+    QVector<double> B;
+    for (int i=0; i<count; i++) { B.append(start*std::pow(factor, i)); }
+    return B;
+
+}
+
+/* === Exposition ==================================================== */
+
+static QByteArray number(double v) {
+
+    if (std::isnan(v)) { return "NaN"; }
+    if (std::isinf(v)) { return v>0 ? "+Inf" : "-Inf"; }
+    return QByteArray::number(v, 'g', 12);
+
+}
+
+static QByteArray series(const QString &name, const QString &labels, const QString &extra = QString()) {
+
+    QString L = labels;
+    if (!extra.isEmpty()) { L += (L.isEmpty() ? "" : ",") + extra; }
+    return (L.isEmpty() ? name : name + "{" + L + "}").toUtf8();
+
+}
+
+QByteArray Metrics::text() {
+
+    // --- Collectors, outside of the registry lock
+    QList< QPair<QPointer<QObject>, std::function<void()> > > C;
+    {
+        QMutexLocker Lock(&Registry);
+        for (int i=Collectors.size()-1; i>=0; i--) {
+            if (Collectors[i].first.isNull()) { Collectors.removeAt(i); }
+        }
+        C = Collectors;
+    }
+    for (int i=0; i<C.size(); i++) {
+        if (C[i].first && C[i].first->thread()==QThread::currentThread()) { C[i].second(); }
+    }
+
+    // The list only grows, and metrics are never freed
+    QVector<Metric*> List;
+    {
+        QMutexLocker Lock(&Registry);
+        List = All;
+    }
+
+    // Families together, in registration order
+    std::stable_sort(List.begin(), List.end(), [](const Metric *a, const Metric *b) { return a->name<b->name; });
+
+    static const char* Types[] = { "counter", "gauge", "histogram" };
+    QByteArray B;
+    QString family;
+
+    foreach (const Metric *M, List) {
+
+        if (M->name!=family) {
+            family = M->name;
+            B += "# HELP " + M->name.toUtf8() + " " + M->help.toUtf8() + "\n";
+            B += "# TYPE " + M->name.toUtf8() + " " + Types[M->type] + "\n";
+        }
+
+        switch (M->type) {
+
+        case Metric::Counter:
+            B += series(M->name, M->labels) + " " + QByteArray::number(static_cast<const Metric_Counter*>(M)->Value.load(std::memory_order_relaxed)) + "\n";
+            break;
+
+        case Metric::Gauge:
+            B += series(M->name, M->labels) + " " + number(static_cast<const Metric_Gauge*>(M)->Value.load(std::memory_order_relaxed)) + "\n";
+            break;
+
+        case Metric::Histogram: {
+            const Metric_Histogram *H = static_cast<const Metric_Histogram*>(M);
+            quint64 c = 0;
+            for (int i=0; i<=H->Bounds.size(); i++) {
+                c += H->Buckets[i].load(std::memory_order_relaxed);
+                QString le = i<H->Bounds.size() ? QString("le=\"%1\"").arg(QString(number(H->Bounds[i]))) : QString("le=\"+Inf\"");
+                B += series(M->name + "_bucket", M->labels, le) + " " + QByteArray::number(c) + "\n";
+            }
+            B += series(M->name + "_sum", M->labels) + " " + number(H->Sum.load(std::memory_order_relaxed)) + "\n";
+            // Consistent with the +Inf bucket, even if observations land during the scrape
+            B += series(M->name + "_count", M->labels) + " " + QByteArray::number(c) + "\n";
+            break;
+        }
+        }
+    }
+
+    return B;
+
+}
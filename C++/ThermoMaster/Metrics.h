@@ -0,0 +1,91 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+class QObject;
+
+/* =================================================================== *\
+|    Metrics                                                            |
+\* =================================================================== */
+
+// Registry of counters, gauges and histograms, rendered in the Prometheus
+// text format. Subsystems register their metrics once (under the registry
+// lock) and keep the pointers; updates are then relaxed atomic operations,
+// and a scrape only reads them, so the acquisition path never waits on a
+// scrape.
+//
+//   static Metric_Counter *Frames = Metrics::counter("thermo_camera_frames_total", "Frames received");
+//   Frames->add();
+//
+// Registering the same name and labels twice returns the same metric.
+// Metrics live for the whole process.
+//
+// Values that are cheaper to read than to track (elapsed times, states)
+// are refreshed by collectors, called before each scrape. A collector
+// only runs on the thread of its owner, and is dropped with it.
+
+struct Metric {
+
+    enum Type { Counter, Gauge, Histogram };
+
+    Type type;
+    QString name;
+    QString labels;         // Prometheus syntax, without braces: zone="left"
+    QString help;
+
+};
+
+struct Metric_Counter : Metric {
+
+    std::atomic<quint64> Value;
+
+    Metric_Counter() : Value(0) {}
+    void add(quint64 n = 1) { Value.fetch_add(n, std::memory_order_relaxed); }
+
+};
+
+struct Metric_Gauge : Metric {
+
+    std::atomic<double> Value;
+
+    Metric_Gauge() : Value(0) {}
+    void set(double v) { Value.store(v, std::memory_order_relaxed); }
+
+};
+
+struct Metric_Histogram : Metric {
+
+    QVector<double> Bounds;                 // Upper bounds, increasing
+    std::atomic<quint64> *Buckets;          // Bounds.size()+1, the last one for +Inf
+    std::atomic<double> Sum;
+
+    Metric_Histogram(const QVector<double> &bounds);
+    ~Metric_Histogram();
+    void observe(double);
+
+};
+
+class Metrics {
+
+public:
+
+    static Metric_Counter* counter(const QString &name, const QString &help, const QString &labels = QString());
+    static Metric_Gauge* gauge(const QString &name, const QString &help, const QString &labels = QString());
+    static Metric_Histogram* histogram(const QString &name, const QString &help, const QVector<double> &bounds,
+                                       const QString &labels = QString());
+
+    static void collect(QObject *owner, std::function<void()>);
+
+    // Bounds growing by factor from start
+    static QVector<double> exponential(double start, double factor, int count);
+
+    static QByteArray text();
+
+};
+
+#endif // METRICS_H
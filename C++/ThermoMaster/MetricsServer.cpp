@@ -0,0 +1,79 @@
+#include "MetricsServer.h"
+#include "Metrics.h"
+
+#include <QHostAddress>
+#include <QTimer>
+#include <QDebug>
+
+/* === Constructor =================================================== */
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent) {
+
+    Server = new QTcpServer(this);
+    connect(Server, SIGNAL(newConnection()), this, SLOT(connection()));
+
+}
+
+bool MetricsServer::listen(quint16 port) {
+
+    if (!Server->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Metrics: unable to listen on port" << port << "-" << qPrintable(Server->errorString());
+        return false;
+    }
+
+    qInfo().nospace() << "Metrics on http://localhost:" << Server->serverPort() << "/metrics";
+    return true;
+
+}
+
+/* === Requests ====================================================== */
+
+void MetricsServer::connection() {
+
+    while (Server->hasPendingConnections()) {
+
+        QTcpSocket *Socket = Server->nextPendingConnection();
+        connect(Socket, SIGNAL(readyRead()), this, SLOT(request()));
+        connect(Socket, SIGNAL(disconnected()), Socket, SLOT(deleteLater()));
+
+        // Idle clients are dropped
+        QTimer::singleShot(5000, Socket, SLOT(deleteLater()));
+
+    }
+
+}
+
+void MetricsServer::request() {
+
+    QTcpSocket *Socket = qobject_cast<QTcpSocket*>(sender());
+    if (!Socket || !Socket->canReadLine()) { return; }
+
+    // Only the request line matters; one request per connection
+    QList<QByteArray> Line = Socket->readLine().trimmed().split(' ');
+    Socket->readAll();
+    disconnect(Socket, SIGNAL(readyRead()), this, SLOT(request()));
+
+    QByteArray Status, Type, Body;
+
+    if (Line.size()<2 || (Line[0]!="GET" && Line[0]!="HEAD")) {
+        Status = "405 Method Not Allowed";
+        Type = "text/plain";
+    } else if (Line[1]=="/metrics" || Line[1].startsWith("/metrics?")) {
+        Status = "200 OK";
+        Type = "text/plain; version=0.0.4; charset=utf-8";
+        Body = Metrics::text();
+    } else {
+        Status = "404 Not Found";
+        Type = "text/plain";
+        Body = "Metrics are served on /metrics\n";
+    }
+
+    QByteArray Response = "HTTP/1.0 " + Status + "\r\nContent-Type: " + Type
+            + "\r\nContent-Length: " + QByteArray::number(Body.size())
+            + "\r\nConnection: close\r\n\r\n";
+    if (Line.value(0)!="HEAD") { Response += Body; }
+
+    Socket->write(Response);
+    Socket->disconnectFromHost();
+
+}
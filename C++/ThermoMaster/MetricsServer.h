@@ -0,0 +1,38 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+/* =================================================================== *\
+|    MetricsServer Class                                                |
+\* =================================================================== */
+
+// Minimal HTTP listener on the loopback interface, serving the metrics
+// registry in the Prometheus text format on GET /metrics. Scrapes are
+// answered from the thread owning the server; they only read atomics.
+
+class MetricsServer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    MetricsServer(QObject *parent = 0);
+
+    bool listen(quint16 port);
+    quint16 port() const { return Server->serverPort(); }
+
+private slots:
+
+    void connection();
+    void request();
+
+private:
+
+    QTcpServer *Server;
+
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,129 @@
+#include "MinMaxPyramid.h"
+
+#include <algorithm>
+
+/* === Constructor =================================================== */
+
+MinMaxPyramid::MinMaxPyramid() {}
+
+/* === Append ======================================================== */
+
+void MinMaxPyramid::append(double k, double v) {
+
+    Keys.append(k);
+    Values.append(v);
+
+    // Update the bucket containing the new sample at each level. Level l+1
+    // is only needed once level l holds two buckets; it then starts from
+    // the (complete) first bucket of level l.
+    int i = Keys.size()-1;
+    for (int l=1; ; l++) {
+
+        if (Levels.size()<l) {
+            Levels.append(QVector<Lod_Bucket>());
+            if (l>1) { Levels[l-1].append(Levels[l-2][0]); }
+        }
+        QVector<Lod_Bucket> &Lv = Levels[l-1];
+
+        int b = i>>l;
+        if (b==Lv.size()) {
+            Lod_Bucket B = { k, k, v, v, v, 1 };
+            Lv.append(B);
+        } else {
+            Lod_Bucket &B = Lv[b];
+            if (v<B.vmin) { B.vmin = v; B.kmin = k; }
+            if (v>B.vmax) { B.vmax = v; B.kmax = k; }
+            B.sum += v;
+            B.n++;
+        }
+
+        if (!b) { break; }
+    }
+
+}
+
+/* === Clear ========================================================= */
+
+void MinMaxPyramid::clear() {
+
+    Keys.clear();
+    Values.clear();
+    Levels.clear();
+
+}
+
+void MinMaxPyramid::dropFront(int n) {
+
+    if (n<=0) { return; }
+    if (n>=Keys.size()) {
+        clear();
+        return;
+    }
+
+    QVector<double> K = Keys.mid(n), V = Values.mid(n);
+    clear();
+    for (int i=0; i<K.size(); i++) { append(K[i], V[i]); }
+
+}
+
+/* === Level of detail =============================================== */
+
+int MinMaxPyramid::lowerIndex(double k) const {
+
+    return std::lower_bound(Keys.constBegin(), Keys.constEnd(), k) - Keys.constBegin();
+
+}
+
+int MinMaxPyramid::level(double k0, double k1, int pixels) const {
+
+    int n = lowerIndex(k1) - lowerIndex(k0);
+
+    // Coarsest level with at least one bucket per pixel
+    int l = 0;
+    while (l<Levels.size() && (n>>(l+1))>=qMax(pixels, 1)) { l++; }
+    return l;
+
+}
+
+/* === Query ========================================================= */
+
+void MinMaxPyramid::query(double k0, double k1, int pixels, QVector<double> &K, QVector<double> &V, Mode mode) const {
+
+    K.clear();
+    V.clear();
+    if (Keys.isEmpty()) { return; }
+
+    // One extra sample on each side, so that lines run off-screen
+    int i0 = qMax(lowerIndex(k0)-1, 0);
+    int i1 = qMin(lowerIndex(k1)+1, Keys.size());
+    int l = level(k0, k1, pixels);
+
+    if (!l) {
+        K = Keys.mid(i0, i1-i0);
+        V = Values.mid(i0, i1-i0);
+        return;
+    }
+
+    const QVector<Lod_Bucket> &Lv = Levels[l-1];
+    int b1 = qMin((i1>>l)+1, Lv.size());
+    K.reserve(2*(b1-(i0>>l)));
+    V.reserve(2*(b1-(i0>>l)));
+
+    for (int b=i0>>l; b<b1; b++) {
+
+        const Lod_Bucket &B = Lv[b];
+
+        if (mode==Mean) {
+            K.append((B.kmin+B.kmax)/2);
+            V.append(B.sum/B.n);
+        } else if (B.kmin<=B.kmax) {
+            K.append(B.kmin); V.append(B.vmin);
+            K.append(B.kmax); V.append(B.vmax);
+        } else {
+            K.append(B.kmax); V.append(B.vmax);
+            K.append(B.kmin); V.append(B.vmin);
+        }
+
+    }
+
+}
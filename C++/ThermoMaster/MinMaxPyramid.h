@@ -0,0 +1,57 @@
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <QVector>
+
+/* =================================================================== *\
+|    MinMaxPyramid Class                                                |
+\* =================================================================== */
+
+// Multi-resolution store of a whole-experiment trace. Level 0 holds the
+// raw samples; level l aggregates 2^l consecutive samples into a bucket
+// with its min, max (and where they occur) and mean. Buckets are updated
+// as samples arrive, so the pyramid is always current.
+//
+// Queries return 2 to 4 points per pixel: the coarsest level that still
+// resolves the screen, emitting each bucket's min and max in time
+// order so that no peak is lost.
+
+struct Lod_Bucket {
+
+    double kmin, kmax;      // Keys of the extrema
+    double vmin, vmax;
+    double sum;
+    int n;
+
+};
+
+class MinMaxPyramid {
+
+public:
+
+    enum Mode { MinMax, Mean };
+
+    MinMaxPyramid();
+
+    void append(double key, double value);
+    void clear();
+    void dropFront(int n);      // Oldest samples, the pyramid is rebuilt
+
+    int count() const { return Keys.size(); }
+    bool isEmpty() const { return Keys.isEmpty(); }
+    double firstKey() const { return Keys.first(); }
+    double lastKey() const { return Keys.last(); }
+
+    int level(double k0, double k1, int pixels) const;
+    void query(double k0, double k1, int pixels, QVector<double> &K, QVector<double> &V, Mode mode = MinMax) const;
+
+private:
+
+    QVector<double> Keys, Values;
+    QVector< QVector<Lod_Bucket> > Levels;     // Levels[l-1] aggregates 2^l samples
+
+    int lowerIndex(double) const;
+
+};
+
+#endif // MINMAXPYRAMID_H
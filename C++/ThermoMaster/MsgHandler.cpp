@@ -1,26 +1,231 @@
 #include "MsgHandler.h"
 
-QVector<Message> Messages;
+#include <QDateTime>
+#include <QThread>
+#include <QtNumeric>
 
-void MsgHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
+MsgQueue<Message, MSG_QUEUE_SIZE> Messages;
 
-    Message MSG;
-    MSG.type = type;
+/* =================================================================== *\
+|    Log records                                                        |
+\* =================================================================== */
+
+QString Log_Field::value() const {
+
+    switch (type) {
+    case Int: return QString::number(i);
+    case Real: return QString::number(d, 'g', 10);
+    default: return s;
+    }
+
+}
+
+Message::Message() {
+
+    type = QtInfoMsg;
+    style = Log_Text;
+    time = 0;
+    thread = 0;
+    nFields = 0;
+
+}
+
+int Message::rank(QtMsgType type) {
+
+    switch (type) {
+    case QtDebugMsg: return 0;
+    case QtInfoMsg: return 1;
+    case QtWarningMsg: return 2;
+    case QtCriticalMsg: return 3;
+    case QtFatalMsg: return 4;
+    }
+    return 1;
+
+}
+
+const char* Message::severity(QtMsgType type) {
+
+    switch (type) {
+    case QtDebugMsg: return "debug";
+    case QtInfoMsg: return "info";
+    case QtWarningMsg: return "warning";
+    case QtCriticalMsg: return "critical";
+    case QtFatalMsg: return "fatal";
+    }
+    return "info";
+
+}
+
+/* === Console formatting ============================================ */
+
+QString Message::html() const {
+
+    QString S;
+
+    switch (type) {
+    case QtWarningMsg: S = "<p class='warning'>"; break;
+    case QtCriticalMsg: S = "<p class='critical'>"; break;
+    case QtFatalMsg: S = "<p class='fatal'>"; break;
+    default:
+        switch (style) {
+        case Log_Title1: S = "<p class='title1'>"; break;
+        case Log_Title2: S = "<p class='title2'>"; break;
+        case Log_Thread: S = "<p class='thread'>"; break;
+        case Log_Custom: S = "<" + css + ">"; break;
+        default: S = "<p>";
+        }
+    }
+
+    S += text;
+    for (int k=0; k<nFields; k++) {
+        S += QString(" <span class='field'>%1</span>=%2").arg(fields[k].key).arg(fields[k].value().toHtmlEscaped());
+    }
+
+    return S + "</p>";
+
+}
+
+/* === File formatting =============================================== */
+
+static void appendJson(QString &S, const QString &s) {
+
+    S += '"';
+    for (int k=0; k<s.size(); k++) {
+        QChar c = s.at(k);
+        switch (c.unicode()) {
+        case '"': S += "\\\""; break;
+        case '\\': S += "\\\\"; break;
+        case '\n': S += "\\n"; break;
+        case '\r': S += "\\r"; break;
+        case '\t': S += "\\t"; break;
+        default:
+            if (c.unicode()<0x20) { S += QString("\\u%1").arg(c.unicode(), 4, 16, QLatin1Char('0')); }
+            else { S += c; }
+        }
+    }
+    S += '"';
+
+}
+
+// One line, with the time and level first so that readers can locate
+// and filter records without parsing the whole object
+QString Message::json() const {
+
+    static const char* Styles[] = { "text", "title1", "title2", "thread", "custom" };
+
+    QString S;
+    S.reserve(96 + text.size());
+    S += QString("{\"time\":%1,\"level\":\"%2\",\"style\":\"%3\",\"thread\":\"%4\",\"text\":")
+            .arg(time).arg(severity(type)).arg(Styles[style]).arg((qulonglong) thread, 0, 16);
+    appendJson(S, text);
+
+    if (nFields) {
+        S += ",\"fields\":{";
+        for (int k=0; k<nFields; k++) {
+            if (k) { S += ','; }
+            appendJson(S, QString(fields[k].key));
+            S += ':';
+            switch (fields[k].type) {
+            case Log_Field::Int: S += QString::number(fields[k].i); break;
+            case Log_Field::Real: S += qIsFinite(fields[k].d) ? QString::number(fields[k].d, 'g', 17) : QString("null"); break;
+            default: appendJson(S, fields[k].s);
+            }
+        }
+        S += '}';
+    }
+
+    return S + '}';
+
+}
+
+/* =================================================================== *\
+|    Log Class                                                          |
+\* =================================================================== */
+
+Log::Log(QtMsgType type, Log_Style style) {
+
+    M.type = type;
+    M.style = style;
+    M.time = QDateTime::currentMSecsSinceEpoch();
+    M.thread = (quintptr) QThread::currentThreadId();
+
+}
+
+Log::~Log() { Messages.push(M); }
+
+Log& Log::text(const QString &t) { M.text = t; return *this; }
 
-    QRegExp rx("css\\{(.*)\\}(.*)");
+Log_Field* Log::next(const char *key, Log_Field::Type type) {
 
-    if (rx.indexIn(msg)==-1) {
+    if (M.nFields>=LOG_MAX_FIELDS) { return 0; }
+    Log_Field *F = &M.fields[M.nFields++];
+    F->key = key;
+    F->type = type;
+    return F;
 
-        MSG.css = QString("p");
-        MSG.text = msg;
+}
+
+Log& Log::field(const char *key, int v) { return field(key, (qint64) v); }
+
+Log& Log::field(const char *key, qint64 v) {
+    Log_Field *F = next(key, Log_Field::Int);
+    if (F) { F->i = v; }
+    return *this;
+}
+
+Log& Log::field(const char *key, double v) {
+    Log_Field *F = next(key, Log_Field::Real);
+    if (F) { F->d = v; }
+    return *this;
+}
+
+Log& Log::field(const char *key, const QString &v) {
+    Log_Field *F = next(key, Log_Field::String);
+    if (F) { F->s = v; }
+    return *this;
+}
+
+/* =================================================================== *\
+|    Qt message handler                                                 |
+\* =================================================================== */
+
+// Legacy qInfo() << TITLE_1 << ... calls: the style prefix is matched
+// against the known macros, without any regular expression.
+
+void MsgHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
+
+    Q_UNUSED(context);
+
+    static const QLatin1String Prefixes[] = { QLatin1String(TITLE_1), QLatin1String(TITLE_2), QLatin1String(THREAD) };
+    static const Log_Style Styles[] = { Log_Title1, Log_Title2, Log_Thread };
+
+    Message MSG;
+    MSG.type = type;
+    MSG.time = QDateTime::currentMSecsSinceEpoch();
+    MSG.thread = (quintptr) QThread::currentThreadId();
+    MSG.text = msg;
 
-    } else {
+    if (msg.startsWith(QLatin1String("css{"))) {
 
-        MSG.css = rx.cap(1);
-        MSG.text = rx.cap(2).trimmed();
+        int k;
+        for (k=0; k<3; k++) {
+            if (msg.startsWith(Prefixes[k])) {
+                MSG.style = Styles[k];
+                MSG.text = msg.mid(Prefixes[k].size()).trimmed();
+                break;
+            }
+        }
 
+        // Other styles are kept verbatim
+        int close;
+        if (k==3 && (close = msg.indexOf(QLatin1Char('}'), 4))>=0) {
+            MSG.style = Log_Custom;
+            MSG.css = msg.mid(4, close-4);
+            MSG.text = msg.mid(close+1).trimmed();
+        }
     }
 
-    Messages.push_back(MSG);
+    // Never blocks: on overflow the message is dropped and counted
+    Messages.push(MSG);
 
 }
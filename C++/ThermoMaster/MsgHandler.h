@@ -3,23 +3,96 @@
 
 #include <QtMessageHandler>
 #include <QString>
-#include <QVector>
-#include <QRegExp>
 #include <iostream>
 
+#include "MsgQueue.h"
+
 #define TITLE_1 "css{p class='title1'}"
 #define TITLE_2 "css{p class='title2'}"
 #define THREAD "css{p class='thread'}"
 
 using namespace std;
 
+/* =================================================================== *\
+|    Log records                                                        |
+\* =================================================================== */
+
+// Records are captured as typed values and only formatted (html, json)
+// when a sink consumes them, away from the thread that logged.
+
+enum Log_Style { Log_Text, Log_Title1, Log_Title2, Log_Thread, Log_Custom };
+
+#define LOG_MAX_FIELDS 6
+
+struct Log_Field {
+
+    enum Type { Int, Real, String };
+
+    const char *key;    // String literal
+    Type type;
+    qint64 i;
+    double d;
+    QString s;
+
+    QString value() const;
+
+};
+
 struct Message {
+
     QtMsgType type;
+    Log_Style style;
+    qint64 time;        // ms since epoch
+    quintptr thread;
     QString text;
-    QString css;
+    QString css;        // Log_Custom only
+    Log_Field fields[LOG_MAX_FIELDS];
+    int nFields;
+
+    Message();
+
+    QString html() const;
+    QString json() const;
+
+    static const char* severity(QtMsgType);
+    static int rank(QtMsgType);         // Increasing severity, debug is 0
+
 };
 
-extern QVector<Message> Messages;
+/* =================================================================== *\
+|    Log Class                                                          |
+\* =================================================================== */
+
+// Structured logging, queued when the object goes out of scope:
+//
+//   Log(QtWarningMsg).text("Image incomplete").field("status", s);
+//
+// Fields beyond LOG_MAX_FIELDS are ignored.
+
+class Log {
+
+public:
+
+    Log(QtMsgType type = QtInfoMsg, Log_Style style = Log_Text);
+    ~Log();
+
+    Log& text(const QString&);
+    Log& field(const char *key, int);
+    Log& field(const char *key, qint64);
+    Log& field(const char *key, double);
+    Log& field(const char *key, const QString&);
+
+private:
+
+    Message M;
+    Log_Field* next(const char *key, Log_Field::Type);
+
+};
+
+// Filled from any thread, drained by the GUI thread only
+#define MSG_QUEUE_SIZE 4096
+
+extern MsgQueue<Message, MSG_QUEUE_SIZE> Messages;
 
 void MsgHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 
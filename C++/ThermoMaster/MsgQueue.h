@@ -0,0 +1,97 @@
+#ifndef MSGQUEUE_H
+#define MSGQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/* =================================================================== *\
+|    MsgQueue Class                                                     |
+\* =================================================================== */
+
+// Bounded multi-producer / single-consumer lock-free queue (after D.
+// Vyukov's bounded queue). Slots are preallocated and each carries a
+// sequence number telling whether it is free for the producer of a given
+// turn or ready for the consumer.
+//
+// push() never blocks nor allocates nor frees: when the queue is full,
+// the item is dropped and counted. pop() must only be called from a single thread.
+
+template <typename T, unsigned N>
+class MsgQueue {
+
+    static_assert(N>=2 && !(N & (N-1)), "MsgQueue capacity must be a power of two");
+
+public:
+
+    MsgQueue() {
+        for (unsigned i=0; i<N; i++) { Slots[i].seq.store(i, std::memory_order_relaxed); }
+        Enq.store(0, std::memory_order_relaxed);
+        Deq = 0;
+        Dropped.store(0, std::memory_order_relaxed);
+    }
+
+    // --- Producers (any thread)
+    bool push(const T &item) {
+
+        size_t pos = Enq.load(std::memory_order_relaxed);
+        Slot *S;
+
+        while (true) {
+            S = &Slots[pos & (N-1)];
+            size_t seq = S->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t) seq - (ptrdiff_t) pos;
+
+            if (dif==0) {
+                // Slot free for this turn: claim it
+                if (Enq.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) { break; }
+            } else if (dif<0) {
+                // Full: the consumer has not released this slot yet
+                Dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = Enq.load(std::memory_order_relaxed);
+            }
+        }
+
+        S->data = item;
+        S->seq.store(pos+1, std::memory_order_release);
+        return true;
+
+    }
+
+    // --- Consumer (single thread)
+    bool pop(T &item) {
+
+        Slot &S = Slots[Deq & (N-1)];
+        size_t seq = S.seq.load(std::memory_order_acquire);
+        if ((ptrdiff_t) seq - (ptrdiff_t) (Deq+1) < 0) { return false; }
+
+        // The slot is emptied here: whatever the move left in it (the
+        // previous content of item, for swapping types) is freed on the
+        // consumer side, never by the producer that overwrites it
+        item = std::move(S.data);
+        S.data = T();
+        S.seq.store(Deq+N, std::memory_order_release);
+        Deq++;
+        return true;
+
+    }
+
+    // Number of dropped items since the last call
+    unsigned takeDropped() { return Dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Slot Slots[N];
+    alignas(64) std::atomic<size_t> Enq;
+    alignas(64) size_t Deq;
+    alignas(64) std::atomic<unsigned> Dropped;
+
+};
+
+#endif // MSGQUEUE_H
@@ -0,0 +1,126 @@
+#include "PlantModel.h"
+
+/* =================================================================== *\
+|    PlantModel Class                                                   |
+\* =================================================================== */
+
+/* === Constructor =================================================== */
+
+PlantModel::PlantModel(Plant_Params Params, double dt) {
+
+    P = Params;
+
+    // Exact zero-order hold discretization of the first-order lag
+    a = P.tau>0 ? exp(-dt/P.tau) : 0;
+
+    // Dead time as a delay line of past commands
+    unsigned int n = P.L>0 ? (unsigned int) round(P.L/dt) : 0;
+    Delay.assign(n+1, 0);
+    iDelay = 0;
+
+    T = P.ambient;
+
+}
+
+/* === Reset ========================================================= */
+
+void PlantModel::reset(double Temp, double u) {
+
+    T = Temp;
+    Delay.assign(Delay.size(), u);
+    iDelay = 0;
+
+}
+
+/* === Time step ===================================================== */
+
+double PlantModel::step(double u) {
+
+    // Push the new command, pop the delayed one
+    Delay[iDelay] = u;
+    iDelay = (iDelay+1) % Delay.size();
+    double ud = Delay[iDelay];
+
+    T = P.ambient + a*(T - P.ambient) + (1-a)*P.K*ud;
+    return T;
+
+}
+
+/* =================================================================== *\
+|    Firmware PID replica                                               |
+\* =================================================================== */
+
+Firmware_PID::Firmware_PID(double p, double i, double d) {
+
+    P = p;
+    I = i;
+    D = d;
+    err = 0;
+    errRef = 0;
+    errInt = 0;
+
+}
+
+void Firmware_PID::start(double target, double temp) {
+
+    err = target - temp;
+    errInt = 10*err;
+
+}
+
+double Firmware_PID::command(double target, double temp) {
+
+    err = target - temp;
+
+    errInt += err;
+    if (errInt>99) { errInt = 99; }
+
+    double cmd = err*P + errInt*I + (err-errRef)*D;
+    if (cmd<-255) { cmd = -255; }
+    if (cmd>255) { cmd = 255; }
+
+    errRef = err;
+    return cmd;
+
+}
+
+/* =================================================================== *\
+|    Step response                                                      |
+\* =================================================================== */
+
+Step_Response simulateStep(Plant_Params Params, double P, double I, double D, double dt, double from, double to, double band) {
+
+    Step_Response R;
+    R.overshoot = 0;
+    R.settling = -1;
+    R.band = band;
+
+    PlantModel Plant(Params, dt);
+    Firmware_PID PID(P, I, D);
+
+    // Long enough for any sensible zone to settle twice
+    double duration = std::max(600.0, 40*(Params.tau + Params.L));
+    int n = (int) ceil(duration/dt);
+
+    // --- Warm-up at the initial target, starting from ambient
+    PID.start(from, Plant.T);
+    for (int k=0; k<n; k++) { Plant.step(PID.command(from, Plant.T)); }
+
+    // --- Step
+    double dir = to>=from ? 1 : -1;
+    int kLast = -1;
+
+    for (int k=0; k<n; k++) {
+
+        double T = Plant.step(PID.command(to, Plant.T));
+
+        R.overshoot = std::max(R.overshoot, dir*(T-to));
+        if (fabs(T-to)>band) { kLast = k; }
+
+    }
+
+    if (kLast<n-1) { R.settling = (kLast+1)*dt; }
+
+    return R;
+
+}
@@ -0,0 +1,79 @@
+#ifndef PLANTMODEL_H
+#define PLANTMODEL_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/* =================================================================== *\
+|    Thermal plant model                                                |
+\* =================================================================== */
+
+// First-order plus dead time (FOPDT) model of one Peltier zone.
+// Temperatures are in °C, commands in PWM units [-255, 255], times in s.
+
+struct Plant_Params {
+
+    double K;           // Static gain (°C per PWM unit)
+    double tau;         // Time constant (s)
+    double L;           // Dead time (s)
+    double ambient;     // Ambient temperature (°C)
+
+};
+
+class PlantModel {
+
+public:
+
+    PlantModel(Plant_Params, double dt);
+
+    void reset(double T, double u = 0);
+    double step(double u);
+
+    double T;
+
+private:
+
+    Plant_Params P;
+    double a;
+    std::vector<double> Delay;
+    unsigned int iDelay;
+
+};
+
+/* =================================================================== *\
+|    Firmware PID replica                                               |
+\* =================================================================== */
+
+// Mirrors the control section of loop() in Arduino/ThermoMaster.ino,
+// including its quirks: the integral is a plain sum of the errors (the
+// leak factor evaluates to 1 in integer arithmetic) clipped at 99 from
+// above only, and "start" pre-charges it with ErrIntTime*err.
+
+struct Firmware_PID {
+
+    double P, I, D;
+    double err, errRef, errInt;
+
+    Firmware_PID(double p = 75, double i = 0.55, double d = 50);
+
+    void start(double target, double temp);
+    double command(double target, double temp);
+
+};
+
+/* =================================================================== *\
+|    Step response                                                      |
+\* =================================================================== */
+
+struct Step_Response {
+
+    double overshoot;   // Peak excursion beyond the new target (°C)
+    double settling;    // Time to stay within the band (s), -1 if never
+    double band;        // Settling band half-width (°C)
+
+};
+
+Step_Response simulateStep(Plant_Params, double P, double I, double D, double dt, double from, double to, double band = 0.1);
+
+#endif // PLANTMODEL_H
@@ -0,0 +1,707 @@
+#include "Protocol.h"
+#include "MsgHandler.h"
+#include "Trace.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+/* =================================================================== *\
+|    Expressions                                                        |
+\* =================================================================== */
+
+double Expr::eval(const QVector<double> &Vars) const {
+
+    double Stack[32];
+    int n = 0;
+
+    for (int i=0; i<RPN.size(); i++) {
+
+        const Token &T = RPN[i];
+        switch (T.type) {
+        case Token::Number: Stack[n++] = T.value; break;
+        case Token::Variable: Stack[n++] = Vars[T.var]; break;
+        case Token::Neg: Stack[n-1] = -Stack[n-1]; break;
+        case Token::Add: n--; Stack[n-1] += Stack[n]; break;
+        case Token::Sub: n--; Stack[n-1] -= Stack[n]; break;
+        case Token::Mul: n--; Stack[n-1] *= Stack[n]; break;
+        case Token::Div: n--; Stack[n-1] /= Stack[n]; break;
+        }
+    }
+
+    return n ? Stack[0] : qQNaN();
+
+}
+
+// Recursive-descent parser, from infix to reverse Polish notation:
+//   expr := term { (+|-) term }
+//   term := unary { (*|/) unary }
+//   unary := -unary | number | $NAME | ( expr )
+
+class Expr_Parser {
+
+public:
+
+    Expr_Parser(const QString &s, const QStringList &names, Expr &E) : S(s), Names(names), Out(E.RPN) {
+        i = 0;
+        depth = 0;
+        maxDepth = 0;
+    }
+
+    QString Error;
+
+    bool parse() {
+
+        Out.clear();
+        expr();
+        skip();
+        if (Error.isEmpty() && i<S.size()) { Error = QString("unexpected \"%1\"").arg(S.mid(i)); }
+        if (Error.isEmpty() && maxDepth>=32) { Error = "expression too deep"; }
+        return Error.isEmpty();
+
+    }
+
+private:
+
+    const QString &S;
+    const QStringList &Names;
+    QVector<Expr::Token> &Out;
+    int i, depth, maxDepth;
+
+    void skip() { while (i<S.size() && S[i].isSpace()) { i++; } }
+
+    void emitOp(Expr::Token::Type type) {
+        Expr::Token T;
+        T.type = type;
+        T.value = 0;
+        T.var = -1;
+        Out.append(T);
+        if (type!=Expr::Token::Neg) { depth--; }
+    }
+
+    void expr() {
+
+        term();
+        while (Error.isEmpty()) {
+            skip();
+            if (i>=S.size() || (S[i]!='+' && S[i]!='-')) { return; }
+            QChar op = S[i++];
+            term();
+            emitOp(op=='+' ? Expr::Token::Add : Expr::Token::Sub);
+        }
+
+    }
+
+    void term() {
+
+        unary();
+        while (Error.isEmpty()) {
+            skip();
+            if (i>=S.size() || (S[i]!='*' && S[i]!='/')) { return; }
+            QChar op = S[i++];
+            unary();
+            emitOp(op=='*' ? Expr::Token::Mul : Expr::Token::Div);
+        }
+
+    }
+
+    void unary() {
+
+        skip();
+        if (i>=S.size()) { Error = "missing value"; return; }
+
+        Expr::Token T;
+        T.value = 0;
+        T.var = -1;
+
+        if (S[i]=='-') {
+
+            i++;
+            unary();
+            emitOp(Expr::Token::Neg);
+
+        } else if (S[i]=='(') {
+
+            i++;
+            expr();
+            skip();
+            if (Error.isEmpty() && (i>=S.size() || S[i]!=')')) { Error = "missing )"; return; }
+            i++;
+
+        } else if (S[i]=='$') {
+
+            int j = ++i;
+            while (i<S.size() && (S[i].isLetterOrNumber() || S[i]=='_')) { i++; }
+            QString name = S.mid(j, i-j);
+            T.type = Expr::Token::Variable;
+            T.var = Names.indexOf(name);
+            if (T.var<0) { Error = QString("undefined variable $%1").arg(name); return; }
+            Out.append(T);
+            maxDepth = qMax(maxDepth, ++depth);
+
+        } else {
+
+            int j = i;
+            while (i<S.size() && (S[i].isDigit() || S[i]=='.')) { i++; }
+            if (i<S.size() && (S[i]=='e' || S[i]=='E')) {
+                int k = i+1;
+                if (k<S.size() && (S[k]=='+' || S[k]=='-')) { k++; }
+                if (k<S.size() && S[k].isDigit()) {
+                    i = k;
+                    while (i<S.size() && S[i].isDigit()) { i++; }
+                }
+            }
+            bool ok = false;
+            T.type = Expr::Token::Number;
+            T.value = S.mid(j, i-j).toDouble(&ok);
+            if (!ok) { Error = QString("bad number \"%1\"").arg(S.mid(j)); return; }
+            Out.append(T);
+            maxDepth = qMax(maxDepth, ++depth);
+
+        }
+
+    }
+
+};
+
+/* =================================================================== *\
+|    Protocol Class                                                     |
+\* =================================================================== */
+
+Protocol_State::Protocol_State() {
+
+    PC = 0;
+    Count = 0;
+    Args[0] = Args[1] = Args[2] = 0;
+
+}
+
+Protocol::Protocol() { Duration = 0; }
+
+void Protocol::clear() {
+
+    Path.clear();
+    Program.clear();
+    Names.clear();
+    Errors.clear();
+    Duration = 0;
+
+}
+
+/* === Loading ======================================================= */
+
+bool Protocol::load(const QString &path) {
+
+    clear();
+    Path = path;
+
+    QFile File(path);
+    if (!File.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        Errors << QString("unable to open %1").arg(path);
+        return false;
+    }
+
+    QStringList Lines;
+    QTextStream stream(&File);
+    QString line;
+    while (stream.readLineInto(&line)) { Lines << line; }
+
+    return compile(Lines);
+
+}
+
+void Protocol::error(int line, const QString &msg) {
+
+    if (line>0) { Errors << QString("line %1: %2").arg(line).arg(msg); }
+    else { Errors << msg; }
+
+}
+
+bool Protocol::parseExpr(const QString &s, Expr &E, int line) {
+
+    Expr_Parser P(s, Names, E);
+    if (P.parse()) { return true; }
+    error(line, P.Error);
+    return false;
+
+}
+
+/* === Compilation =================================================== */
+
+bool Protocol::compile(const QStringList &Lines) {
+
+    Program.clear();
+    Names.clear();
+    Errors.clear();
+    Duration = 0;
+
+    QVector<int> Open;      // Pending repeat blocks
+
+    for (int k=0; k<Lines.size(); k++) {
+
+        QString line = Lines[k].trimmed();
+        int n = k+1;
+
+        // --- Empty lines and comments
+        if (line.isEmpty() || line.startsWith('#')) { continue; }
+
+        Instruction I;
+        I.line = n;
+        I.var = -1;
+        I.jump = -1;
+
+        // --- Blocks
+        if (line.startsWith("repeat") && line.endsWith('{')) {
+
+            I.op = Instruction::Repeat;
+            if (!parseExpr(line.mid(6, line.size()-7), I.arg[0], n)) { continue; }
+            Open.append(Program.size());
+            Program.append(I);
+            continue;
+
+        }
+
+        if (line=="}") {
+
+            if (Open.isEmpty()) {
+                error(n, "} without repeat");
+                continue;
+            }
+            I.op = Instruction::End;
+            I.jump = Open.takeLast();
+            Program[I.jump].jump = Program.size()+1;
+            Program.append(I);
+            continue;
+
+        }
+
+        // --- Commands
+        QStringList F = line.split(':');
+        for (int i=0; i<F.size(); i++) { F[i] = F[i].trimmed(); }
+        QString cmd = F[0];
+
+        if (cmd=="print") {
+
+            // The text may itself contain colons
+            if (F.size()<2) {
+                error(n, "print expects a text");
+                continue;
+            }
+            I.op = Instruction::Print;
+            I.text = line.mid(line.indexOf(':')+1).trimmed();
+
+        } else if (cmd=="data") {
+
+            if (F.size()!=2 || F[1]!="create directory") {
+                error(n, QString("unknown data command \"%1\"").arg(line));
+                continue;
+            }
+            I.op = Instruction::CreateDirectory;
+
+        } else if (cmd=="camera") {
+
+            if (F.size()==2 && F[1]=="start") { I.op = Instruction::CameraStart; }
+            else if (F.size()==2 && F[1]=="stop") { I.op = Instruction::CameraStop; }
+            else {
+                error(n, QString("unknown camera command \"%1\"").arg(line));
+                continue;
+            }
+
+        } else if (cmd=="clip") {
+
+            I.op = Instruction::Clip;
+            if (F.size()>1) { I.text = line.mid(line.indexOf(':')+1).trimmed(); }
+
+        } else if (cmd=="regulation") {
+
+            if (F.size()==2 && F[1]=="start") { I.op = Instruction::RegulationStart; }
+            else if (F.size()==2 && F[1]=="stop") { I.op = Instruction::RegulationStop; }
+            else {
+                error(n, QString("unknown regulation command \"%1\"").arg(line));
+                continue;
+            }
+
+        } else if (cmd=="targets") {
+
+            if (F.size()!=3) {
+                error(n, QString("targets expects two temperatures, got \"%1\"").arg(line));
+                continue;
+            }
+            I.op = Instruction::Targets;
+            if (!parseExpr(F[1], I.arg[0], n) || !parseExpr(F[2], I.arg[1], n)) { continue; }
+
+        } else if (cmd=="ramp") {
+
+            if (F.size()!=4) {
+                error(n, QString("ramp expects two temperatures and a duration, got \"%1\"").arg(line));
+                continue;
+            }
+            I.op = Instruction::Ramp;
+            if (!parseExpr(F[1], I.arg[0], n) || !parseExpr(F[2], I.arg[1], n) || !parseExpr(F[3], I.arg[2], n)) { continue; }
+
+        } else if (cmd=="wait") {
+
+            if (F.size()!=2) {
+                error(n, QString("wait expects a duration in ms, got \"%1\"").arg(line));
+                continue;
+            }
+            I.op = Instruction::Wait;
+            if (!parseExpr(F[1], I.arg[0], n)) { continue; }
+
+        } else if (cmd=="var") {
+
+            bool valid = F.size()==3 && !F[1].isEmpty() && !F[1][0].isDigit();
+            for (int i=0; valid && i<F[1].size(); i++) { valid = F[1][i].isLetterOrNumber() || F[1][i]=='_'; }
+            if (!valid) {
+                error(n, QString("var expects a name and a value, got \"%1\"").arg(line));
+                continue;
+            }
+
+            // The value may refer to the previous value, not to an undeclared name
+            I.op = Instruction::Var;
+            if (!parseExpr(F[2], I.arg[0], n)) { continue; }
+            I.var = Names.indexOf(F[1]);
+            if (I.var<0) {
+                I.var = Names.size();
+                Names << F[1];
+            }
+
+        } else {
+
+            error(n, QString("unknown command \"%1\"").arg(line));
+            continue;
+
+        }
+
+        Program.append(I);
+
+    }
+
+    foreach (int k, Open) { error(Program[k].line, "repeat block is not closed"); }
+
+    // --- Dry run
+    if (Errors.isEmpty()) { validate(); }
+
+    return Errors.isEmpty();
+
+}
+
+/* === Execution state =============================================== */
+
+void Protocol::reset(Protocol_State &S) const {
+
+    S.PC = 0;
+    S.Count = 0;
+    S.Vars.fill(0, Names.size());
+    S.Loops.clear();
+
+}
+
+const Instruction* Protocol::next(Protocol_State &S) const {
+
+    while (S.PC<Program.size() && S.Count<MaxSteps) {
+
+        const Instruction &I = Program[S.PC++];
+        S.Count++;
+
+        switch (I.op) {
+
+        // --- Control flow
+        case Instruction::Var:
+            S.Vars[I.var] = I.arg[0].eval(S.Vars);
+            continue;
+
+        case Instruction::Repeat: {
+            double n = I.arg[0].eval(S.Vars);
+            if (n>=1) { S.Loops.append(qMakePair(S.PC-1, (qint64) qRound64(n))); }
+            else { S.PC = I.jump; }
+            continue;
+        }
+
+        case Instruction::End:
+            if (--S.Loops.last().second>0) { S.PC = I.jump+1; }
+            else { S.Loops.removeLast(); }
+            continue;
+
+        // --- Actions
+        case Instruction::Print:
+        case Instruction::Clip:
+            S.Text = I.text;
+            if (S.Text.contains('$')) {
+                // Longest names first, so that $T does not match $T2
+                QStringList Sorted = Names;
+                std::sort(Sorted.begin(), Sorted.end(), [](const QString &a, const QString &b) { return a.size()>b.size(); });
+                foreach (const QString &name, Sorted) {
+                    S.Text.replace("$" + name, QString::number(S.Vars[Names.indexOf(name)]));
+                }
+            }
+            return &I;
+
+        default:
+            for (int k=0; k<3; k++) { S.Args[k] = I.arg[k].RPN.isEmpty() ? 0 : I.arg[k].eval(S.Vars); }
+            return &I;
+
+        }
+    }
+
+    return 0;
+
+}
+
+/* === Validation and planned duration =============================== */
+
+// Protocols do not depend on external inputs, so a dry run goes through
+// exactly the instructions of the real run.
+
+void Protocol::validate() {
+
+    Protocol_State S;
+    reset(S);
+
+    bool directory = false;
+    qint64 d = 0;
+    const Instruction *I;
+
+    while (Errors.isEmpty() && (I = next(S))) {
+
+        switch (I->op) {
+
+        case Instruction::CreateDirectory:
+            directory = true;
+            break;
+
+        case Instruction::CameraStart:
+            if (!directory) { error(I->line, "camera:start before any data:create directory"); }
+            break;
+
+        case Instruction::Targets:
+            if (!std::isfinite(S.Args[0]) || !std::isfinite(S.Args[1])) { error(I->line, "invalid target temperature"); }
+            break;
+
+        case Instruction::Ramp:
+            if (!std::isfinite(S.Args[0]) || !std::isfinite(S.Args[1])) { error(I->line, "invalid target temperature"); }
+            if (!std::isfinite(S.Args[2]) || S.Args[2]<0) { error(I->line, QString("invalid ramp duration %1 ms").arg(S.Args[2])); }
+            else { d += qRound64(S.Args[2]); }
+            break;
+
+        case Instruction::Wait:
+            if (!std::isfinite(S.Args[0]) || S.Args[0]<0) { error(I->line, QString("invalid wait duration %1 ms").arg(S.Args[0])); }
+            else { d += qRound64(S.Args[0]); }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (S.Count>=MaxSteps) { error(0, QString("the protocol exceeds %1 instructions").arg(MaxSteps)); }
+
+    Duration = d;
+
+}
+
+/* =================================================================== *\
+|    ProtocolEngine Class                                               |
+\* =================================================================== */
+
+ProtocolEngine::ProtocolEngine(QObject *parent) : QObject(parent) {
+
+    Left = 0;
+    Right = 0;
+    RampPeriod = 500;
+
+    Line = 0;
+    Running = false;
+    Waiting = false;
+    Ramping = false;
+    Deadline = 0;
+    Steps = 0;
+    WorstLateness = 0;
+    TotalLateness = 0;
+
+    Timer = new QTimer(this);
+    Timer->setSingleShot(true);
+    Timer->setTimerType(Qt::PreciseTimer);
+    connect(Timer, SIGNAL(timeout()), this, SLOT(run()));
+
+    // --- Metrics
+    mLateness = Metrics::histogram("thermo_protocol_lateness_seconds", "Delay of the protocol steps on their deadlines",
+                                   Metrics::exponential(0.0005, 2, 12));
+
+    Metric_Gauge *mRunning = Metrics::gauge("thermo_protocol_running", "1 while a protocol is running");
+    Metric_Gauge *mLine = Metrics::gauge("thermo_protocol_line", "Source line of the current instruction");
+    Metric_Gauge *mElapsed = Metrics::gauge("thermo_protocol_elapsed_seconds", "Time since the protocol started");
+    Metric_Gauge *mRemaining = Metrics::gauge("thermo_protocol_remaining_seconds", "Planned time left");
+    Metric_Gauge *mLeft = Metrics::gauge("thermo_protocol_target_celsius", "Protocol targets", "zone=\"left\"");
+    Metric_Gauge *mRight = Metrics::gauge("thermo_protocol_target_celsius", "Protocol targets", "zone=\"right\"");
+
+    Metrics::collect(this, [=]() {
+        double l, r;
+        current(l, r);
+        mRunning->set(Running);
+        mLine->set(Line);
+        mElapsed->set(elapsed()*1e-3);
+        mRemaining->set(Running ? remaining()*1e-3 : 0);
+        mLeft->set(l);
+        mRight->set(r);
+    });
+
+}
+
+void ProtocolEngine::load(const Protocol &P) {
+
+    stop();
+    Program = P;
+    Program.reset(State);
+    Line = 0;
+
+}
+
+int ProtocolEngine::line() const { return Line; }
+
+qint64 ProtocolEngine::elapsed() const { return Clock.isValid() ? Clock.elapsed() : 0; }
+
+qint64 ProtocolEngine::remaining() const { return qMax((qint64) 0, Program.duration() - elapsed()); }
+
+void ProtocolEngine::current(double &left, double &right) const {
+
+    left = Left;
+    right = Right;
+    if (!Ramping) { return; }
+
+    double f = qBound(0.0, (Clock.nsecsElapsed()*1e-6-RampStart)/qMax((qint64) 1, Deadline-RampStart), 1.0);
+    left += f*(RampLeft-Left);
+    right += f*(RampRight-Right);
+
+}
+
+/* === Control ======================================================= */
+
+void ProtocolEngine::start() {
+
+    Program.reset(State);
+    Line = 0;
+    Deadline = 0;
+    Steps = 0;
+    WorstLateness = 0;
+    TotalLateness = 0;
+    Waiting = false;
+    Ramping = false;
+    Running = true;
+
+    Clock.start();
+    run();
+
+}
+
+void ProtocolEngine::stop() {
+
+    Timer->stop();
+    Running = false;
+    Waiting = false;
+    Ramping = false;
+
+}
+
+/* === Execution ===================================================== */
+
+// Waiting for a deadline: true while it is still ahead (the timer is
+// armed), false once it is reached
+bool ProtocolEngine::hold() {
+
+    double now = Clock.nsecsElapsed()*1e-6;
+
+    if (now<Deadline) {
+
+        // Ramp display update
+        if (Ramping) {
+            double l, r;
+            current(l, r);
+            emit setpoints(l, r);
+        }
+
+        // Sleep again until the deadline (or the next display update)
+        qint64 dt = qMax((qint64) 1, Deadline - (qint64) now);
+        Timer->start((int) qMin(Ramping ? qMin(dt, (qint64) RampPeriod) : dt, (qint64) INT_MAX));
+        return true;
+    }
+
+    if (Ramping) {
+        Left = RampLeft;
+        Right = RampRight;
+        Ramping = false;
+        emit setpoints(Left, Right);
+    }
+
+    double late = now - Deadline;
+    Waiting = false;
+    Steps++;
+    WorstLateness = qMax(WorstLateness, late);
+    TotalLateness += late;
+    mLateness->observe(qMax(0.0, late)*1e-3);
+
+    Log(QtDebugMsg).text("Protocol step").field("line", Line)
+            .field("deadline_ms", Deadline).field("late_ms", late);
+
+    return false;
+
+}
+
+void ProtocolEngine::run() {
+
+    TRACE_SPAN("protocol step");
+
+    if (Waiting && hold()) { return; }
+
+    const Instruction *I;
+
+    while (Running && (I = Program.next(State))) {
+
+        Line = I->line;
+
+        switch (I->op) {
+        case Instruction::Print: emit print(State.Text); break;
+        case Instruction::CreateDirectory: emit createDirectory(); break;
+        case Instruction::CameraStart: emit camera(true); break;
+        case Instruction::CameraStop: emit camera(false); break;
+        case Instruction::Clip: emit clip(State.Text); break;
+        case Instruction::RegulationStart: emit regulation(true); break;
+        case Instruction::RegulationStop: emit regulation(false); break;
+
+        case Instruction::Targets:
+            Left = State.Args[0];
+            Right = State.Args[1];
+            emit targets(Left, Right);
+            break;
+
+        case Instruction::Ramp:
+            RampLeft = State.Args[0];
+            RampRight = State.Args[1];
+            RampStart = Deadline;
+            Ramping = true;
+            emit ramp(RampLeft, RampRight, qRound64(State.Args[2]));
+            Deadline += qRound64(State.Args[2]);
+            Waiting = true;
+            if (hold()) { return; }
+            break;
+
+        case Instruction::Wait:
+            Deadline += qRound64(State.Args[0]);
+            Waiting = true;
+            if (hold()) { return; }
+            break;
+
+        default:
+            break;
+        }
+
+    }
+
+    if (Running) {
+        Running = false;
+        emit finished();
+    }
+
+}
@@ -0,0 +1,199 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "Metrics.h"
+
+/* =================================================================== *\
+|    Protocol Class                                                     |
+\* =================================================================== */
+
+// Protocol files are compiled once into a list of typed instructions,
+// and validated completely before anything runs. Syntax, one command per
+// line ('#' starts a comment):
+//
+//   print:<text>                   ($NAME is replaced by its value)
+//   data:create directory
+//   camera:start | camera:stop
+//   clip[:<label>]                 saves the frames around this instant
+//   regulation:start | regulation:stop
+//   targets:<left>:<right>         (°C)
+//   ramp:<left>:<right>:<duration> (°C, ms) linear, from the current targets
+//   wait:<duration>                (ms)
+//   var:<NAME>:<value>
+//   repeat <count> {
+//   }
+//
+// Numeric arguments are expressions of numbers and $NAME variables with
+// + - * / and parentheses, evaluated when the instruction is reached.
+
+struct Expr {
+
+    struct Token {
+        enum Type { Number, Variable, Add, Sub, Mul, Div, Neg };
+        Type type;
+        double value;
+        int var;
+    };
+
+    QVector<Token> RPN;
+
+    double eval(const QVector<double> &Vars) const;
+
+};
+
+struct Instruction {
+
+    enum Op { Print, CreateDirectory, CameraStart, CameraStop, Clip, RegulationStart, RegulationStop,
+              Targets, Ramp, Wait, Var, Repeat, End };
+
+    Op op;
+    int line;           // 1-based, in the source file
+    QString text;       // Print, Clip
+    Expr arg[3];        // Targets (left, right), Ramp (left, right, ms), Wait (ms), Var (value), Repeat (count)
+    int var;            // Var: variable slot
+    int jump;           // Repeat: index after the matching End; End: index of the Repeat
+
+};
+
+// Execution state. Control flow (variables, loops) is resolved lazily by
+// Protocol::next(), which only returns the actions, with their evaluated
+// arguments.
+
+struct Protocol_State {
+
+    int PC;
+    QVector<double> Vars;
+    QVector< QPair<int, qint64> > Loops;    // Repeat index, iterations left
+    double Args[3];
+    QString Text;
+    qint64 Count;                           // Instructions processed
+
+    Protocol_State();
+
+};
+
+class Protocol {
+
+public:
+
+    Protocol();
+
+    bool load(const QString &path);
+    bool compile(const QStringList &lines);
+    void clear();
+
+    void reset(Protocol_State&) const;
+    const Instruction* next(Protocol_State&) const;
+
+    qint64 duration() const { return Duration; }    // Planned duration (ms)
+
+    QString Path;
+    QVector<Instruction> Program;
+    QStringList Names;              // Variables, by slot
+    QStringList Errors;             // "line N: ..." messages
+
+    static const qint64 MaxSteps = 10000000;
+
+private:
+
+    qint64 Duration;
+
+    void error(int line, const QString&);
+    bool parseExpr(const QString&, Expr&, int line);
+    void validate();
+
+};
+
+/* =================================================================== *\
+|    ProtocolEngine Class                                               |
+\* =================================================================== */
+
+// Runs a compiled program iteratively: consecutive instructions execute
+// in a single pass and the engine only yields on waits and ramps. Actions
+// are exposed as signals.
+//
+// Waits are scheduled against absolute deadlines on a monotonic clock
+// started with the protocol, so that timer latencies do not accumulate
+// along the run. The lateness of each step is logged and summarized.
+//
+// Ramps are handed over in one piece (the board interpolates its own
+// setpoints); the engine only emits interpolated setpoints for display,
+// every RampPeriod.
+
+class ProtocolEngine : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    ProtocolEngine(QObject *parent = 0);
+
+    void load(const Protocol&);
+    bool isRunning() const { return Running; }
+    bool isRamping() const { return Ramping; }
+    int line() const;               // Source line of the current instruction
+
+    qint64 elapsed() const;         // Since start (ms)
+    qint64 remaining() const;       // Planned time left (ms)
+    void current(double &left, double &right) const;    // Targets, along the ramps
+
+    // Current targets, origin of the ramps
+    double Left, Right;
+    int RampPeriod;                 // ms
+
+    // Lateness statistics (ms)
+    int Steps;
+    double WorstLateness, TotalLateness;
+
+public slots:
+
+    void start();
+    void stop();
+
+signals:
+
+    void print(QString);
+    void createDirectory();
+    void camera(bool);
+    void clip(QString);
+    void regulation(bool);
+    void targets(double, double);
+    void ramp(double, double, qint64);
+    void setpoints(double, double);
+    void finished();
+
+private slots:
+
+    void run();
+
+private:
+
+    Protocol Program;
+    Protocol_State State;
+    int Line;
+    bool Running, Waiting;
+    QTimer *Timer;
+
+    QElapsedTimer Clock;
+    qint64 Deadline;                // Nominal time of the next step (ms)
+
+    // Ramp in progress
+    bool Ramping;
+    double RampLeft, RampRight;
+    qint64 RampStart;
+
+    Metric_Histogram *mLateness;
+
+    bool hold();
+
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,152 @@
+#include "ProtocolSim.h"
+
+#include <QElapsedTimer>
+#include <cmath>
+
+/* === Constructor =================================================== */
+
+ProtocolSim::ProtocolSim(const Plant_Params &left, const Plant_Params &right, double step) {
+
+    Params[0] = left;
+    Params[1] = right;
+    dt = step>0 ? step : 0.1;
+
+    P = 75;
+    I = 0.55;
+    D = 50;
+    Band = 0.5;
+    TraceInterval = 1;
+    Initial[0] = left.ambient;
+    Initial[1] = right.ambient;
+
+    Runtime = 0;
+    Elapsed = 0;
+
+}
+
+/* === Simulation ==================================================== */
+
+bool ProtocolSim::run(const Protocol &Prog) {
+
+    QElapsedTimer Timer;
+    Timer.start();
+
+    Steps.clear();
+    Time.clear();
+    for (int z=0; z<2; z++) {
+        Temp[z].clear();
+        Target[z].clear();
+    }
+
+    PlantModel Plant[2] = { PlantModel(Params[0], dt), PlantModel(Params[1], dt) };
+    Firmware_PID PID[2] = { Firmware_PID(P, I, D), Firmware_PID(P, I, D) };
+
+    // Board state at power-up (see the firmware definitions)
+    double target[2] = { 28, 28 };
+    bool regulation = false;
+
+    for (int z=0; z<2; z++) { Plant[z].reset(Initial[z]); }
+
+    // Preallocate the traces
+    int nTrace = (int) (Prog.duration()*1e-3/TraceInterval) + 2;
+    Time.reserve(nTrace);
+    for (int z=0; z<2; z++) {
+        Temp[z].reserve(nTrace);
+        Target[z].reserve(nTrace);
+    }
+
+    int every = qMax(1, (int) round(TraceInterval/dt));
+    qint64 k = 0;               // Loop iterations since start
+
+    Protocol_State S;
+    Prog.reset(S);
+    const Instruction *Ins;
+
+    while ((Ins = Prog.next(S))) {
+
+        switch (Ins->op) {
+
+        case Instruction::RegulationStart:
+            regulation = true;
+            for (int z=0; z<2; z++) { PID[z].start(target[z], Plant[z].T); }
+            break;
+
+        case Instruction::RegulationStop:
+            regulation = false;
+            break;
+
+        case Instruction::Targets:
+            target[0] = S.Args[0];
+            target[1] = S.Args[1];
+            break;
+
+        case Instruction::Wait:
+        case Instruction::Ramp: {
+
+            bool ramp = Ins->op==Instruction::Ramp;
+            double duration = (ramp ? S.Args[2] : S.Args[0])*1e-3;
+            qint64 n = (qint64) round(duration/dt);
+            if (n<=0) { break; }
+
+            double from[2] = { target[0], target[1] };
+            double to[2] = { ramp ? S.Args[0] : target[0], ramp ? S.Args[1] : target[1] };
+
+            Sim_Step St;
+            St.line = Ins->line;
+            St.start = k*dt;
+            St.duration = n*dt;
+
+            qint64 lastOut[2] = { -1, -1 };
+            qint64 inBand[2] = { 0, 0 };
+            qint64 saturated[2] = { 0, 0 };
+
+            for (qint64 i=0; i<n; i++, k++) {
+
+                for (int z=0; z<2; z++) {
+
+                    if (ramp) { target[z] = from[z] + (to[z]-from[z])*(i+1)/n; }
+
+                    // The firmware updates the integral even when not regulating
+                    double T = Plant[z].T;
+                    double u = PID[z].command(target[z], T);
+                    if (!regulation) { u = 0; }
+                    if (fabs(u)>=255) { saturated[z]++; }
+                    T = Plant[z].step(u);
+
+                    if (fabs(T-target[z])<=Band) { inBand[z]++; }
+                    else { lastOut[z] = i; }
+
+                }
+
+                if (!(k % every)) {
+                    Time.append(k*dt);
+                    for (int z=0; z<2; z++) {
+                        Temp[z].append(Plant[z].T);
+                        Target[z].append(target[z]);
+                    }
+                }
+            }
+
+            for (int z=0; z<2; z++) {
+                St.target[z] = target[z];
+                St.end[z] = Plant[z].T;
+                St.inBand[z] = inBand[z]*dt;
+                St.saturated[z] = saturated[z]*dt;
+                St.settling[z] = lastOut[z]<n-1 ? (lastOut[z]+1)*dt : -1;
+            }
+            Steps.append(St);
+
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    Runtime = k*dt;
+    Elapsed = Timer.elapsed();
+
+    return !Steps.isEmpty();
+
+}
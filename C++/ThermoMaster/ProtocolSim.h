@@ -0,0 +1,59 @@
+#ifndef PROTOCOLSIM_H
+#define PROTOCOLSIM_H
+
+#include <QVector>
+
+#include "Protocol.h"
+#include "PlantModel.h"
+
+/* =================================================================== *\
+|    ProtocolSim Class                                                  |
+\* =================================================================== */
+
+// Fast-forward dry run of a compiled protocol against the FOPDT models of
+// both zones and the firmware PID replica, at the firmware loop period.
+// Each wait or ramp is a step, for which the time spent within Band of
+// the targets, the settling and saturation times are reported. Traces are
+// decimated to one sample every TraceInterval.
+
+struct Sim_Step {
+
+    int line;
+    double start;           // s, from protocol start
+    double duration;        // s
+    double target[2];       // Targets at the end of the step (°C)
+    double end[2];          // Temperatures at the end of the step (°C)
+    double inBand[2];       // Time within the band (s)
+    double settling[2];     // Time to enter the band for good (s), -1 if never
+    double saturated[2];    // Time at the command limits (s)
+
+};
+
+class ProtocolSim {
+
+public:
+
+    ProtocolSim(const Plant_Params &left, const Plant_Params &right, double dt);
+
+    bool run(const Protocol&);
+
+    // Settings
+    double P, I, D;
+    double Band;                    // °C
+    double TraceInterval;           // s
+    double Initial[2];              // Initial temperatures (°C)
+
+    // Results
+    QVector<Sim_Step> Steps;
+    QVector<double> Time, Temp[2], Target[2];
+    double Runtime;                 // Simulated duration (s)
+    qint64 Elapsed;                 // Computation time (ms)
+
+private:
+
+    Plant_Params Params[2];
+    double dt;
+
+};
+
+#endif // PROTOCOLSIM_H
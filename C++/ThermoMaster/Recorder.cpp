@@ -0,0 +1,284 @@
+#include "Recorder.h"
+#include "Metrics.h"
+#include "FrameKernels.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <cstring>
+
+/* === Constructor =================================================== */
+
+Recorder::Recorder(QObject *parent) : QObject(parent) {
+
+    Rate = 0;
+    StoreImages = true;
+    Track = new Tracker(this);
+    Encoders = new EncoderPool(this);
+    MaxDelay = 500000000;
+    nRun = 0;
+    nFrame = 0;
+    Recording = false;
+    tLast = -1;
+
+    mFrames = Metrics::counter("thermo_recorder_frames_total", "Frames saved to the run");
+    mThrottled = Metrics::counter("thermo_recorder_throttled_total", "Frames skipped by the save rate");
+    mDecimated = Metrics::counter("thermo_recorder_decimated_total", "Frames skipped by the decimation of the files");
+    mRecording = Metrics::gauge("thermo_recorder_recording", "1 while frames are being saved");
+    mPending = Metrics::gauge("thermo_recorder_pending_frames", "Frames waiting for the temperatures of their time");
+    mWait = Metrics::histogram("thermo_recorder_wait_seconds", "Time between a frame and the temperature sample after it",
+                               Metrics::exponential(0.001, 2, 12));
+
+}
+
+/* === Settings ====================================================== */
+
+void Recorder::load(const QSettings &Settings) {
+
+    Storage.load(Settings, "Recording");
+    Analysis.load(Settings, "Analysis");
+
+}
+
+/* === Runs ========================================================== */
+
+int Recorder::lastRun(const QString &dataPath) {
+
+    int n = 0;
+    QFileInfoList FIL = QDir(dataPath).entryInfoList(QDir::AllDirs | QDir::NoDotAndDotDot, QDir::DirsFirst);
+    foreach(const QFileInfo &elm, FIL) {
+
+        QStringList tmp = elm.fileName().split(" ", QString::SkipEmptyParts);
+        if (tmp.count()==2 && !tmp.at(0).compare("Run")) { n = qMax(n, tmp.at(1).toInt()); }
+
+    }
+    return n;
+
+}
+
+bool Recorder::createRun(const QString &dataPath, const QString &protocolPath, const Run_Parameters &Parameters) {
+
+    QString sep = QDir::separator();
+
+    // Create run directory
+    if (!QDir().mkpath(dataPath)) {
+        qWarning() << "Unable to create" << qPrintable(dataPath);
+        return false;
+    }
+    nRun = qMax(nRun, lastRun(dataPath)) + 1;
+    RunPath = QString(dataPath + "Run %1" + sep).arg(nRun, 2, 10, QLatin1Char('0'));
+    if (!QDir().mkpath(RunPath)) {
+        qWarning() << "Unable to create" << qPrintable(RunPath);
+        return false;
+    }
+
+    // Save protocol file
+    if (!protocolPath.isEmpty()) { QFile::copy(protocolPath, RunPath + "Protocol.txt"); }
+
+    // Save parameters
+    QFile fparam(RunPath + "Parameters.txt");
+    if (fparam.open(QIODevice::WriteOnly)) {
+        QTextStream stream(&fparam);
+        for (int i=0; i<Parameters.size(); i++) {
+            stream << Parameters[i].first << "\t" << Parameters[i].second << endl;
+        }
+        if (!Storage.isIdentity()) { stream << "Frames\t" << Storage.describe() << endl; }
+        if (!Analysis.isIdentity()) { stream << "Tracking_frames\t" << Analysis.describe() << endl; }
+    }
+
+    return true;
+
+}
+
+/* === Recording ===================================================== */
+
+void Recorder::start() {
+
+    nFrame = 0;
+    tLast = -1;
+    Recording = true;
+    mRecording->set(1);
+    Encoders->Signature = Signature;
+    Storage.reset();
+    Analysis.reset();
+    Track->Bin = Analysis.Bin;
+
+    if (RunPath.isEmpty()) { return; }
+    if (Track->Enabled) { Track->start(RunPath + "Tracking.tsv"); }
+
+    // Appended when a run is resumed
+    MotionFile.close();
+    MotionFile.setFileName(RunPath + "Motion.tsv");
+    bool header = !MotionFile.exists();
+    if (MotionFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        Motion.setDevice(&MotionFile);
+        if (header) { Motion << "timestamp\tleft\tright\troi\n"; }
+    } else { qWarning() << "Unable to write" << qPrintable(MotionFile.fileName()); }
+
+}
+
+void Recorder::stop() {
+
+    release(0, true);
+    Recording = false;
+    mRecording->set(0);
+    Encoders->finish();
+    Track->stop();
+
+    Motion.flush();
+    Motion.setDevice(0);
+    MotionFile.close();
+
+}
+
+void Recorder::write(const QImage &Img, qint64 timestamp, qint64 time, const QImage &Raw) {
+
+    if (!Recording || RunPath.isEmpty()) { return; }
+
+    Recorder_Frame F = { Img, Raw, timestamp, time };
+    Pending.append(F);
+    release(time);
+
+}
+
+void Recorder::addTemperatures(const Temperature_Sample &S) {
+
+    Temperatures.append(S);
+    if (!Pending.isEmpty()) { release(S.t); }
+
+}
+
+// Frames covered by the temperatures, or waiting for too long
+void Recorder::release(qint64 time, bool all) {
+
+    while (!Pending.isEmpty()) {
+
+        const Recorder_Frame &F = Pending.first();
+        bool covered = Temperatures.lastTime()>=F.time;
+        if (!covered && !all && time-F.time<MaxDelay) { break; }
+        if (covered && !all) { mWait->observe((time-F.time)*1e-9); }
+
+        Temperature_Sample T;
+        Temperatures.next(F.time, T);
+        save(F, T);
+        Pending.removeFirst();
+
+    }
+    mPending->set(Pending.size());
+
+}
+
+void Recorder::save(const Recorder_Frame &F, const Temperature_Sample &T) {
+
+    // Every frame is tracked, at the resolution and rate of the analysis
+    if (Track->isRunning()) {
+        if (Analysis.take()) { Track->push(Analysis.apply(F.Img), F.timestamp, T.TL, T.TR); }
+        else { Track->skip(); }
+    }
+    if (!StoreImages) { return; }
+
+    if (!Storage.take()) { mDecimated->add(); return; }
+
+    // --- Save rate, on the camera clock (ns)
+    if (Rate>0 && tLast>=0 && F.timestamp-tLast < 1e9/Rate) { mThrottled->add(); return; }
+    tLast = F.timestamp;
+
+    if (!Encoders->submit(QString(RunPath + "Frame_%1.").arg(nFrame, 6, 10, QLatin1Char('0')) + Encoders->Format,
+                          Storage.apply(F.Raw.isNull() ? F.Img : F.Raw), F.timestamp, T)) { return; }
+
+    nFrame++;
+    mFrames->add();
+    emit frameSaved();
+
+}
+
+void Recorder::writeMotion(qint64 timestamp, double left, double right, double roi) {
+
+    if (!Recording || !Motion.device()) { return; }
+    Motion << timestamp << '\t' << left << '\t' << right << '\t' << roi << '\n';
+
+}
+
+/* === PGM frames ==================================================== */
+
+QString Recorder::metadata(qint64 timestamp, double TL, double TR, double targetLeft, double targetRight) {
+
+    QString M = QString("Timestamp:%1;TempLeft:%2;TempRight:%3").arg(timestamp).arg(TL).arg(TR);
+    if (!qIsNaN(targetLeft)) { M += QString(";TargetLeft:%1;TargetRight:%2").arg(targetLeft).arg(targetRight); }
+    return M;
+
+}
+
+bool Recorder::writeFrame(const QString &path, const QImage &Img, const QString &signature,
+                          qint64 timestamp, double TL, double TR, QByteArray &Buffer,
+                          double targetLeft, double targetRight) {
+
+    QElapsedTimer T;
+    T.start();
+
+    // --- Sensor levels of high bit-depth frames, at their depth
+    bool deep = Img.format()==QImage::Format_Grayscale16;
+    int bits = deep ? Img.text("Bits").toInt() : 8;
+    if (bits<=0 || bits>16) { bits = 16; }
+
+    // --- Gray levels, through the color table of indexed images
+    QImage G = Img;
+    if (!deep && G.format()!=QImage::Format_Indexed8 && G.format()!=QImage::Format_Grayscale8) {
+        G = G.convertToFormat(QImage::Format_Grayscale8);
+    }
+
+    uchar Lut[256];
+    bool identity = true;
+    QVector<QRgb> Colors = G.format()==QImage::Format_Indexed8 ? G.colorTable() : QVector<QRgb>();
+    for (int i=0; i<256; i++) {
+        Lut[i] = i<Colors.size() ? qGray(Colors[i]) : i;
+        if (Lut[i]!=i) { identity = false; }
+    }
+
+    // --- Header, pixels and metadata in a single write
+    int w = G.width(), h = G.height();
+    int row = deep ? 2*w : w;
+    QByteArray Header = QString("P5\n%1 %2\n%3\n").arg(w).arg(h).arg((1 << bits) - 1).toLatin1();
+    QByteArray Meta = QString("\n#%1\n#%2").arg(signature).arg(metadata(timestamp, TL, TR, targetLeft, targetRight)).toLatin1();
+
+    Buffer.resize(Header.size() + row*h + Meta.size());
+    char *p = Buffer.data();
+    memcpy(p, Header.constData(), Header.size());
+    p += Header.size();
+
+    for (int y=0; y<h; y++) {
+        const uchar *line = G.constScanLine(y);
+        if (deep) { toBigEndian16((const quint16*) line, (uchar*) p, w); }
+        else if (identity) { memcpy(p, line, w); }
+        else { for (int x=0; x<w; x++) { p[x] = Lut[line[x]]; } }
+        p += row;
+    }
+    memcpy(p, Meta.constData(), Meta.size());
+
+    return writeFile(path, Buffer, T);
+
+}
+
+bool Recorder::writeFile(const QString &path, const QByteArray &Data, const QElapsedTimer &T) {
+
+    // Shared by runs, clips, snapshots and the encoders
+    static Metric_Counter *mBytes = Metrics::counter("thermo_disk_bytes_total", "Bytes of frame files written");
+    static Metric_Counter *mErrors = Metrics::counter("thermo_disk_errors_total", "Frame files that could not be written");
+    static Metric_Histogram *mWrite = Metrics::histogram("thermo_disk_write_seconds", "Time to encode and write a frame file",
+                                                         Metrics::exponential(0.0005, 2, 12));
+
+    QFile File(path);
+    if (!File.open(QIODevice::WriteOnly) || File.write(Data)!=Data.size()) {
+        qWarning() << "Unable to write" << qPrintable(path);
+        mErrors->add();
+        return false;
+    }
+    mBytes->add(Data.size());
+    mWrite->observe(T.nsecsElapsed()*1e-9);
+    return true;
+
+}
@@ -0,0 +1,146 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QImage>
+#include <QByteArray>
+#include <QFile>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QtNumeric>
+#include <QSettings>
+
+#include "Metrics.h"
+#include "Tracker.h"
+#include "TemperatureBuffer.h"
+#include "EncoderPool.h"
+#include "FrameStage.h"
+
+/* =================================================================== *\
+|    Recorder Class                                                     |
+\* =================================================================== */
+
+// Run directories and image storage, shared by the GUI and the
+// command-line runner. A run is a "Run NN" folder of the day's data
+// directory, holding a copy of the protocol, the parameters of the
+// experiment and the frames:
+//
+//   Frame_<n>.pgm      8-bit binary PGM, followed by the comment lines
+//                      #<setup> <version>
+//                      #Timestamp:<ns>;TempLeft:<°C>;TempRight:<°C>
+//
+//   Frame_<n>.png      with Encoders->Format png or tiff, 8-bit gray
+//   Frame_<n>.tiff     levels and the same metadata in the Description
+//                      text (tEXt chunk, ImageDescription tag)
+//
+// High bit-depth frames are stored at their depth: 16-bit PGM (maxval
+// 2^bits-1, big-endian samples) or 16-bit PNG and TIFF.
+//
+// Frames are written at most Rate per second of camera time; indexed
+// images are stored through their color table. The temperatures are
+// those of the exposure: frames come with their time on the host clock
+// and wait until the samples of Temperatures cover it (at most MaxDelay
+// after the newest frame), then get the interpolated values. The
+// targets are appended to the metadata (TargetLeft, TargetRight).
+//
+// When tracking is enabled, every frame of the run also goes to the
+// tracker, which writes Tracking.tsv in the run folder. With StoreImages
+// off, only the positions are kept.
+//
+// Frames are reduced separately for the files (Storage, Recording/Bin,
+// Recording/BinMode, Recording/Every) and for the tracker (Analysis,
+// Analysis/* keys), before the save rate; the reductions are noted in
+// Parameters.txt.
+//
+// The motion energy of every frame goes to Motion.tsv:
+//
+//   timestamp  left  right  roi
+//
+// mean absolute differences to the previous frame (gray levels per
+// pixel) on each half of the image and in the region of interest.
+
+typedef QList< QPair<QString, QString> > Run_Parameters;
+
+struct Recorder_Frame {
+
+    QImage Img;
+    QImage Raw;             // Sensor levels, stored instead of Img if set
+    qint64 timestamp;       // Camera clock (ns)
+    qint64 time;            // Host clock (ns)
+
+};
+
+class Recorder : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Recorder(QObject *parent = 0);
+
+    void load(const QSettings&);        // Recording/Bin, BinMode, Every; Analysis/*
+
+    static int lastRun(const QString &dataPath);
+    bool createRun(const QString &dataPath, const QString &protocolPath, const Run_Parameters&);
+
+    void start();
+    void stop();
+    bool isRecording() const { return Recording; }
+
+    // Frames wait for the temperatures of their time (host clock, ns);
+    // Raw, the sensor levels of high bit-depth formats, goes to the file
+    void write(const QImage&, qint64 timestamp, qint64 time, const QImage &Raw = QImage());
+    void addTemperatures(const Temperature_Sample&);
+
+    void writeMotion(qint64 timestamp, double left, double right, double roi);
+
+    // Single frame, with its metadata; Buffer is reused between calls
+    static bool writeFrame(const QString &path, const QImage&, const QString &signature,
+                           qint64 timestamp, double TL, double TR, QByteArray &Buffer,
+                           double targetLeft = qQNaN(), double targetRight = qQNaN());
+
+    // "Timestamp:<ns>;TempLeft:<°C>;TempRight:<°C>[;TargetLeft:<°C>;TargetRight:<°C>]"
+    static QString metadata(qint64 timestamp, double TL, double TR, double targetLeft, double targetRight);
+
+    // Whole file in a single write, with the disk metrics (T started with the encoding)
+    static bool writeFile(const QString &path, const QByteArray&, const QElapsedTimer &T);
+
+    QString Signature;      // "<setup> <version>"
+    double Rate;            // Frames per second, 0 for all frames
+    bool StoreImages;
+    Tracker *Track;
+    FrameStage Storage, Analysis;
+    EncoderPool *Encoders;
+    TemperatureBuffer Temperatures;
+    qint64 MaxDelay;        // ns
+    int nRun;
+    QString RunPath;
+    qint64 nFrame;
+
+signals:
+
+    void frameSaved();
+
+private:
+
+    bool Recording;
+    qint64 tLast;
+    QByteArray Buffer;
+    QList<Recorder_Frame> Pending;
+    QFile MotionFile;
+    QTextStream Motion;
+
+    Metric_Counter *mFrames, *mThrottled, *mDecimated;
+    Metric_Gauge *mRecording, *mPending;
+    Metric_Histogram *mWait;
+
+    void release(qint64 time, bool all = false);
+    void save(const Recorder_Frame&, const Temperature_Sample&);
+
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,76 @@
+#include "ReplotScheduler.h"
+#include "Trace.h"
+
+/* === Constructor =================================================== */
+
+ReplotScheduler::ReplotScheduler(QObject *parent) : QObject(parent) {
+
+    Budget = 0.3;
+    MaxInterval = 1000;
+    AvgTime = 0;
+
+    Timer = new QTimer(this);
+    connect(Timer, SIGNAL(timeout()), this, SLOT(refresh()));
+    setRate(25);
+
+}
+
+/* === Settings ====================================================== */
+
+void ReplotScheduler::addPlot(QCustomPlot *Plot) {
+
+    Plots.append(Plot);
+    Dirty.append(false);
+
+}
+
+void ReplotScheduler::setRate(double hz) {
+
+    BaseInterval = 1000/hz;
+    Interval = BaseInterval;
+    Timer->start((int) Interval);
+
+}
+
+/* === New data ====================================================== */
+
+void ReplotScheduler::markDirty() { for (int i=0; i<Dirty.size(); i++) { Dirty[i] = true; } }
+
+/* === Refresh tick ================================================== */
+
+void ReplotScheduler::refresh() {
+
+    if (!Dirty.contains(true)) { return; }
+
+    TRACE_SPAN("replot");
+    QElapsedTimer T;
+    T.start();
+
+    // Last chance for plots to pull their data
+    emit aboutToReplot();
+
+    // Hidden plots (other tab, minimized window) stay dirty until shown
+    int n = 0;
+    for (int i=0; i<Plots.size(); i++) {
+        if (!Dirty[i] || !Plots[i]->isVisible()) { continue; }
+        Plots[i]->replot(QCustomPlot::rpImmediateRefresh);
+        Dirty[i] = false;
+        n++;
+    }
+    if (!n) { return; }
+
+    // --- Replot cost (exponential moving average, ms)
+    AvgTime = 0.8*AvgTime + 0.2*T.nsecsElapsed()/1e6;
+
+    // --- Adapt the refresh period to the budget
+    double I = Interval;
+    if (AvgTime>Budget*Interval) { I = qMin(2*Interval, MaxInterval); }
+    else if (AvgTime<Budget*Interval/4) { I = qMax(Interval/2, BaseInterval); }
+
+    if (I!=Interval) {
+        Interval = I;
+        Timer->setInterval((int) Interval);
+        emit rateChanged(rate());
+    }
+
+}
@@ -0,0 +1,58 @@
+#ifndef REPLOTSCHEDULER_H
+#define REPLOTSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QElapsedTimer>
+
+#include "qcustomplot.h"
+
+/* =================================================================== *\
+|    ReplotScheduler Class                                              |
+\* =================================================================== */
+
+// Decouples plot redraws from sample arrival. Samples only mark the plots
+// dirty; a single refresh tick replots the visible ones. Replot time is
+// measured and the tick backs off when it exceeds its share (Budget) of
+// the refresh period, then recovers when replots get cheap again.
+
+class ReplotScheduler : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    ReplotScheduler(QObject *parent = 0);
+
+    void addPlot(QCustomPlot*);
+    void setRate(double);
+
+    double Budget;          // Fraction of the period allowed for replots
+    double MaxInterval;     // Slowest refresh period (ms)
+
+    double rate() const { return 1000/Interval; }
+    double replotTime() const { return AvgTime; }
+
+public slots:
+
+    void markDirty();
+    void refresh();
+
+signals:
+
+    void aboutToReplot();
+    void rateChanged(double);
+
+private:
+
+    QList<QCustomPlot*> Plots;
+    QTimer *Timer;
+    QList<bool> Dirty;      // Per plot, until it is replotted
+
+    double BaseInterval, Interval;
+    double AvgTime;
+
+};
+
+#endif // REPLOTSCHEDULER_H
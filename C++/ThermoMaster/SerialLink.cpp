@@ -0,0 +1,142 @@
+#include "SerialLink.h"
+#include "Trace.h"
+#include "Metrics.h"
+
+#include <QDebug>
+#include <QThread>
+
+/* === Constructor =================================================== */
+
+SerialLink::SerialLink(QObject *parent) : QObject(parent) {
+
+    Port = new QSerialPort(this);
+    connect(Port, SIGNAL(readyRead()), this, SLOT(read()));
+
+    qRegisterMetaType<Serial_Sample>();
+
+    mSamples = Metrics::counter("thermo_serial_samples_total", "Temperature samples received");
+    mLines = Metrics::counter("thermo_serial_lines_total", "Non-sample lines received");
+    mBytes = Metrics::counter("thermo_serial_bytes_total", "Bytes read from the serial port");
+    mLeft = Metrics::gauge("thermo_temperature_celsius", "Last measured temperature", "zone=\"left\"");
+    mRight = Metrics::gauge("thermo_temperature_celsius", "Last measured temperature", "zone=\"right\"");
+
+}
+
+/* === Connection ==================================================== */
+
+bool SerialLink::open(const QString &port) {
+
+    close();
+
+    // --- Get available ports
+
+    const QList<QSerialPortInfo> infos = QSerialPortInfo::availablePorts();
+    qInfo() << infos.length() << "connections detected";
+
+    // --- Assign port
+
+    for (int i=0; i<infos.length(); i++) {
+
+        // --- Checks
+
+        if (port.isEmpty()) {
+
+            // Skip non-Arduino connections
+            if (infos[i].description().left(7)!="Arduino") { continue; }
+
+        } else if (infos[i].portName()!=port && infos[i].systemLocation()!=port) { continue; }
+
+        // Is device busy ?
+        if (infos[i].isBusy()) {
+            qInfo().nospace() << "[" << infos[i].portName() << "] is busy ...";
+            continue;
+        }
+
+        // --- Open connection
+
+        qInfo() << "Opening" << infos[i].portName();
+
+        Port->setPortName(infos[i].portName());
+        Port->setBaudRate(115200);
+        Port->setDataBits(QSerialPort::Data8);
+        Port->setParity(QSerialPort::NoParity);
+        Port->setStopBits(QSerialPort::OneStop);
+        Port->setFlowControl(QSerialPort::NoFlowControl);
+
+        if (!Port->open(QIODevice::ReadWrite)) {
+            qWarning() << "Failed to open port" << Port->portName();
+            return false;
+        }
+
+        qInfo() << "Init. serial connection";
+
+        PortName = infos[i].portName();
+        RigId = infos[i].serialNumber().isEmpty() ? infos[i].portName() : infos[i].serialNumber();
+        Lines.clear();
+        return true;
+
+    }
+
+    if (!port.isEmpty()) { qWarning() << "Serial port" << qPrintable(port) << "not found"; }
+    return false;
+
+}
+
+void SerialLink::close() {
+
+    if (Port->isOpen()) { Port->close(); }
+
+}
+
+/* === Commands ====================================================== */
+
+void SerialLink::send(QString cmd) {
+
+    if (!Port->isOpen()) { return; }
+
+    Port->write(cmd.append("\n").toLatin1());
+    Port->flush();
+    QThread::msleep(5);
+
+}
+
+void SerialLink::flush(int msecs) {
+
+    if (Port->isOpen() && Port->bytesToWrite()) { Port->waitForBytesWritten(msecs); }
+
+}
+
+/* === Responses ===================================================== */
+
+void SerialLink::read() {
+
+    TRACE_SPAN("readSerial");
+
+    // Partial lines are kept for the next chunk
+    QByteArray Chunk = Port->readAll();
+    qint64 host = Trace::now();
+    mBytes->add(Chunk.size());
+    qint64 discarded = Lines.nDiscarded;
+    Lines.append(Chunk);
+    if (Lines.nDiscarded>discarded) { qWarning() << "Serial line longer than" << Lines.MaxLine << "bytes discarded"; }
+
+    const char *begin, *end;
+    while (Lines.next(begin, end)) {
+
+        if (begin==end) { continue; }
+
+        Serial_Sample S;
+        if (parseData(begin, end, S)) {
+            S.host = host;
+            mSamples->add();
+            mLeft->set(S.TL);
+            mRight->set(S.TR);
+            emit sample(S);
+        } else {
+            mLines->add();
+            emit line(QByteArray(begin, end-begin));
+        }
+
+    }
+
+}
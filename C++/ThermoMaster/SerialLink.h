@@ -0,0 +1,62 @@
+#ifndef SERIALLINK_H
+#define SERIALLINK_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QSerialPort>
+#include <QSerialPortInfo>
+
+#include "SerialParser.h"
+#include "Metrics.h"
+
+/* =================================================================== *\
+|    SerialLink Class                                                   |
+\* =================================================================== */
+
+// Connection to the regulation board, shared by the GUI and the
+// command-line runner. Commands are newline-terminated; incoming lines
+// are split and parsed in place, temperature samples are emitted as
+// such and any other line is forwarded as text.
+
+class SerialLink : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    SerialLink(QObject *parent = 0);
+
+    // Opens the given port, or the first free Arduino if empty
+    bool open(const QString &port = QString());
+    void close();
+    bool isOpen() const { return Port->isOpen(); }
+
+    void send(QString);
+    void flush(int msecs = 500);        // Waits until the commands are written
+
+    QString PortName;
+    QString RigId;          // Board serial number, or port name
+
+signals:
+
+    void sample(Serial_Sample);
+    void line(QByteArray);
+
+private slots:
+
+    void read();
+
+private:
+
+    QSerialPort *Port;
+    Line_Splitter Lines;
+
+    Metric_Counter *mSamples, *mLines, *mBytes;
+    Metric_Gauge *mLeft, *mRight;
+
+};
+
+Q_DECLARE_METATYPE(Serial_Sample)
+
+#endif // SERIALLINK_H
@@ -0,0 +1,170 @@
+#include "SerialParser.h"
+
+/* =================================================================== *\
+|    Number parsing                                                     |
+\* =================================================================== */
+
+static const double Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isSep(char c) { return c==' ' || c=='\t' || c==',' || c=='\r' || c=='\n'; }
+static inline bool isDigit(char c) { return c>='0' && c<='9'; }
+
+// Decimal numbers as printed by the firmware and by MATLAB's dlmwrite.
+// Returns a pointer past the number, or 0 if no number starts at p.
+static const char* parseNumber(const char *p, const char *end, double &v) {
+
+    bool neg = false;
+    if (p<end && (*p=='-' || *p=='+')) { neg = *p=='-'; p++; }
+
+    unsigned long long m = 0;
+    int digits = 0, scale = 0;
+    const char *start = p;
+
+    // --- Integer part
+    for (; p<end && isDigit(*p); p++) {
+        if (digits<18) { m = m*10 + (*p-'0'); if (m) { digits++; } }
+        else { scale++; }
+    }
+
+    // --- Fractional part
+    if (p<end && *p=='.') {
+        for (p++; p<end && isDigit(*p); p++) {
+            if (digits<18) { m = m*10 + (*p-'0'); scale--; if (m) { digits++; } }
+        }
+    }
+
+    if (p==start || (p==start+1 && *start=='.')) { return 0; }
+
+    // --- Exponent
+    if (p<end && (*p=='e' || *p=='E')) {
+        const char *q = p+1;
+        bool eneg = false;
+        if (q<end && (*q=='-' || *q=='+')) { eneg = *q=='-'; q++; }
+        if (q<end && isDigit(*q)) {
+            int e = 0;
+            for (; q<end && isDigit(*q); q++) { if (e<1000) { e = e*10 + (*q-'0'); } }
+            scale += eneg ? -e : e;
+            p = q;
+        }
+    }
+
+    // --- Scale
+    double d = (double) m;
+    while (scale>22) { d *= 1e22; scale -= 22; }
+    while (scale<-22) { d /= 1e22; scale += 22; }
+    d = scale>=0 ? d*Pow10[scale] : d/Pow10[-scale];
+
+    v = neg ? -d : d;
+    return p;
+
+}
+
+/* =================================================================== *\
+|    Line parsing                                                       |
+\* =================================================================== */
+
+int parseColumns(const char *p, const char *end, double *values, int max) {
+
+    // Skip an alphabetic prefix ("Data", ...)
+    while (p<end && ((*p>='A' && *p<='Z') || (*p>='a' && *p<='z'))) { p++; }
+
+    int n = 0;
+    while (true) {
+
+        while (p<end && isSep(*p)) { p++; }
+        if (p>=end) { break; }
+        if (n>=max) { return -1; }
+
+        p = parseNumber(p, end, values[n]);
+        if (!p || (p<end && !isSep(*p))) { return -1; }
+        n++;
+
+    }
+
+    return n;
+
+}
+
+bool parseData(const char *begin, const char *end, Serial_Sample &S) {
+
+    if (end-begin<5 || begin[0]!='D' || begin[1]!='a' || begin[2]!='t' || begin[3]!='a') { return false; }
+
+    double v[SERIAL_MAX_COLUMNS];
+    int n = parseColumns(begin+4, end, v, SERIAL_MAX_COLUMNS);
+    if (n<3) { return false; }
+
+    S.t = v[0];
+    S.TL = v[1];
+    S.TR = v[2];
+    S.tuning = n>=4;
+    S.relay = S.tuning ? (v[3]>0) - (v[3]<0) : 0;
+    S.host = 0;
+    return true;
+
+}
+
+/* =================================================================== *\
+|    Line_Splitter Class                                                |
+\* =================================================================== */
+
+Line_Splitter::Line_Splitter() {
+
+    MaxLine = 4096;
+    nDiscarded = 0;
+    Pos = 0;
+    Skipping = false;
+
+}
+
+void Line_Splitter::append(const QByteArray &Chunk) {
+
+    // Drop consumed lines before growing
+    if (Pos) {
+        Buffer.remove(0, Pos);
+        Pos = 0;
+    }
+
+    // Rest of an overlong line
+    int from = 0;
+    if (Skipping) {
+        int nl = Chunk.indexOf('\n');
+        if (nl<0) { return; }
+        from = nl+1;
+        Skipping = false;
+    }
+    Buffer.append(Chunk.constData()+from, Chunk.size()-from);
+
+    // Partial line beyond the bound
+    int last = Buffer.lastIndexOf('\n');
+    if (Buffer.size()-(last+1)>MaxLine) {
+        Buffer.truncate(last+1);
+        Skipping = true;
+        nDiscarded++;
+    }
+
+}
+
+bool Line_Splitter::next(const char *&begin, const char *&end) {
+
+    int nl = Buffer.indexOf('\n', Pos);
+    if (nl<0) { return false; }
+
+    begin = Buffer.constData() + Pos;
+    end = Buffer.constData() + nl;
+    if (end>begin && end[-1]=='\r') { end--; }
+
+    Pos = nl+1;
+    return true;
+
+}
+
+void Line_Splitter::clear() {
+
+    Buffer.clear();
+    Pos = 0;
+    Skipping = false;
+
+}
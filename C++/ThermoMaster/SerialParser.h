@@ -0,0 +1,66 @@
+#ifndef SERIALPARSER_H
+#define SERIALPARSER_H
+
+#include <QByteArray>
+
+/* =================================================================== *\
+|    Serial line parsing                                                |
+\* =================================================================== */
+
+// Shared by the GUI and the calibration tool. Lines are parsed in place,
+// without building intermediate string lists.
+
+const int SERIAL_MAX_COLUMNS = 16;
+
+// Temperature sample sent by the firmware: "Data <t> <TL> <TR> [<relay>]",
+// the relay state being sent during the autotuning only
+struct Serial_Sample {
+
+    double t;           // Board time (µs)
+    double TL;          // Left temperature (°C)
+    double TR;          // Right temperature (°C)
+    int relay;          // Relay of the zone under autotuning (-1, 0, 1)
+    bool tuning;        // relay was sent
+    qint64 host;        // Host clock at reception (ns), set by the link
+
+};
+
+// Parses up to max numbers separated by spaces, tabs or commas, after an
+// optional alphabetic prefix. Returns the number of values read, or -1 if
+// the line contains anything else.
+int parseColumns(const char *begin, const char *end, double *values, int max);
+
+// Parses a "Data" line. Returns false for any other line.
+bool parseData(const char *begin, const char *end, Serial_Sample &S);
+
+/* =================================================================== *\
+|    Line_Splitter Class                                                |
+\* =================================================================== */
+
+// Accumulates raw serial chunks and hands out complete lines, keeping
+// partial lines for the next chunk. A partial line longer than MaxLine
+// (a device that sends no newline) is discarded, as is the rest of it up
+// to the next newline, where the splitter resyncs.
+
+class Line_Splitter {
+
+public:
+
+    Line_Splitter();
+
+    void append(const QByteArray&);
+    bool next(const char *&begin, const char *&end);
+    void clear();
+
+    int MaxLine;            // bytes
+    qint64 nDiscarded;      // Overlong lines dropped
+
+private:
+
+    QByteArray Buffer;
+    int Pos;
+    bool Skipping;          // Until the next newline
+
+};
+
+#endif // SERIALPARSER_H
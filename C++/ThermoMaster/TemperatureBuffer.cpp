@@ -0,0 +1,89 @@
+#include "TemperatureBuffer.h"
+
+#include <QtNumeric>
+
+/* === Constructor =================================================== */
+
+TemperatureBuffer::TemperatureBuffer(int capacity) : Ring(qMax(2, capacity)) { clear(); }
+
+void TemperatureBuffer::clear() {
+
+    Start = 0;
+    Count = 0;
+    Cursor = 0;
+    nAppended = 0;
+
+}
+
+/* === Samples ======================================================= */
+
+void TemperatureBuffer::append(const Temperature_Sample &S) {
+
+    if (Count && S.t<=lastTime()) { return; }
+
+    if (Count<Ring.size()) { Ring[(Start+Count++) % Ring.size()] = S; }
+    else {
+        Ring[Start] = S;
+        Start = (Start+1) % Ring.size();
+    }
+    nAppended++;
+
+}
+
+/* === Queries ======================================================= */
+
+// Between samples i and i+1, or clamped to the ends
+bool TemperatureBuffer::interpolate(int i, qint64 t, Temperature_Sample &S) const {
+
+    if (!Count) {
+        S.t = t;
+        S.TL = S.TR = S.targetLeft = S.targetRight = qQNaN();
+        return false;
+    }
+    if (i<0) { S = sample(0); S.t = t; return false; }
+    if (i>=Count-1) {
+        S = sample(Count-1);
+        bool exact = S.t==t;
+        S.t = t;
+        return exact;
+    }
+
+    const Temperature_Sample &A = sample(i), &B = sample(i+1);
+    double u = (double) (t-A.t)/(B.t-A.t);
+    S.t = t;
+    S.TL = A.TL + u*(B.TL-A.TL);
+    S.TR = A.TR + u*(B.TR-A.TR);
+    S.targetLeft = A.targetLeft + u*(B.targetLeft-A.targetLeft);
+    S.targetRight = A.targetRight + u*(B.targetRight-A.targetRight);
+    return true;
+
+}
+
+bool TemperatureBuffer::at(qint64 t, Temperature_Sample &S) const {
+
+    if (!Count) { return interpolate(-1, t, S); }
+
+    // Last sample at or before t
+    int lo = 0, hi = Count;
+    while (lo<hi) {
+        int mid = (lo+hi)/2;
+        if (sample(mid).t<=t) { lo = mid+1; } else { hi = mid; }
+    }
+    return interpolate(lo-1, t, S);
+
+}
+
+bool TemperatureBuffer::next(qint64 t, Temperature_Sample &S) {
+
+    if (!Count) { return interpolate(-1, t, S); }
+
+    // The cursor counts appended samples, so that it survives the ring
+    qint64 first = nAppended-Count;
+    int i = (int) (qMax(Cursor, first) - first);
+    if (i>0 && sample(i).t>t) { return at(t, S); }
+
+    while (i<Count && sample(i).t<=t) { i++; }
+    Cursor = first + qMax(0, i-1);
+    return interpolate(i-1, t, S);
+
+}
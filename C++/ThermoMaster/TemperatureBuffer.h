@@ -0,0 +1,60 @@
+#ifndef TEMPERATUREBUFFER_H
+#define TEMPERATUREBUFFER_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/* =================================================================== *\
+|    TemperatureBuffer Class                                            |
+\* =================================================================== */
+
+// Recent temperatures and targets, indexed by time on the host clock, so
+// that frames get the temperatures of their own exposure rather than
+// those of the last sample received. Values between two samples are
+// interpolated linearly.
+//
+// Samples are kept in a ring of fixed capacity, in increasing time. at()
+// is a binary search (O(log n)); next() keeps a cursor for increasing
+// query times, which makes a sequence of queries amortized O(1). Both
+// return false when t is outside the samples, with the values of the
+// closest one (NaN when there is none).
+
+struct Temperature_Sample {
+
+    qint64 t;               // Host clock (ns)
+    double TL, TR;          // °C
+    double targetLeft;      // °C, 0 without regulation
+    double targetRight;
+
+};
+
+class TemperatureBuffer {
+
+public:
+
+    TemperatureBuffer(int capacity = 4096);
+
+    void clear();
+    void append(const Temperature_Sample&);     // Older samples are ignored
+
+    bool at(qint64 t, Temperature_Sample&) const;
+    bool next(qint64 t, Temperature_Sample&);
+
+    bool isEmpty() const { return Count==0; }
+    int size() const { return Count; }
+    qint64 firstTime() const { return Count ? sample(0).t : -1; }
+    qint64 lastTime() const { return Count ? sample(Count-1).t : -1; }
+
+private:
+
+    QVector<Temperature_Sample> Ring;
+    int Start, Count;
+    qint64 Cursor;          // Index of the last next(), in appended samples
+    qint64 nAppended;
+
+    const Temperature_Sample &sample(int i) const { return Ring[(Start+i) % Ring.size()]; }
+    bool interpolate(int i, qint64 t, Temperature_Sample&) const;
+
+};
+
+#endif // TEMPERATUREBUFFER_H
@@ -0,0 +1,36 @@
+# === ThermoMaster core ======================================================
+#
+# Sources shared by the GUI and the command-line tools. They only depend on
+# QtCore (and QtSerialPort for the serial link).
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/MsgHandler.cpp \
+    $$PWD/LogSink.cpp \
+    $$PWD/LogReader.cpp \
+    $$PWD/Protocol.cpp \
+    $$PWD/ProtocolSim.cpp \
+    $$PWD/PlantModel.cpp \
+    $$PWD/SerialParser.cpp \
+    $$PWD/FrameKernels.cpp \
+    $$PWD/Trace.cpp \
+    $$PWD/Metrics.cpp \
+    $$PWD/ClockSync.cpp \
+    $$PWD/TemperatureBuffer.cpp
+
+HEADERS += \
+    $$PWD/MsgHandler.h \
+    $$PWD/LogSink.h \
+    $$PWD/LogReader.h \
+    $$PWD/Protocol.h \
+    $$PWD/ProtocolSim.h \
+    $$PWD/PlantModel.h \
+    $$PWD/MsgQueue.h \
+    $$PWD/SerialParser.h \
+    $$PWD/FrameKernels.h \
+    $$PWD/Trace.h \
+    $$PWD/Metrics.h \
+    $$PWD/ClockSync.h \
+    $$PWD/TemperatureBuffer.h
@@ -15,23 +15,23 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
     mainwindow.cpp \
-    MsgHandler.cpp \
-    Camera_FLIR.cpp \
-    qcustomplot.cpp
+    qcustomplot.cpp \
+    Autotune.cpp \
+    TimeSeries.cpp \
+    ReplotScheduler.cpp \
+    MinMaxPyramid.cpp
 
 HEADERS  += mainwindow.h \
-    MsgHandler.h \
-    Camera_FLIR.h \
-    qcustomplot.h
+    qcustomplot.h \
+    Autotune.h \
+    TimeSeries.h \
+    ReplotScheduler.h \
+    MinMaxPyramid.h
 
 FORMS    += mainwindow.ui
 
+include(ThermoRig.pri)
+
 DISTFILES += \
     output.css \
     Settings.conf
-
-# === Platform-specific libraries ==========================================
-
-# --- LINUX
-unix:!macx: LIBS += -L/usr/local/Spinnaker/lib -lSpinnaker
-unix:!macx: INCLUDEPATH += /usr/include/spinnaker
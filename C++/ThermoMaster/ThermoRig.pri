@@ -0,0 +1,44 @@
+# === ThermoMaster rig =======================================================
+#
+# Acquisition, serial link, recording, the metrics endpoint and the frame
+# stream, shared by the GUI and the headless runner. Frames are handled as
+# QImage, so that QtGui is needed but no display. The sensor levels of the
+# high bit-depth formats are kept in Grayscale16 images, which need Qt 5.13.
+
+lessThan(QT_MAJOR_VERSION, 6):lessThan(QT_MINOR_VERSION, 13): error("ThermoMaster needs Qt 5.13 or later (QImage::Format_Grayscale16)")
+
+QT += gui serialport network
+
+include(ThermoCore.pri)
+
+SOURCES += \
+    $$PWD/SerialLink.cpp \
+    $$PWD/Recorder.cpp \
+    $$PWD/EncoderPool.cpp \
+    $$PWD/FrameStage.cpp \
+    $$PWD/Tracker.cpp \
+    $$PWD/ClipRecorder.cpp \
+    $$PWD/Camera_FLIR.cpp \
+    $$PWD/MetricsServer.cpp \
+    $$PWD/FrameStream.cpp
+
+HEADERS += \
+    $$PWD/SerialLink.h \
+    $$PWD/Recorder.h \
+    $$PWD/EncoderPool.h \
+    $$PWD/FrameStage.h \
+    $$PWD/Tracker.h \
+    $$PWD/ClipRecorder.h \
+    $$PWD/Camera_FLIR.h \
+    $$PWD/MetricsServer.h \
+    $$PWD/FrameStream.h \
+    $$PWD/ThermoStream.h
+
+# === Platform-specific libraries ==========================================
+
+# --- LINUX
+unix:!macx: LIBS += -L/usr/local/Spinnaker/lib -lSpinnaker
+unix:!macx: INCLUDEPATH += /usr/include/spinnaker
+
+# Shared memory (shm_open), for the frame stream
+unix:!macx: LIBS += -lrt
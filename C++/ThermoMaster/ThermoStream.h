@@ -0,0 +1,110 @@
+#ifndef THERMOSTREAM_H
+#define THERMOSTREAM_H
+
+/* =================================================================== *\
+|    ThermoStream shared-memory layout                                  |
+\* =================================================================== */
+
+/*
+ * Frames published by the acquisition, for external analysis processes.
+ * Plain C, so that it can be included from C, C++ or MEX files; the
+ * Python reader (Python/thermostream.py) mirrors this layout.
+ *
+ * The POSIX shared-memory object (/dev/shm/<name>) holds a header
+ * followed by Slots slots of SlotSize bytes, each made of a slot header
+ * and the pixels (8-bit, Stride bytes per row):
+ *
+ *   [ ThermoStream_Header | Slot 0 | Slot 1 | ... ]
+ *
+ * Frame n goes to slot n % Slots. The writer never waits for readers:
+ * a slot is protected by a sequence number, odd while the slot is being
+ * written and equal to 2(n+1) once frame n is complete. A reader takes
+ * the sequence, reads the frame (in place, without copy) and checks the
+ * sequence again; if it changed, the frame has been overwritten and must
+ * be dropped. Readers that fall behind skip frames, they never stall the
+ * acquisition.
+ *
+ *   int fd = shm_open("/thermomaster", O_RDONLY, 0);
+ *   ThermoStream_Header *H = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+ *   uint64_t n = thermostream_latest(H);
+ *   const ThermoStream_Slot *S = thermostream_slot(H, n);
+ *   uint64_t seq = thermostream_begin(S, n);
+ *   ... use S->Width, S->Height, thermostream_pixels(S) ...
+ *   if (!thermostream_valid(S, seq)) { ... overwritten, drop ... }
+ *
+ * The geometry may change from one frame to the next (e.g. a smaller
+ * ROI): readers take Width, Height and Stride from each slot. Only when
+ * a frame needs more than Capacity bytes does the writer create a new
+ * object: the old one is marked closed (State 0) and readers should
+ * attach again.
+ */
+
+#include <stdint.h>
+
+#define THERMOSTREAM_MAGIC      0x4D524854u     /* "THRM" */
+#define THERMOSTREAM_VERSION    1
+#define THERMOSTREAM_NAME       "/thermomaster"
+
+typedef struct {
+
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t HeaderSize;        /* Offset of slot 0 */
+    uint32_t Slots;
+    uint64_t SlotSize;          /* Slot header and pixels */
+    uint64_t Capacity;          /* Pixel bytes per slot */
+    uint32_t State;             /* 1 while the writer publishes, 0 once closed */
+    int32_t  WriterPid;
+    uint64_t Published;         /* Frames published; the latest is Published-1 */
+    char     Setup[64];         /* "<setup> <version>", NUL-terminated */
+
+} ThermoStream_Header;
+
+typedef struct {
+
+    uint64_t Sequence;          /* Odd while written, 2(n+1) once frame n is complete */
+    uint64_t Frame;             /* Index n in the stream */
+    int64_t  Timestamp;         /* Camera clock (ns) */
+    int64_t  FrameId;           /* Camera frame counter */
+    uint32_t Width, Height;
+    uint32_t Stride;            /* Bytes per row */
+    uint32_t Format;            /* 1: 8-bit gray levels, see below */
+    double   TempLeft;          /* Last temperatures (°C) */
+    double   TempRight;
+    double   Mean;              /* Mean gray level */
+    uint8_t  Reserved[56];      /* Up to 128 bytes, keeping the pixels aligned */
+
+} ThermoStream_Slot;
+
+/* Gray levels are the sensor levels for Mono8; frames of the high
+ * bit-depth formats (Mono10, Mono12, Mono16) are published as display
+ * levels, mapped on 0-255 through the display window (Camera/Window). */
+#define THERMOSTREAM_GRAY8      1
+
+/* === Reader helpers ================================================ */
+
+static inline uint64_t thermostream_latest(const ThermoStream_Header *H) {
+    return __atomic_load_n(&H->Published, __ATOMIC_ACQUIRE) - 1;
+}
+
+static inline const ThermoStream_Slot* thermostream_slot(const ThermoStream_Header *H, uint64_t n) {
+    return (const ThermoStream_Slot*) ((const char*) H + H->HeaderSize + (n % H->Slots)*H->SlotSize);
+}
+
+static inline const uint8_t* thermostream_pixels(const ThermoStream_Slot *S) {
+    return (const uint8_t*) (S + 1);
+}
+
+/* Sequence to check against once the frame is used, 0 if frame n is
+   not (or no longer) in its slot */
+static inline uint64_t thermostream_begin(const ThermoStream_Slot *S, uint64_t n) {
+    uint64_t seq = __atomic_load_n(&S->Sequence, __ATOMIC_ACQUIRE);
+    return seq==2*(n+1) ? seq : 0;
+}
+
+static inline int thermostream_valid(const ThermoStream_Slot *S, uint64_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return seq && __atomic_load_n(&S->Sequence, __ATOMIC_RELAXED)==seq;
+}
+
+#endif /* THERMOSTREAM_H */
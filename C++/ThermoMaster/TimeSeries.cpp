@@ -0,0 +1,104 @@
+#include "TimeSeries.h"
+
+/* === Constructor =================================================== */
+
+TimeSeries::TimeSeries(int samples) {
+
+    Head = 0;
+    Count = 0;
+    Mask = 0;
+    MaxCount = 0;
+    Span = 0;
+    setWindow(samples);
+
+}
+
+/* === Window ======================================================== */
+
+void TimeSeries::setWindow(int samples, double span) {
+
+    samples = qMax(samples, 2);
+
+    // Power-of-two capacity, so that indices wrap with a mask
+    int capacity = 1;
+    while (capacity<samples) { capacity <<= 1; }
+
+    // Keep the most recent samples
+    int n = qMin(Count, samples);
+    QVector<double> K(capacity), V(capacity);
+    for (int i=0; i<n; i++) {
+        K[i] = key(Count-n+i);
+        V[i] = value(Count-n+i);
+    }
+
+    Keys = K;
+    Values = V;
+    Head = 0;
+    Count = n;
+    Mask = capacity-1;
+    MaxCount = samples;
+    Span = span;
+
+    if (Container && Count) { Container->removeBefore(firstKey()); }
+
+}
+
+/* === Plot container ================================================ */
+
+void TimeSeries::attach(QSharedPointer<QCPGraphDataContainer> C) {
+
+    Container = C;
+    Container->clear();
+    for (int i=0; i<Count; i++) { Container->add(QCPGraphData(key(i), value(i))); }
+
+}
+
+/* === Append ======================================================== */
+
+void TimeSeries::append(double k, double v) {
+
+    // The board clock wraps around (micros() overflows every ~71 min)
+    if (Count && k<lastKey()) { clear(); }
+
+    bool expired = false;
+
+    if (Count==MaxCount) {
+        Head = (Head+1) & Mask;
+        Count--;
+        expired = true;
+    }
+
+    int i = (Head+Count) & Mask;
+    Keys[i] = k;
+    Values[i] = v;
+    Count++;
+
+    if (Span>0) {
+        while (Count>1 && firstKey()<k-Span) {
+            Head = (Head+1) & Mask;
+            Count--;
+            expired = true;
+        }
+    }
+
+    // --- Incremental plot update
+    if (Container) {
+        Container->add(QCPGraphData(k, v));
+        if (expired) { Container->removeBefore(firstKey()); }
+    }
+
+}
+
+/* === Clear ========================================================= */
+
+void TimeSeries::clear() {
+
+    Head = 0;
+    Count = 0;
+    if (Container) { Container->clear(); }
+
+}
+
+/* === Last value ==================================================== */
+
+double TimeSeries::last() const { return Count ? value(Count-1) : qQNaN(); }
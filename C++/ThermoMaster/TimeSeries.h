@@ -0,0 +1,50 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <QVector>
+#include <QSharedPointer>
+
+#include "qcustomplot.h"
+
+/* =================================================================== *\
+|    TimeSeries Class                                                   |
+\* =================================================================== */
+
+// Fixed-capacity ring buffer of (key, value) samples. Appending and
+// expiring are O(1); an attached QCustomPlot data container is kept in
+// sync incrementally instead of being rebuilt with setData.
+//
+// The window is bounded in samples and, optionally, in key span (s).
+
+class TimeSeries {
+
+public:
+
+    TimeSeries(int samples = 200);
+
+    void setWindow(int samples, double span = 0);
+    void attach(QSharedPointer<QCPGraphDataContainer>);
+
+    void append(double key, double value);
+    void clear();
+
+    int count() const { return Count; }
+    bool isEmpty() const { return !Count; }
+    double key(int i) const { return Keys[(Head+i) & Mask]; }
+    double value(int i) const { return Values[(Head+i) & Mask]; }
+    double firstKey() const { return key(0); }
+    double lastKey() const { return key(Count-1); }
+    double last() const;
+
+private:
+
+    QVector<double> Keys, Values;
+    int Head, Count, Mask;
+    int MaxCount;
+    double Span;
+
+    QSharedPointer<QCPGraphDataContainer> Container;
+
+};
+
+#endif // TIMESERIES_H
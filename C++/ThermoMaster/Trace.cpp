@@ -0,0 +1,258 @@
+#include "Trace.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QCoreApplication>
+
+/* === Thread buffers ================================================ */
+
+// Written by the owning thread only; the exporter follows the chunks and
+// reads up to the published count of each.
+
+static const int TRACE_CHUNK = 4096;
+
+struct Trace_Chunk {
+
+    Trace_Event Events[TRACE_CHUNK];
+    std::atomic<int> Count;
+    std::atomic<Trace_Chunk*> Next;
+
+    Trace_Chunk() : Count(0), Next(0) {}
+
+};
+
+struct Trace_Thread {
+
+    int tid;
+    QString Name;
+    std::atomic<Trace_Chunk*> Head;
+    Trace_Chunk *Tail;
+    qint64 Total;
+    std::atomic<qint64> Dropped;
+    std::atomic<int> Generation;        // Trace the chunks belong to
+
+    Trace_Thread() : tid(0), Head(new Trace_Chunk), Total(0), Dropped(0), Generation(0) { Tail = Head.load(); }
+
+};
+
+// Threads are kept for the whole process, they may end before export.
+// Each start() is a new generation: the owner thread replaces its chunks
+// with an empty chain at its next event and retires the old one, which
+// the next start() frees (start() and write() are called from the same
+// thread, so that no export is reading it by then).
+static QMutex Registry;
+static QVector<Trace_Thread*> Threads;
+static QVector<Trace_Chunk*> Retired;
+static std::atomic<int> Current(0);          // Generation of the trace
+static thread_local Trace_Thread *Local = 0;
+
+static QElapsedTimer &traceClock() {
+
+    static QElapsedTimer C = []() { QElapsedTimer T; T.start(); return T; }();
+    return C;
+
+}
+
+static std::atomic<qint64> Origin(0);
+
+static Trace_Thread* local() {
+
+    if (!Local) {
+        Local = new Trace_Thread;
+        Local->Generation.store(Current.load(std::memory_order_acquire), std::memory_order_relaxed);
+        QMutexLocker Lock(&Registry);
+        Local->tid = Threads.size()+1;
+        Threads.append(Local);
+    }
+    return Local;
+
+}
+
+static void recycle(Trace_Thread *T, int generation) {
+
+    Trace_Chunk *Old = T->Head.load(std::memory_order_relaxed);
+    Trace_Chunk *C = new Trace_Chunk;
+
+    T->Tail = C;
+    T->Total = 0;
+    T->Dropped.store(0, std::memory_order_relaxed);
+    T->Head.store(C, std::memory_order_release);
+    T->Generation.store(generation, std::memory_order_release);
+
+    QMutexLocker Lock(&Registry);
+    Retired.append(Old);
+
+}
+
+/* === Control ======================================================= */
+
+std::atomic<bool> Trace::Enabled(false);
+qint64 Trace::MaxEvents = 1 << 22;
+
+void Trace::start() {
+
+    // Chains retired since the previous start
+    {
+        QMutexLocker Lock(&Registry);
+        foreach (Trace_Chunk *C, Retired) {
+            while (C) {
+                Trace_Chunk *N = C->Next.load(std::memory_order_acquire);
+                delete C;
+                C = N;
+            }
+        }
+        Retired.clear();
+    }
+
+    Origin.store(now());
+    Current.fetch_add(1, std::memory_order_release);
+    Enabled.store(true);
+
+}
+
+void Trace::stop() { Enabled.store(false); }
+
+qint64 Trace::now() { return traceClock().nsecsElapsed(); }
+
+void Trace::setThreadName(const QString &name) {
+
+    Trace_Thread *T = local();
+    QMutexLocker Lock(&Registry);
+    T->Name = name;
+
+}
+
+/* === Recording ===================================================== */
+
+void Trace::record(const char *name, qint64 begin, qint64 end) {
+
+    Trace_Thread *T = local();
+
+    // First event of a new trace: the budget starts over
+    int g = Current.load(std::memory_order_acquire);
+    if (T->Generation.load(std::memory_order_relaxed)!=g) { recycle(T, g); }
+
+    if (T->Total>=MaxEvents) {
+        T->Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Trace_Chunk *C = T->Tail;
+    int n = C->Count.load(std::memory_order_relaxed);
+    if (n==TRACE_CHUNK) {
+        Trace_Chunk *N = new Trace_Chunk;
+        C->Next.store(N, std::memory_order_release);
+        T->Tail = C = N;
+        n = 0;
+    }
+
+    Trace_Event &E = C->Events[n];
+    E.name = name;
+    E.begin = begin;
+    E.end = end;
+    C->Count.store(n+1, std::memory_order_release);
+    T->Total++;
+
+}
+
+void Trace::instant(const char *name) {
+
+    if (!isEnabled()) { return; }
+    record(name, now(), -1);
+
+}
+
+/* === Export ======================================================== */
+
+static void escape(QByteArray &B, const QString &s) {
+
+    for (int i=0; i<s.size(); i++) {
+        QChar c = s[i];
+        if (c=='"' || c=='\\') { B += '\\'; }
+        if (c.unicode()<0x20) { B += ' '; continue; }
+        B += QString(c).toUtf8();
+    }
+
+}
+
+qint64 Trace::write(const QString &path) {
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile File(path);
+    if (!File.open(QIODevice::WriteOnly)) { return -1; }
+
+    QVector<Trace_Thread*> List;
+    QVector<QString> Names;
+    {
+        QMutexLocker Lock(&Registry);
+        List = Threads;
+        for (int i=0; i<List.size(); i++) { Names.append(List[i]->Name); }
+    }
+
+    qint64 origin = Origin.load();
+    qint64 pid = QCoreApplication::applicationPid();
+    qint64 n = 0;
+    qint64 dropped = 0;
+
+    QByteArray B;
+    B.reserve(1 << 20);
+    B += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    for (int i=0; i<List.size(); i++) {
+
+        // --- Thread name
+        B += QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":\"").arg(pid).arg(List[i]->tid).toUtf8();
+        escape(B, Names[i].isEmpty() ? QString("Thread %1").arg(List[i]->tid) : Names[i]);
+        B += "\"}},\n";
+
+        // --- Events, in µs
+        for (Trace_Chunk *C = List[i]->Head.load(std::memory_order_acquire); C; C = C->Next.load(std::memory_order_acquire)) {
+
+            int m = C->Count.load(std::memory_order_acquire);
+            for (int k=0; k<m; k++) {
+
+                const Trace_Event &E = C->Events[k];
+                if (E.begin<origin) { continue; }
+
+                B += "{\"name\":\"";
+                B += E.name;
+                if (E.end<0) {
+                    B += "\",\"ph\":\"i\",\"s\":\"t\"";
+                } else {
+                    B += "\",\"ph\":\"X\",\"dur\":";
+                    B += QByteArray::number((E.end-E.begin)/1e3, 'f', 3);
+                }
+                B += ",\"ts\":";
+                B += QByteArray::number((E.begin-origin)/1e3, 'f', 3);
+                B += ",\"pid\":";
+                B += QByteArray::number(pid);
+                B += ",\"tid\":";
+                B += QByteArray::number(List[i]->tid);
+                B += "},\n";
+                n++;
+
+                if (B.size()>(1 << 20)) {
+                    File.write(B);
+                    B.clear();
+                }
+            }
+        }
+
+        // Threads silent since start() still count the drops of the previous trace
+        if (List[i]->Generation.load(std::memory_order_acquire)==Current.load()) {
+            dropped += List[i]->Dropped.load(std::memory_order_relaxed);
+        }
+
+    }
+
+    // Closing record, also carries the drop count
+    B += QString("{\"name\":\"trace_dropped\",\"ph\":\"M\",\"pid\":%1,\"tid\":0,\"args\":{\"events\":%2}}\n]}\n").arg(pid).arg(dropped).toUtf8();
+    File.write(B);
+
+    return n;
+
+}
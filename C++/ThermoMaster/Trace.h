@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+/* =================================================================== *\
+|    Trace                                                              |
+\* =================================================================== */
+
+// Span tracing, compiled in and switched at runtime. Each thread records
+// into its own buffer (chunks of events published with release stores),
+// so that recording takes no lock and is a single relaxed load when
+// tracing is off. Buffers are read while threads keep recording.
+//
+// The export is a Chrome trace-event JSON file, for chrome://tracing or
+// Perfetto: one complete ("X") event per span and instant ("i") events
+// for markers, with thread names as metadata.
+//
+//   TRACE_SPAN("grab");            // until the end of the scope
+//   Trace::instant("protocol:start");
+//
+// Names must be string literals (only the pointer is kept). Define
+// TRACE_DISABLED to compile the spans out. start() and write() are
+// called from the same thread.
+
+struct Trace_Event {
+
+    const char *name;
+    qint64 begin;           // ns since the trace clock origin
+    qint64 end;             // -1 for instants
+
+};
+
+class Trace {
+
+public:
+
+    static void start();
+    static void stop();
+    static bool isEnabled() { return Enabled.load(std::memory_order_relaxed); }
+
+    static qint64 now();
+    static void record(const char *name, qint64 begin, qint64 end);
+    static void instant(const char *name);
+    static void setThreadName(const QString&);
+
+    // Events recorded since the last start(); returns the number written
+    static qint64 write(const QString &path);
+
+    static qint64 MaxEvents;            // Per thread and per trace, then events are dropped
+
+private:
+
+    static std::atomic<bool> Enabled;
+
+};
+
+class Trace_Span {
+
+public:
+
+    Trace_Span(const char *name) : Name(name), Begin(Trace::isEnabled() ? Trace::now() : -1) {}
+    ~Trace_Span() { if (Begin>=0) { Trace::record(Name, Begin, Trace::now()); } }
+
+private:
+
+    const char *Name;
+    qint64 Begin;
+
+};
+
+#ifndef TRACE_DISABLED
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#define TRACE_SPAN(name) Trace_Span TRACE_CAT(TraceSpan_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,404 @@
+#include "Tracker.h"
+#include "MsgHandler.h"
+#include "Trace.h"
+
+#include <QRunnable>
+#include <QCoreApplication>
+#include <QThread>
+#include <QDebug>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+/* === Worker ======================================================== */
+
+class Tracker_Job : public QRunnable {
+
+public:
+
+    Tracker_Job(Tracker *T, const Tracker_Result &R, const QVector<uchar> &bg, int threshold, double minArea, double maxArea) :
+        T(T), R(R), Background(bg), Threshold(threshold), MinArea(minArea), MaxArea(maxArea) {}
+
+    void run() {
+
+        TRACE_SPAN("track");
+
+        Tracker::detect(R.Img.constBits(), R.Img.bytesPerLine(), Background.constData(), R.Img.width(), R.Img.height(),
+                        Threshold, MinArea, MaxArea, R.Blobs);
+
+        // Back to camera pixels: centre of the binned pixel on the full frame
+        if (R.bin>1) {
+            double c = 0.5*(R.bin-1);
+            for (int i=0; i<R.Blobs.size(); i++) {
+                R.Blobs[i].x = R.Blobs[i].x*R.bin + c;
+                R.Blobs[i].y = R.Blobs[i].y*R.bin + c;
+                R.Blobs[i].area *= R.bin*R.bin;
+            }
+        }
+
+        QMetaObject::invokeMethod(T, "collect", Qt::QueuedConnection, Q_ARG(Tracker_Result, R));
+
+    }
+
+private:
+
+    Tracker *T;
+    Tracker_Result R;
+    QVector<uchar> Background;
+    int Threshold;
+    double MinArea, MaxArea;
+
+};
+
+/* === Constructor =================================================== */
+
+Tracker::Tracker(QObject *parent) : QObject(parent), Pending(0) {
+
+    Enabled = false;
+    Threshold = 25;
+    MinArea = 20;
+    MaxArea = 5000;
+    BackgroundRate = 0.02;
+    BackgroundEvery = 10;
+    LinkDistance = 40;
+    MaxGap = 25;
+    MaxPending = 2*qMax(1, QThread::idealThreadCount());
+    Bin = 1;
+
+    nFrame = 0;
+    nLarvae = 0;
+    Width = 0;
+    Height = 0;
+    nBackground = 0;
+    nSubmitted = 0;
+    nNext = 0;
+    nId = 0;
+
+    // Leaves a core to the acquisition and the interface
+    Pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()-1));
+    Clock.start();
+
+    qRegisterMetaType<Tracker_Result>();
+
+    mFrames = Metrics::counter("thermo_tracker_frames_total", "Frames tracked");
+    mDropped = Metrics::counter("thermo_tracker_dropped_total", "Frames dropped while the workers were busy");
+    mLarvae = Metrics::gauge("thermo_tracker_larvae", "Larvae detected in the last frame");
+    mLatency = Metrics::histogram("thermo_tracker_latency_seconds", "Time from submission to linking",
+                                  Metrics::exponential(0.001, 2, 12));
+
+}
+
+Tracker::~Tracker() { stop(); }
+
+/* === Settings ====================================================== */
+
+void Tracker::load(const QSettings &S) {
+
+    Enabled = S.value("Tracking/Enabled", Enabled).toBool();
+    Threshold = S.value("Tracking/Threshold", Threshold).toInt();
+    MinArea = S.value("Tracking/MinArea", MinArea).toDouble();
+    MaxArea = S.value("Tracking/MaxArea", MaxArea).toDouble();
+    BackgroundRate = S.value("Tracking/BackgroundRate", BackgroundRate).toDouble();
+    BackgroundEvery = qMax(1, S.value("Tracking/BackgroundEvery", BackgroundEvery).toInt());
+    LinkDistance = S.value("Tracking/LinkDistance", LinkDistance).toDouble();
+    MaxGap = S.value("Tracking/MaxGap", MaxGap).toInt();
+
+    int workers = S.value("Tracking/Workers", Pool.maxThreadCount()).toInt();
+    Pool.setMaxThreadCount(qMax(1, workers));
+    MaxPending = S.value("Tracking/MaxPending", 2*Pool.maxThreadCount()).toInt();
+
+}
+
+/* === Control ======================================================= */
+
+bool Tracker::start(const QString &path) {
+
+    stop();
+
+    File.setFileName(path);
+    if (!File.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Unable to write" << qPrintable(path);
+        return false;
+    }
+    Out.setDevice(&File);
+    Out << "frame\ttimestamp\ttemp_left\ttemp_right\tid\tx\ty\theading\tarea\n";
+
+    // A new run starts from a new background and new identities
+    Width = 0;
+    Height = 0;
+    nFrame = 0;
+    nSubmitted = 0;
+    nNext = 0;
+    nId = 0;
+    Tracks.clear();
+    Reorder.clear();
+
+    qInfo() << "Tracking to" << qPrintable(path) << "-" << Pool.maxThreadCount() << "worker(s)";
+    return true;
+
+}
+
+void Tracker::stop() {
+
+    if (!isRunning()) { return; }
+
+    // Pending results are linked before closing
+    Pool.waitForDone();
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+
+    Out.flush();
+    Out.setDevice(0);
+    File.close();
+
+    Log(QtInfoMsg).text("Tracking stopped").field("frames", nFrame).field("larvae", nId);
+
+}
+
+/* === Frames ======================================================== */
+
+void Tracker::push(const QImage &Img, qint64 timestamp, double TL, double TR) {
+
+    if (!isRunning() || Img.depth()!=8) { return; }
+
+    qint64 frame = nFrame++;
+
+    // Workers busy: drop rather than queue
+    if (Pending.load(std::memory_order_relaxed)>=MaxPending) {
+        mDropped->add();
+        return;
+    }
+
+    // First frame of the run, or new region of interest
+    if (Img.width()!=Width || Img.height()!=Height) {
+        Width = Img.width();
+        Height = Img.height();
+        Accumulator.fill(0, Width*Height);
+        Background.resize(Width*Height);
+        nBackground = 0;
+        updateBackground(Img);
+    }
+
+    Tracker_Result R;
+    R.seq = nSubmitted++;
+    R.frame = frame;
+    R.timestamp = timestamp;
+    R.TL = TL;
+    R.TR = TR;
+    R.Img = Img;
+    R.bin = qMax(1, Bin);
+    R.submitted = Clock.nsecsElapsed();
+
+    Pending.fetch_add(1, std::memory_order_relaxed);
+    // Areas in pixels of the frame
+    double a = R.bin*R.bin;
+    Pool.start(new Tracker_Job(this, R, Background, Threshold, MinArea/a, MaxArea/a));
+
+}
+
+void Tracker::collect(Tracker_Result R) {
+
+    Pending.fetch_sub(1, std::memory_order_relaxed);
+
+    // Stale results of a previous run
+    if (!isRunning() || R.seq<nNext) { return; }
+
+    // --- Reorder buffer, released in submission order
+    Reorder.insert(R.seq, R);
+
+    while (!Reorder.isEmpty() && Reorder.firstKey()==nNext) {
+
+        Tracker_Result N = Reorder.take(nNext++);
+        link(N);
+
+        if (N.seq % BackgroundEvery==0) { updateBackground(N.Img); }
+
+        mFrames->add();
+        mLatency->observe((Clock.nsecsElapsed()-N.submitted)*1e-9);
+
+    }
+
+}
+
+/* === Linking ======================================================= */
+
+void Tracker::link(Tracker_Result &R) {
+
+    TRACE_SPAN("track link");
+
+    // Tracks lost for too long
+    for (int i=Tracks.size()-1; i>=0; i--) {
+        if (R.frame-Tracks[i].last>MaxGap) { Tracks.removeAt(i); }
+    }
+
+    // --- Greedy matching, closest pairs first
+    struct Pair { double d; int t, b; };
+    QVector<Pair> Pairs;
+    for (int t=0; t<Tracks.size(); t++) {
+        for (int b=0; b<R.Blobs.size(); b++) {
+            double d = std::hypot(R.Blobs[b].x-Tracks[t].x, R.Blobs[b].y-Tracks[t].y);
+            if (d<=LinkDistance) { Pairs.append({d, t, b}); }
+        }
+    }
+    std::sort(Pairs.begin(), Pairs.end(), [](const Pair &a, const Pair &b) { return a.d<b.d; });
+
+    QVector<bool> usedT(Tracks.size(), false);
+    for (int i=0; i<R.Blobs.size(); i++) { R.Blobs[i].id = -1; }
+
+    foreach (const Pair &P, Pairs) {
+        if (usedT[P.t] || R.Blobs[P.b].id>=0) { continue; }
+        usedT[P.t] = true;
+        R.Blobs[P.b].id = Tracks[P.t].id;
+        Tracks[P.t].x = R.Blobs[P.b].x;
+        Tracks[P.t].y = R.Blobs[P.b].y;
+        Tracks[P.t].last = R.frame;
+    }
+
+    // New larvae
+    for (int b=0; b<R.Blobs.size(); b++) {
+        if (R.Blobs[b].id>=0) { continue; }
+        Larva_Track T = { ++nId, R.Blobs[b].x, R.Blobs[b].y, R.frame };
+        Tracks.append(T);
+        R.Blobs[b].id = T.id;
+    }
+
+    // --- Output
+    foreach (const Larva_Blob &B, R.Blobs) {
+        Out << R.frame << '\t' << R.timestamp << '\t' << R.TL << '\t' << R.TR << '\t' << B.id << '\t'
+            << QString::number(B.x, 'f', 2) << '\t' << QString::number(B.y, 'f', 2) << '\t'
+            << QString::number(B.heading, 'f', 3) << '\t' << B.area << '\n';
+    }
+
+    nLarvae = R.Blobs.size();
+    mLarvae->set(nLarvae);
+
+}
+
+/* === Background ==================================================== */
+
+void Tracker::updateBackground(const QImage &Img) {
+
+    TRACE_SPAN("track background");
+
+    // Plain average of the first frames, then a running average
+    float a = nBackground<qRound(1/BackgroundRate) ? 1.0f/(nBackground+1) : (float) BackgroundRate;
+    nBackground++;
+
+    float *acc = Accumulator.data();
+    uchar *bg = Background.data();      // Detaches from the workers' snapshots
+    for (int y=0; y<Height; y++) {
+        const uchar *row = Img.constScanLine(y);
+        for (int x=0; x<Width; x++, acc++, bg++) {
+            *acc += a*(row[x]-*acc);
+            *bg = (uchar) (*acc+0.5f);
+        }
+    }
+
+}
+
+/* === Detection ===================================================== */
+
+// Raw moments of a blob, up to the third order
+struct Blob_Moments {
+
+    double n, sx, sy, sxx, sxy, syy, sxxx, sxxy, sxyy, syyy;
+
+    void add(double x, double y) {
+        double xx = x*x, yy = y*y;
+        n++; sx += x; sy += y;
+        sxx += xx; sxy += x*y; syy += yy;
+        sxxx += xx*x; sxxy += xx*y; sxyy += x*yy; syyy += yy*y;
+    }
+
+    void add(const Blob_Moments &M) {
+        n += M.n; sx += M.sx; sy += M.sy;
+        sxx += M.sxx; sxy += M.sxy; syy += M.syy;
+        sxxx += M.sxxx; sxxy += M.sxxy; sxyy += M.sxyy; syyy += M.syyy;
+    }
+
+};
+
+static inline int root(QVector<int> &Parent, int l) {
+
+    while (Parent[l]!=l) { l = Parent[l] = Parent[Parent[l]]; }
+    return l;
+
+}
+
+void Tracker::detect(const uchar *img, int stride, const uchar *bg, int w, int h,
+                     int threshold, double minArea, double maxArea, QVector<Larva_Blob> &out) {
+
+    out.clear();
+
+    // --- Labels of the previous and current rows (4-connectivity), label 0 for the background
+    QVector<int> Prev(w, 0), Cur(w, 0);
+    QVector<int> Parent(1, 0);
+    QVector<Blob_Moments> M(1);
+
+    for (int y=0; y<h; y++) {
+
+        const uchar *row = img + (qint64) y*stride;
+        const uchar *brow = bg + (qint64) y*w;
+        int left = 0;
+
+        for (int x=0; x<w; x++) {
+
+            if (std::abs(row[x]-brow[x])<=threshold) { Cur[x] = left = 0; continue; }
+
+            int up = Prev[x];
+            int l;
+
+            if (!left && !up) {
+                l = Parent.size();
+                Parent.append(l);
+                M.append(Blob_Moments());
+            } else if (left && up) {
+                l = root(Parent, left);
+                int r = root(Parent, up);
+                if (r!=l) { Parent[r] = l; }
+            } else { l = left ? left : up; }
+
+            M[l].add(x, y);
+            Cur[x] = left = l;
+
+        }
+
+        Prev.swap(Cur);
+    }
+
+    // --- Merge the provisional labels into their roots
+    for (int l=Parent.size()-1; l>0; l--) {
+        int r = root(Parent, l);
+        if (r!=l) { M[r].add(M[l]); }
+    }
+
+    for (int l=1; l<Parent.size(); l++) {
+
+        if (Parent[l]!=l) { continue; }
+        const Blob_Moments &B = M[l];
+        if (B.n<minArea || B.n>maxArea) { continue; }
+
+        // Central moments
+        double cx = B.sx/B.n, cy = B.sy/B.n;
+        double mxx = B.sxx/B.n - cx*cx;
+        double myy = B.syy/B.n - cy*cy;
+        double mxy = B.sxy/B.n - cx*cy;
+        double mxxx = B.sxxx/B.n - 3*cx*B.sxx/B.n + 2*cx*cx*cx;
+        double mxxy = B.sxxy/B.n - 2*cx*B.sxy/B.n - cy*B.sxx/B.n + 2*cx*cx*cy;
+        double mxyy = B.sxyy/B.n - 2*cy*B.sxy/B.n - cx*B.syy/B.n + 2*cx*cy*cy;
+        double myyy = B.syyy/B.n - 3*cy*B.syy/B.n + 2*cy*cy*cy;
+
+        // Body axis, and skewness along it: the thin tail spreads on the negative side
+        double theta = 0.5*std::atan2(2*mxy, mxx-myy);
+        double c = std::cos(theta), s = std::sin(theta);
+        double skew = c*c*c*mxxx + 3*c*c*s*mxxy + 3*c*s*s*mxyy + s*s*s*myyy;
+        double heading = skew<=0 ? theta : (theta>0 ? theta-M_PI : theta+M_PI);
+
+        double d = std::sqrt((mxx-myy)*(mxx-myy) + 4*mxy*mxy);
+        double l1 = (mxx+myy+d)/2, l2 = (mxx+myy-d)/2;
+
+        Larva_Blob L = { -1, cx, cy, B.n, heading, l2>0 ? std::sqrt(l1/l2) : 0 };
+        out.append(L);
+
+    }
+
+}
@@ -0,0 +1,154 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QVector>
+#include <QMap>
+#include <QFile>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <atomic>
+
+#include "Metrics.h"
+
+/* =================================================================== *\
+|    Tracker Class                                                      |
+\* =================================================================== */
+
+// Online tracking of the larvae, on every frame of a run.
+//
+// Detection runs on a pool of workers: difference to the background,
+// threshold, connected components (single pass, two rows of labels) and
+// the moments of each blob, giving its centroid, area and body axis. The
+// head side of the axis is the heavier one (skewness of the blob along
+// its axis), the tail being thinner.
+//
+// Results come back in any order; a reorder buffer hands them over in
+// frame order to the linking stage, on the tracker's thread: greedy
+// nearest-neighbour matching with the tracks of the previous frames,
+// and the update of the background (running average, every
+// BackgroundEvery frames). Workers read a shared snapshot of the
+// background, so that they never wait on each other.
+//
+// Frames are never queued beyond MaxPending: when the workers fall
+// behind, frames are dropped (and counted) rather than delaying the
+// acquisition. Positions go to a tab-separated file:
+//
+//   frame  timestamp  temp_left  temp_right  id  x  y  heading  area
+//
+// frame is the index in the run (all frames, saved or not), timestamp
+// the camera time (ns), heading the direction of the head (rad, image
+// axes), area in pixels.
+//
+// Frames may come binned (Bin camera pixels per pixel) and decimated
+// (skip() for the frames left out): areas and distances of the settings
+// stay in camera pixels, and positions are given on the full frame.
+
+struct Larva_Blob {
+
+    int id;                 // Track, once linked
+    double x, y;            // Centroid (px)
+    double area;            // px
+    double heading;         // Head direction (rad)
+    double elongation;      // Ratio of the axes of the blob
+
+};
+
+struct Larva_Track {
+
+    int id;
+    double x, y;
+    qint64 last;            // Last frame seen
+
+};
+
+struct Tracker_Result {
+
+    qint64 seq;             // Submission order
+    qint64 frame;
+    qint64 timestamp;
+    double TL, TR;
+    QImage Img;
+    int bin;                // Camera pixels per pixel of Img
+    QVector<Larva_Blob> Blobs;
+    qint64 submitted;       // Clock at submission (ns)
+
+};
+
+class Tracker : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Tracker(QObject *parent = 0);
+    ~Tracker();
+
+    void load(const QSettings&);        // Tracking/* keys
+
+    bool start(const QString &path);    // Opens the output file
+    void stop();                        // Waits for the workers and closes it
+    bool isRunning() const { return Out.device()!=0; }
+
+    void push(const QImage&, qint64 timestamp, double TL, double TR);
+    void skip() { if (isRunning()) { nFrame++; } }
+
+    // Blobs of a frame against a background of the same size
+    static void detect(const uchar *img, int stride, const uchar *bg, int w, int h,
+                       int threshold, double minArea, double maxArea, QVector<Larva_Blob> &out);
+
+    bool Enabled;
+    int Threshold;              // Gray levels from the background
+    double MinArea, MaxArea;    // px
+    double BackgroundRate;      // Weight of a new frame in the background
+    int BackgroundEvery;        // Frames between background updates
+    double LinkDistance;        // Max. displacement between frames (px)
+    int MaxGap;                 // Frames a lost track is kept
+    int MaxPending;             // Frames in the workers
+    int Bin;                    // Camera pixels per pixel of the frames pushed
+
+    qint64 nFrame;
+    int nLarvae;
+
+private slots:
+
+    void collect(Tracker_Result);
+
+private:
+
+    QThreadPool Pool;
+    QElapsedTimer Clock;
+    std::atomic<int> Pending;
+
+    // Background, shared read-only with the workers
+    QVector<float> Accumulator;
+    QVector<uchar> Background;
+    int Width, Height;
+    qint64 nBackground;
+
+    QMap<qint64, Tracker_Result> Reorder;
+    qint64 nSubmitted;
+    qint64 nNext;               // Next submission to link
+
+    QList<Larva_Track> Tracks;
+    int nId;
+
+    QFile File;
+    QTextStream Out;
+
+    Metric_Counter *mFrames, *mDropped;
+    Metric_Gauge *mLarvae;
+    Metric_Histogram *mLatency;
+
+    void link(Tracker_Result&);
+    void updateBackground(const QImage&);
+
+};
+
+Q_DECLARE_METATYPE(Tracker_Result)
+
+#endif // TRACKER_H
@@ -7,6 +7,7 @@ int main(int argc, char *argv[]) {
     qInstallMessageHandler(MsgHandler);
 
     QApplication a(argc, argv);
+    Trace::setThreadName("GUI");
     MainWindow w;
     w.show();
 
@@ -17,14 +17,50 @@ MainWindow::MainWindow(QWidget *parent) :
     projPath = projPath.mid(0, projPath.toStdString().find_last_of(filesep.toStdString()));
     projPath = projPath.mid(0, projPath.toStdString().find_last_of(filesep.toStdString())) + filesep;
 
+    // Messages
+    LogMaxBlocks = 5000;        // Paragraphs kept in the console
+    LogBatchMax = 500;          // Messages rendered per drain
+    Session = new LogSink(this);
+
+    // Plots
+    PlotRateMax = 50;           // Upper bound of the telemetry rate (Hz)
+    HistoryOffset = 0;
+    HistoryLast = 0;
+    HistoryFollow = true;
+    HistoryUpdating = false;
+    HistoryIdleMax = 200000;    // Samples kept outside the runs
+    PredictionOffset = 0;
+    PredictionAlign = false;
+
+    // Serial communication
+    Link = new SerialLink(this);
+    BoardClock.Scale = 1000;    // Board micros, 32 bits
+    BoardClock.Wrap = Q_INT64_C(4294967296);
+    mErrorLeft = Metrics::gauge("thermo_temperature_error_celsius", "Measured minus target temperature, NaN without regulation", "zone=\"left\"");
+    mErrorRight = Metrics::gauge("thermo_temperature_error_celsius", "Measured minus target temperature, NaN without regulation", "zone=\"right\"");
+
     // Run
     SaveRate = 10;              // Image saving rate (Hz)
-    nRun = 0;
-    nFrame = 0;
-
-    // Image writer
-    ImgWriter = new QImageWriter;
-    ImgWriter->setFormat("pgm");
+    Rec = new Recorder(this);
+    Rec->Signature = SetupName + " " + Version;
+    Rec->Rate = SaveRate;
+    connect(Rec, SIGNAL(frameSaved()), this, SLOT(frameSaved()));
+
+    // Event clips
+    Clips = new ClipRecorder(this);
+    Clips->Signature = Rec->Signature;
+    Clips->PreTrigger = 5;      // Frames kept before a trigger (s)
+    Clips->PostTrigger = 10;    // Frames saved after a trigger (s)
+    LastTimestamp = 0;
+    LastTime = 0;
+    nSnap = -1;
+
+    // Autotune
+    TuneAmplitude = 150;        // Relay amplitude (PWM units)
+    TuneHysteresis = 0.1;       // Relay hysteresis (°C)
+    TuneTimeout = 1800000;      // Maximal duration per zone (ms)
+    TuneResult[0].valid = false;
+    TuneResult[1].valid = false;
 
     // === USER INTERFACE ==================================================
 
@@ -49,6 +85,11 @@ MainWindow::MainWindow(QWidget *parent) :
     s_Close = new QShortcut(Qt::Key_Escape, this);
     connect(s_Close, SIGNAL(activated()), QApplication::instance(), SLOT(quit()));
 
+    // Ctrl+T: Start / stop tracing (also from startup with THERMOMASTER_TRACE set)
+    s_Trace = new QShortcut(QKeySequence("Ctrl+T"), this);
+    connect(s_Trace, SIGNAL(activated()), this, SLOT(toggleTrace()));
+    if (qEnvironmentVariableIsSet("THERMOMASTER_TRACE")) { Trace::start(); }
+
     // --- Messages -----------------------------
 
     // Style
@@ -57,6 +98,8 @@ MainWindow::MainWindow(QWidget *parent) :
     QTextDocument *OutDoc = new QTextDocument;
     OutDoc->setDefaultStyleSheet(File.readAll());
     OutDoc->setDefaultFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    OutDoc->setMaximumBlockCount(LogMaxBlocks);
+    OutDoc->setUndoRedoEnabled(false);
     ui->Output->setDocument(OutDoc);
 
     // Timer
@@ -88,38 +131,109 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->PlotRight->graph(1)->setPen(QPen(Qt::red));
     ui->PlotRight->graph(1)->setBrush(QBrush(QColor(255, 0, 0, 20)));
 
+    // Motion energy of each half of the image, on the right axis
+    ui->PlotLeft->addGraph(ui->PlotLeft->xAxis, ui->PlotLeft->yAxis2);
+    ui->PlotLeft->graph(2)->setPen(QPen(Qt::darkGreen));
+    ui->PlotRight->addGraph(ui->PlotRight->xAxis, ui->PlotRight->yAxis2);
+    ui->PlotRight->graph(2)->setPen(QPen(Qt::darkGreen));
+
     // Configure right and top axis to show ticks but no labels
     ui->PlotLeft->xAxis2->setVisible(true);
     ui->PlotLeft->xAxis2->setTickLabels(false);
     ui->PlotLeft->yAxis2->setVisible(true);
-    ui->PlotLeft->yAxis2->setTickLabels(false);
 
     ui->PlotRight->xAxis2->setVisible(true);
     ui->PlotRight->xAxis2->setTickLabels(false);
     ui->PlotRight->yAxis2->setVisible(true);
-    ui->PlotRight->yAxis2->setTickLabels(false);
 
-    // Make left and bottom axes always transfer their ranges to right and top axes:
+    // Make the bottom axes always transfer their ranges to the top axes (the right ones show the motion)
     connect(ui->PlotLeft->xAxis, SIGNAL(rangeChanged(QCPRange)), ui->PlotLeft->xAxis2, SLOT(setRange(QCPRange)));
-    connect(ui->PlotLeft->yAxis, SIGNAL(rangeChanged(QCPRange)), ui->PlotLeft->yAxis2, SLOT(setRange(QCPRange)));
-
     connect(ui->PlotRight->xAxis, SIGNAL(rangeChanged(QCPRange)), ui->PlotRight->xAxis2, SLOT(setRange(QCPRange)));
-    connect(ui->PlotRight->yAxis, SIGNAL(rangeChanged(QCPRange)), ui->PlotRight->yAxis2, SLOT(setRange(QCPRange)));
+
+    // Series feed the graph containers incrementally
+    TempLeft.attach(ui->PlotLeft->graph(0)->data());
+    TargetLeft.attach(ui->PlotLeft->graph(1)->data());
+    TempRight.attach(ui->PlotRight->graph(0)->data());
+    TargetRight.attach(ui->PlotRight->graph(1)->data());
+    MotionLeft.attach(ui->PlotLeft->graph(2)->data());
+    MotionRight.attach(ui->PlotRight->graph(2)->data());
+    MotionSum[0] = MotionSum[1] = 0;
+    MotionCount = 0;
+    MotionMax = 1;
+    setPlotWindow();
+
+    // Replots are coalesced on a refresh tick
+    Replot = new ReplotScheduler(this);
+    Replot->addPlot(ui->PlotLeft);
+    Replot->addPlot(ui->PlotRight);
+    Replot->setRate(25);
+    connect(Replot, SIGNAL(rateChanged(double)), this, SLOT(plotRateChanged(double)));
+
+    // --- History plot
+
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(0)->setPen(QPen(Qt::darkCyan));
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(1)->setPen(QPen(Qt::darkMagenta));
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(2)->setPen(QPen(Qt::red, 1, Qt::DashLine));
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(3)->setPen(QPen(Qt::darkRed, 1, Qt::DashLine));
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(4)->setPen(QPen(Qt::darkCyan, 1, Qt::DotLine));
+    ui->PlotHistory->addGraph();
+    ui->PlotHistory->graph(5)->setPen(QPen(Qt::darkMagenta, 1, Qt::DotLine));
+    ui->PlotHistory->yAxis->setRange(15,40);
+
+    // Horizontal zoom and pan, double-click to follow the whole run again
+    ui->PlotHistory->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+    ui->PlotHistory->axisRect()->setRangeDrag(Qt::Horizontal);
+    ui->PlotHistory->axisRect()->setRangeZoom(Qt::Horizontal);
+
+    Replot->addPlot(ui->PlotHistory);
+    connect(Replot, SIGNAL(aboutToReplot()), this, SLOT(updateHistory()));
+    connect(ui->PlotHistory->xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(historyRangeChanged(QCPRange)));
+    connect(ui->PlotHistory, SIGNAL(mouseDoubleClick(QMouseEvent*)), this, SLOT(followHistory()));
+    connect(ui->Simulate, SIGNAL(clicked()), this, SLOT(simulateProtocol()));
 
     // Default target values
     TargetLeftValue = ui->TargetLeft->text().toDouble();
     TargetRightValue = ui->TargetRight->text().toDouble();
 
+    // --- Autotune rules -----------------------
+
+    for (int i=0; i<Autotune::nRules; i++) { ui->TuneRule->addItem(Autotune::ruleName(i)); }
+    ui->TuneRule->setCurrentIndex(Autotune::SomeOvershoot);
+
     // === Camera ==========================================================
 
     qInfo() << TITLE_2 << "Camera";
 
+    // Shared-memory stream of the frames, for external readers; an empty Stream/Name disables it
+    QSettings Settings(progPath + "Settings.conf", QSettings::IniFormat);
+    Stream = new FrameStream;
+    Stream->Signature = SetupName + " " + Version;
+    QString StreamName = Settings.value("Stream/Name", THERMOSTREAM_NAME).toString();
+    if (!StreamName.isEmpty()) { Stream->open(StreamName, Settings.value("Stream/Slots", 16).toInt()); }
+
+    // Online tracking of the runs (Tracking/* keys); StoreImages off keeps the positions only
+    Rec->Track->load(Settings);
+    Rec->StoreImages = Settings.value("Tracking/StoreImages", true).toBool();
+    if (!Rec->StoreImages && !Rec->Track->Enabled) { qWarning() << "Neither images nor positions will be recorded"; }
+
+    // Frame files: format and encoder threads (Recording/* keys), binning
+    // and decimation of the files and of the tracked frames
+    Rec->Encoders->load(Settings);
+    Rec->load(Settings);
+
     // Initialize Camera
     InitCamera();
 
     // === Connections =====================================================
 
     connect(ui->CheckSerial, SIGNAL(released()), this, SLOT(checkSerial()));
+    connect(Link, SIGNAL(sample(Serial_Sample)), this, SLOT(setTemperatures(Serial_Sample)));
+    connect(Link, SIGNAL(line(QByteArray)), this, SLOT(serialLine(QByteArray)));
 
     connect(ui->ProjectPathButton, SIGNAL(clicked()), this, SLOT(BrowseProject()));
     connect(ui->Autoset, SIGNAL(clicked()), this, SLOT(autoset()));
@@ -127,6 +241,7 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->ProtocolRun, SIGNAL(toggled(bool)), this, SLOT(toggleProtocol(bool)));
 
     connect(ui->Snapshot, SIGNAL(clicked()), this, SLOT(snapshot()));
+    connect(Clips, SIGNAL(clipSaved(QString,int)), this, SLOT(clipSaved(QString,int)));
     connect(ui->SpawningDate, SIGNAL(dateChanged(QDate)), this, SLOT(updateAge(QDate)));
 
     connect(ui->Regulation, SIGNAL(released()), this, SLOT(setRegulation()));
@@ -137,15 +252,41 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->Icoeff, SIGNAL(editingFinished()), this, SLOT(setI()));
     connect(ui->Dcoeff, SIGNAL(editingFinished()), this, SLOT(setD()));
 
+    connect(ui->PlotWindow, SIGNAL(editingFinished()), this, SLOT(setPlotWindow()));
+    connect(ui->PlotWindowUnit, SIGNAL(activated(int)), this, SLOT(setPlotWindow()));
+
+    connect(ui->Autotune, SIGNAL(toggled(bool)), this, SLOT(toggleAutotune(bool)));
+    connect(ui->TuneRule, SIGNAL(activated(int)), this, SLOT(applyTuneRule(int)));
+    connect(ui->SaveGains, SIGNAL(clicked()), this, SLOT(saveGains()));
+
     // === Timers ==========================================================
 
     // --- Protocol timer
     timerProtocol = new QTimer(this);
     connect(timerProtocol, SIGNAL(timeout()), this, SLOT(ProtocolLoop()));
 
+    // --- Protocol engine
+    Engine = new ProtocolEngine(this);
+    Engine->RampPeriod = 250;           // Display update of the ramps (ms)
+    connect(Engine, SIGNAL(print(QString)), this, SLOT(protocolPrint(QString)));
+    connect(Engine, SIGNAL(createDirectory()), this, SLOT(protocolDirectory()));
+    connect(Engine, SIGNAL(camera(bool)), this, SLOT(protocolCamera(bool)));
+    connect(Engine, SIGNAL(clip(QString)), this, SLOT(protocolClip(QString)));
+    connect(Engine, SIGNAL(regulation(bool)), this, SLOT(protocolRegulation(bool)));
+    connect(Engine, SIGNAL(targets(double,double)), this, SLOT(protocolTargets(double,double)));
+    connect(Engine, SIGNAL(ramp(double,double,qint64)), this, SLOT(protocolRamp(double,double,qint64)));
+    connect(Engine, SIGNAL(setpoints(double,double)), this, SLOT(protocolSetpoints(double,double)));
+    connect(Engine, SIGNAL(finished()), this, SLOT(protocolFinished()));
+
+    // === Metrics =========================================================
+
+    // Prometheus endpoint on localhost; Metrics/Port = 0 disables it
+    int MetricsPort = Settings.value("Metrics/Port", 9464).toInt();
+    Monitor = new MetricsServer(this);
+    if (MetricsPort>0) { Monitor->listen(MetricsPort); }
+
     // === Startup =========================================================
 
-    //skipSerial = true;
     QTimer::singleShot(400, this, SLOT(checkSerial()));
 
 }
@@ -156,32 +297,76 @@ MainWindow::MainWindow(QWidget *parent) :
 
 void MainWindow::UpdateMessage() {
 
-    while (Messages.length()) {
+    TRACE_SPAN("UpdateMessage");
+
+    // Report overflows of the message queue
+    unsigned dropped = Messages.takeDropped();
+    if (dropped) {
+        static Metric_Counter *mDropped = Metrics::counter("thermo_log_dropped_total", "Log records dropped, by stage (queue: log queue full, sink: session writer behind)", "stage=\"queue\"");
+        mDropped->add(dropped);
+        qWarning() << dropped << "message(s) dropped: the log queue was full";
+    }
+
+    // --- Batch: bounded per drain, the rest waits for the next tick
+    Message MSG;
+    QString Batch;
+    int n = 0;
 
-        Message MSG = Messages.takeFirst();
-        QString S;
+    while (n<LogBatchMax && Messages.pop(MSG)) {
 
-        switch (MSG.type) {
-        case QtDebugMsg:
+        Session->write(MSG);
+
+        if (MSG.type==QtDebugMsg) {
             cout << MSG.text.toStdString() << endl;
-            break;
-        case QtInfoMsg:
-            S = "<" + MSG.css + ">" + MSG.text + "</p>" ;
-            break;
-        case QtWarningMsg:
-            S = "<p class='warning'>" + MSG.text + "</p>";
-            break;
-        case QtCriticalMsg:
-            S= "<p class='critical'>" + MSG.text + "</p>";
-            break;
-        case QtFatalMsg:
-            S = "<p class='fatal'>" + MSG.text + "</p>";
-            break;
+            continue;
         }
+        Batch += MSG.html();
+        n++;
+    }
+
+    if (Batch.isEmpty()) { return; }
+
+    // --- Append at the end of the document; old paragraphs are trimmed
+    // by the maximum block count
+    QScrollBar *Bar = ui->Output->verticalScrollBar();
+    bool follow = Bar->value()==Bar->maximum();
+
+    QTextCursor Cursor(ui->Output->document());
+    Cursor.movePosition(QTextCursor::End);
+    Cursor.beginEditBlock();
+    if (!ui->Output->document()->isEmpty()) { Cursor.insertBlock(QTextBlockFormat(), QTextCharFormat()); }
+    Cursor.insertHtml(Batch);
+    Cursor.endEditBlock();
+
+    if (follow) { Bar->setValue(Bar->maximum()); }
+
+}
+
+/* ====================================================================== *\
+|    TRACING                                                               |
+\* ====================================================================== */
 
-        ui->Output->setHtml(ui->Output->toHtml().append(S));
-        ui->Output->verticalScrollBar()->setValue(ui->Output->verticalScrollBar()->maximum());
+void MainWindow::toggleTrace() {
+
+    if (Trace::isEnabled()) {
+        writeTrace();
+        Trace::stop();
+    } else {
+        Trace::start();
+        qInfo() << "Tracing started";
     }
+
+}
+
+void MainWindow::writeTrace() {
+
+    QString path = ui->ProjectPath->text() + "Data" + filesep + "Traces" + filesep
+            + "Trace_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_hhmmss") + ".json";
+
+    qint64 n = Trace::write(path);
+    if (n<0) { qWarning() << "Unable to write" << qPrintable(path); }
+    else { qInfo() << "Trace:" << n << "events written to" << qPrintable(path); }
+
 }
 
 /* ====================================================================== *\
@@ -202,6 +387,7 @@ void MainWindow::updatePath() {
 
     QDateTime now = QDateTime::currentDateTime();
     ui->DataPath->setText(ui->ProjectPath->text() + "Data" + filesep + now.toString("yyyy-MM-dd") + filesep);
+    Session->setDirectory(ui->ProjectPath->text() + "Data" + filesep + "Logs" + filesep);
     autoset();
 
 }
@@ -212,21 +398,14 @@ void MainWindow::autoset() {
     if (!QDir(ui->DataPath->text()).exists()) { QDir().mkdir(ui->DataPath->text()); }
 
     // Find last run
-    nRun = 0;
-    QDir DataDir(ui->DataPath->text());
-    QFileInfoList FIL = DataDir.entryInfoList(QDir::AllDirs | QDir::NoDotAndDotDot, QDir::DirsFirst);
-    foreach(const QFileInfo &elm, FIL) {
-        if(QDir(elm.absoluteFilePath()).exists()) {
-
-            QStringList tmp = elm.fileName().split(" ", QString::SkipEmptyParts);
-            if (tmp.count()==2 || !tmp.at(0).compare("Run")) {
-                nRun = tmp.at(1).toInt();
-            }
-        }
-    }
+    Rec->nRun = Recorder::lastRun(ui->DataPath->text());
 
-    if (nRun) {
-        ui->statusBar->showMessage(QString("Last run: %1").arg(nRun, 2, 10, QLatin1Char('0')));
+    // Clips outside of the runs; snapshots are counted again on demand
+    Clips->setDirectory(ui->DataPath->text() + "Clips" + filesep);
+    nSnap = -1;
+
+    if (Rec->nRun) {
+        ui->statusBar->showMessage(QString("Last run: %1").arg(Rec->nRun, 2, 10, QLatin1Char('0')));
     } else {
         ui->statusBar->showMessage(QString("No run for today"));
     }
@@ -246,91 +425,17 @@ void MainWindow::checkSerial() {
 
     qInfo() << TITLE_2 << "Serial connections";
 
-    // --- Get available ports
-
-    const QList<QSerialPortInfo> infos = QSerialPortInfo::availablePorts();
-    qInfo() << infos.length() << "connections detected";
-
-    // --- Assign port
-
-    for (int i=0; i<infos.length(); i++) {
-
-        // --- Checks
-
-        // Skip non-Arduino connections
-        if (infos[i].description().left(7)!="Arduino") { continue; }
-
-        // Is device busy ?
-        if (infos[i].isBusy()) {
-            qInfo().nospace() << "[" << infos[i].portName() << "] is busy ...";
-            continue;
-        }
-
-        // --- Open connection
+    if (Link->open()) {
 
-        qInfo() << "Opening" << infos[i].portName();
-
-        Serial = new QSerialPort(this);
-
-        Serial->setPortName(infos[i].portName());
-        Serial->setBaudRate(115200);
-        Serial->setDataBits(QSerialPort::Data8);
-        Serial->setParity(QSerialPort::NoParity);
-        Serial->setStopBits(QSerialPort::OneStop);
-        Serial->setFlowControl(QSerialPort::NoFlowControl);
-
-        if (!Serial->open(QIODevice::ReadWrite)) {
-            qWarning() << "Failed to open port" << Serial->portName();
-            return;
-        }
-
-        qInfo() << "Init. serial connection";
-
-        // Connect serial read output
-        connect(Serial, SIGNAL(readyRead()), this, SLOT(readSerial()));
+        // Saved gains, once the board is out of reset
+        QTimer::singleShot(2500, this, SLOT(loadGains()));
 
     }
 }
 
-void MainWindow::send(QString cmd) {
-    Serial->write(cmd.toStdString().c_str());
-    Serial->flush();
-    QThread::msleep(5);
-}
-
-void MainWindow::readSerial() {
-
-    // --- Read response
-    QByteArray readData = Serial->readAll();
-    while (Serial->waitForReadyRead(10)) {
-        readData.append(Serial->readAll());
-    }
-
-    if (skipSerial) {
-        skipSerial = false;
-        return;
-    }
-
-    QStringList res = QString(readData).split("\r\n", QString::SkipEmptyParts);
-
-    // --- Filter responses
-    for (int i=0; i<res.size(); i++) {
+void MainWindow::send(QString cmd) { Link->send(cmd); }
 
-        if (res[i].left(4)=="Data") {
-
-            QStringList Data = res[i].mid(5).split(" ", QString::SkipEmptyParts);
-            setTemperatures(Data);
-
-        } else {
-
-            // --- Display
-            qDebug() << res[i].toStdString().c_str();
-
-        }
-
-    }
-
-}
+void MainWindow::serialLine(QByteArray line) { qDebug() << line.constData(); }
 
 /* ====================================================================== *\
 |    CAMERA                                                                |
@@ -339,10 +444,17 @@ void MainWindow::readSerial() {
 void MainWindow::InitCamera() {
 
     Camera = new Camera_FLIR(0);
+    Camera->Stream = Stream;
+
+    // Pixel format, display window, motion region and display binning (Camera/*, Motion/Roi, Display/*)
+    QSettings Settings(progPath + "Settings.conf", QSettings::IniFormat);
+    Camera->load(Settings);
 
     // --- Connections
     connect(ui->UpdateCamera, SIGNAL(released()), this, SLOT(UpdateCamera()));
-    connect(Camera, SIGNAL(newImageForDisplay(QPixmap)), this, SLOT(updateDisplay(QPixmap)));
+    connect(Camera, SIGNAL(newImageForDisplay(QImage)), this, SLOT(updateDisplay(QImage)));
+    connect(Camera, SIGNAL(newFrame(Image_FLIR)), this, SLOT(recordFrame(Image_FLIR)));
+    connect(ui->Record, SIGNAL(toggled(bool)), this, SLOT(toggleRecord(bool)));
     connect(ui->CstAvg, SIGNAL(toggled(bool)), this, SLOT(SetAvgVal(bool)));
 
     this->ArmCamera();
@@ -370,58 +482,95 @@ void MainWindow::UpdateCamera() {
 
 }
 
-void MainWindow::updateDisplay(QPixmap pix) {
+void MainWindow::updateDisplay(QImage Img) {
 
-    ui->Image->setPixmap(pix);
+    TRACE_SPAN("updateDisplay");
+
+    ui->Image->setPixmap(QPixmap::fromImage(Img));
     ui->AvgValue->setText(QString("%1").arg(Camera->avgval));
 
-    if (ui->Record->isChecked()) {
+}
 
-        // Save Image
-        ImgWriter->setFileName(QString(RunPath + filesep + "Frame_%1.pgm").arg(nFrame, 6, 10, QLatin1Char('0')));
-        ImgWriter->write(ui->Image->pixmap()->toImage());
+void MainWindow::recordFrame(Image_FLIR FImg) {
 
-        // Append metadata
-        QFile ImgFile(ImgWriter->fileName());
-        if (ImgFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
-            QTextStream tmp(&ImgFile);
-            tmp << endl << "#" + SetupName + " " + Version;
-            tmp << endl << "#" + QString("Timestamp:%1;TempLeft:%2;TempRight:%3").arg(Camera->timestamp).arg(TempLeft.last()).arg(TempRight.last());
-        }
+    TRACE_SPAN("recordFrame");
 
-        // --- Update
+    // Exposure time on the host clock, shared with the temperatures
+    qint64 time = CameraClock.add(FImg.timestamp, FImg.host);
 
-        // Status bar
-        ui->statusBar->showMessage(QString("Run %1 - Frame %2").arg(nRun, 2, 10, QLatin1Char('0')).arg(nFrame, 6, 10, QLatin1Char('0')));
+    LastFrame = FImg.Raw.isNull() ? FImg.Img : FImg.Raw;
+    LastTimestamp = FImg.timestamp;
+    LastTime = time;
 
-        // Frame number
-        nFrame++;
+    // Clips are pushed at once, with the latest temperatures
+    Temperature_Sample T;
+    Rec->Temperatures.at(time, T);
+    Clips->push(FImg.Img, FImg.timestamp, T.TL, T.TR);
 
+    // Motion energy, plotted per serial sample and logged per frame
+    if (!qIsNaN(FImg.motionLeft)) {
+        MotionSum[0] += FImg.motionLeft;
+        MotionSum[1] += FImg.motionRight;
+        MotionCount++;
     }
+    Rec->writeMotion(FImg.timestamp, FImg.motionLeft, FImg.motionRight, FImg.motionRoi);
+
+    Rec->write(FImg.Img, FImg.timestamp, time, FImg.Raw);
+
+}
+
+void MainWindow::frameSaved() {
+
+    ui->statusBar->showMessage(QString("Run %1 - Frame %2").arg(Rec->nRun, 2, 10, QLatin1Char('0')).arg(Rec->nFrame-1, 6, 10, QLatin1Char('0')));
+
+}
+
+void MainWindow::toggleRecord(bool b) {
+
+    if (b) { Rec->start(); }
+    else { Rec->stop(); }
+
 }
 
 void MainWindow::snapshot() {
 
     // Create snapshot directory?
     QString SnapPath(ui->DataPath->text() + "Snapshots" + filesep);
-    if (!QDir(ui->DataPath->text()).exists()) { QDir().mkdir(ui->DataPath->text()); }
-    if (!QDir(SnapPath).exists()) { QDir().mkdir(SnapPath); }
+    if (!QDir().mkpath(SnapPath)) {
+        qWarning() << "Unable to create" << qPrintable(SnapPath);
+        return;
+    }
+
+    // Get last image number, once per directory
+    if (nSnap<0) {
+        nSnap = 0;
+        QStringList flist = QDir(SnapPath).entryList(QStringList() << "Image_*", QDir::NoDotAndDotDot | QDir::Files);
+        foreach(QString file, flist) { nSnap = qMax(nSnap, file.section('_', 1).section('.', 0, 0).toInt()); }
+    }
 
-    // Get last image number
-    int nSnap = 0;
-    QDir SnapDir(SnapPath);
-    QStringList flist = SnapDir.entryList(QDir::NoDotAndDotDot | QDir::Files);
-    foreach(QString file, flist) {
-        QStringList tmp = file.split("_", QString::SkipEmptyParts);
-        tmp = tmp.at(1).split(".");
-        if (tmp.at(0).toInt()>nSnap) { nSnap = tmp.at(0).toInt(); }
+    // Save the last frame
+    if (!LastFrame.isNull()) {
+        QByteArray Buffer;
+        Temperature_Sample T;
+        Rec->Temperatures.at(LastTime, T);
+        if (Recorder::writeFrame(QString(SnapPath + "Image_%1.pgm").arg(nSnap+1, 6, 10, QLatin1Char('0')), LastFrame,
+                                 Rec->Signature, LastTimestamp, T.TL, T.TR, Buffer, T.targetLeft, T.targetRight)) {
+            nSnap++;
+            ui->statusBar->showMessage(QString("Last image: %1").arg(nSnap, 6, 10, QLatin1Char('0')));
+        }
     }
-    nSnap++;
 
+    // And the frames around
+    triggerClip("snapshot");
+
+}
+
+void MainWindow::triggerClip(QString label) { Clips->trigger(label); }
 
+void MainWindow::clipSaved(QString path, int frames) {
 
-    // Update status message
-    ui->statusBar->showMessage(QString("Last image: %1").arg(nSnap, 6, 10, QLatin1Char('0')));
+    qInfo() << "Clip saved:" << frames << "frames in" << qPrintable(path);
+    ui->statusBar->showMessage(QString("Clip %1 - %2 frames").arg(Clips->nClip, 4, 10, QLatin1Char('0')).arg(frames));
 
 }
 
@@ -461,53 +610,204 @@ void MainWindow::setTargets() {
 void MainWindow::setRegulation() {
 
     if (ui->Regulation->isChecked()) { send(QString("start")); }
-    else { send(QString("stop")); }
+    else {
+        send(QString("stop"));
+        ui->Autotune->setChecked(false);    // The board has released the relay
+    }
+
+}
+
+void MainWindow::setPlotWindow() {
+
+    int n = ui->PlotWindow->value();
+    if (ui->PlotWindowUnit->currentIndex()==0) {
+
+        // Window in samples
+        TempLeft.setWindow(n);
+        TempRight.setWindow(n);
+        TargetLeft.setWindow(n);
+        TargetRight.setWindow(n);
+        MotionLeft.setWindow(n);
+        MotionRight.setWindow(n);
+
+    } else {
+
+        // Window in seconds, sized for the fastest telemetry (at most 2M samples)
+        int m = qMin(n*PlotRateMax, 1<<21);
+        TempLeft.setWindow(m, n);
+        TempRight.setWindow(m, n);
+        TargetLeft.setWindow(m, n);
+        TargetRight.setWindow(m, n);
+        MotionLeft.setWindow(m, n);
+        MotionRight.setWindow(m, n);
+        n = m;
+
+    }
+
+    // Markers only while the window is short enough to resolve them
+    QCPScatterStyle Markers(QCPScatterStyle::ssNone);
+    if (n<=500) { Markers = QCPScatterStyle(QCPScatterStyle::ssCircle, Qt::darkCyan, Qt::darkCyan, 3); }
+    ui->PlotLeft->graph(0)->setScatterStyle(Markers);
+    ui->PlotRight->graph(0)->setScatterStyle(Markers);
 
 }
 
-void MainWindow::setTemperatures(QStringList Data) {
+void MainWindow::setTemperatures(const Serial_Sample &S) {
+
+    TRACE_SPAN("setTemperatures");
 
     // --- Update text displays
-    ui->TempLeft->setText(Data[1]);
-    ui->TempRight->setText(Data[2]);
+    ui->TempLeft->setText(QString::number(S.TL, 'f', 2));
+    ui->TempRight->setText(QString::number(S.TR, 'f', 2));
 
     // --- Update plot
 
-    // Update vectors
-    Time.append(Data[0].toDouble()/1e6);
-    TempLeft.append(Data[1].toDouble());
-    TempRight.append(Data[2].toDouble());
-    if (ui->Regulation->isChecked()) {
-        TargetLeft.append(TargetLeftValue);
-        TargetRight.append(TargetRightValue);
-    } else {
-        TargetLeft.append(0);
-        TargetRight.append(0);
+    // Update series (and graph data)
+    double t = S.t/1e6;
+    double tl = ui->Regulation->isChecked() ? TargetLeftValue : 0;
+    double tr = ui->Regulation->isChecked() ? TargetRightValue : 0;
+    TempLeft.append(t, S.TL);
+    TempRight.append(t, S.TR);
+    TargetLeft.append(t, tl);
+    TargetRight.append(t, tr);
+
+    // Motion energy of the frames received since the last sample
+    if (MotionCount) {
+        MotionLeft.append(t, MotionSum[0]/MotionCount);
+        MotionRight.append(t, MotionSum[1]/MotionCount);
+        MotionMax = qMax(0.999*MotionMax, qMax(MotionLeft.last(), MotionRight.last()));
+        MotionSum[0] = MotionSum[1] = 0;
+        MotionCount = 0;
+    }
+
+    // Attached to the streamed frames
+    Stream->setTemperatures(S.TL, S.TR);
+
+    // Frames of the run get the temperatures of their exposure
+    Temperature_Sample T = { BoardClock.add((qint64) S.t, S.host), S.TL, S.TR, tl, tr };
+    Rec->addTemperatures(T);
+
+    // Regulation error, for monitoring
+    mErrorLeft->set(ui->Regulation->isChecked() ? S.TL-tl : qQNaN());
+    mErrorRight->set(ui->Regulation->isChecked() ? S.TR-tr : qQNaN());
+
+    // Whole-experiment history, on the unwrapped board clock
+    if (t+HistoryOffset<HistoryLast) { HistoryOffset += 4294.967296; }
+    HistoryLast = t+HistoryOffset;
+    History[0].append(HistoryLast, S.TL);
+    History[1].append(HistoryLast, S.TR);
+    History[2].append(HistoryLast, tl);
+    History[3].append(HistoryLast, tr);
+
+    // Outside the runs only the recent past is kept, halved when full
+    if (!Engine->isRunning() && History[0].count()>HistoryIdleMax) {
+        for (int i=0; i<4; i++) { History[i].dropFront(History[i].count() - HistoryIdleMax/2); }
     }
 
-    while (Time.count()>200) {
-        Time.removeFirst();
-        TempLeft.removeFirst();
-        TempRight.removeFirst();
-        TargetLeft.removeFirst();
-        TargetRight.removeFirst();
+    // The prediction starts with the run
+    if (PredictionAlign) {
+        PredictionOffset = HistoryLast;
+        PredictionAlign = false;
     }
 
-    // Display plot
-    ui->PlotLeft->graph(0)->setData(Time, TempLeft);
-    ui->PlotLeft->graph(1)->setData(Time, TargetLeft);
-    ui->PlotRight->graph(0)->setData(Time, TempRight);
-    ui->PlotRight->graph(1)->setData(Time, TargetRight);
+    // --- Autotune
+    if (ui->Autotune->isChecked()) {
+
+        Tuner.addSample(HistoryLast, Tuner.Zone=='L' ? S.TL : S.TR, S.relay, S.tuning);
+
+        if (Tuner.done()) {
+
+            TuneResult[Tuner.Zone=='L' ? 0 : 1] = Tuner.result();
+            if (Tuner.Zone=='L') { startTuneZone('R'); }
+            else { finishAutotune(); }
 
-    ui->PlotLeft->xAxis->setRange(Time.first()-0.5, Time.last()+0.5);
-    ui->PlotRight->xAxis->setRange(Time.first()-0.5, Time.last()+1);
+        } else if (TuneTime.elapsed()>TuneTimeout) {
+
+            qWarning() << "Autotune: no sustained oscillation on zone" << Tuner.Zone;
+            qWarning() << "Increase the relay amplitude or set a target closer to ambient";
+            ui->Autotune->setChecked(false);
+
+        }
+    }
+
+    // Display plot
+    ui->PlotLeft->xAxis->setRange(TempLeft.firstKey()-0.5, TempLeft.lastKey()+0.5);
+    ui->PlotRight->xAxis->setRange(TempRight.firstKey()-0.5, TempRight.lastKey()+1);
     ui->PlotLeft->yAxis->setRange(15,40);
     ui->PlotRight->yAxis->setRange(15,40);
+    ui->PlotLeft->yAxis2->setRange(0, 1.2*qMax(0.1, MotionMax));
+    ui->PlotRight->yAxis2->setRange(0, 1.2*qMax(0.1, MotionMax));
 
     // ui->PlotLeft->rescaleAxes();
 
-    ui->PlotLeft->replot();
-    ui->PlotRight->replot();
+    Replot->markDirty();
+
+}
+
+void MainWindow::updateHistory() {
+
+    if (!ui->PlotHistory->isVisible() || (History[0].isEmpty() && Prediction[0].isEmpty())) { return; }
+
+    // Show the whole run and prediction unless the user zoomed in
+    if (HistoryFollow) {
+
+        double k0 = History[0].isEmpty() ? PredictionOffset : History[0].firstKey();
+        double k1 = History[0].isEmpty() ? PredictionOffset : History[0].lastKey();
+        if (!Prediction[0].isEmpty()) {
+            k0 = qMin(k0, PredictionOffset + Prediction[0].firstKey());
+            k1 = qMax(k1, PredictionOffset + Prediction[0].lastKey());
+        }
+
+        HistoryUpdating = true;
+        ui->PlotHistory->xAxis->setRange(k0, k1);
+        HistoryUpdating = false;
+    }
+
+    loadHistory();
+
+}
+
+void MainWindow::loadHistory() {
+
+    // Level of detail matching the visible pixel width
+    QCPRange R = ui->PlotHistory->xAxis->range();
+    int px = ui->PlotHistory->axisRect()->width();
+
+    QVector<double> K, V;
+    for (int i=0; i<4; i++) {
+        History[i].query(R.lower, R.upper, px, K, V);
+        ui->PlotHistory->graph(i)->setData(K, V, true);
+    }
+
+    // Predicted temperatures, on the same time axis
+    for (int z=0; z<2; z++) {
+        Prediction[z].query(R.lower-PredictionOffset, R.upper-PredictionOffset, px, K, V);
+        for (int i=0; i<K.size(); i++) { K[i] += PredictionOffset; }
+        ui->PlotHistory->graph(4+z)->setData(K, V, true);
+    }
+
+}
+
+void MainWindow::historyRangeChanged(QCPRange) {
+
+    if (HistoryUpdating) { return; }
+
+    // User zoom or pan
+    HistoryFollow = false;
+    loadHistory();
+
+}
+
+void MainWindow::followHistory() {
+
+    HistoryFollow = true;
+    Replot->markDirty();
+
+}
+
+void MainWindow::plotRateChanged(double hz) {
+
+    qInfo().nospace() << "Plot refresh rate set to " << hz << " Hz (replot: " << Replot->replotTime() << " ms)";
 
 }
 
@@ -519,6 +819,166 @@ void MainWindow::setP() { send("P " + QString("%1").arg(ui->Pcoeff->value())); }
 void MainWindow::setI() { send("I " + QString("%1").arg(ui->Icoeff->value())); }
 void MainWindow::setD() { send("D " + QString("%1").arg(ui->Dcoeff->value())); }
 
+/* ====================================================================== *\
+|    AUTOTUNE                                                              |
+\* ====================================================================== */
+
+void MainWindow::toggleAutotune(bool b) {
+
+    if (b) {
+
+        qInfo() << TITLE_2 << "Autotune";
+
+        TuneResult[0].valid = false;
+        TuneResult[1].valid = false;
+        startTuneZone('L');
+
+    } else {
+
+        send(QString("tune stop"));
+
+    }
+
+}
+
+void MainWindow::startTuneZone(char zone) {
+
+    double target = zone=='L' ? TargetLeftValue : TargetRightValue;
+
+    // Switching zone on the firmware side also releases the previous one
+    Tuner.start(zone, target, TuneAmplitude, TuneHysteresis);
+    TuneTime.start();
+    send(QString("tune %1 %2 %3").arg(zone).arg(TuneAmplitude).arg(TuneHysteresis));
+
+    qInfo().nospace() << "Relay experiment on zone " << zone << " around " << target << "°C";
+
+}
+
+void MainWindow::finishAutotune() {
+
+    ui->Autotune->setChecked(false);
+
+    if (!TuneResult[0].valid || !TuneResult[1].valid) {
+        qWarning() << "Autotune failed: unable to identify the zones";
+        return;
+    }
+
+    // --- Identified zones
+    QString S = "<table class='tuneInfo'><tr><th>Zone</th><th>Ku</th><th>Tu (s)</th>"
+                "<th>K (&deg;C/PWM)</th><th>&tau; (s)</th><th>L (s)</th><th>Ambient (&deg;C)</th></tr>";
+
+    for (int z=0; z<2; z++) {
+        Relay_Result &R = TuneResult[z];
+        S += QString("<tr><th>%1</th><td>%2</td><td>%3</td><td>%4</td><td>%5</td><td>%6</td><td>%7</td></tr>")
+                .arg(z ? "Right" : "Left").arg(R.Ku, 0, 'f', 1).arg(R.Tu, 0, 'f', 1)
+                .arg(R.Model.K, 0, 'g', 3).arg(R.Model.tau, 0, 'f', 1).arg(R.Model.L, 0, 'f', 2)
+                .arg(R.Model.ambient, 0, 'f', 1);
+    }
+    S += "</table>";
+    qInfo().nospace() << qPrintable(S);
+
+    // --- Proposals, validated against both identified zones
+    S = "<table class='tuneInfo'><tr><th>Rule</th><th>P</th><th>I</th><th>D</th>"
+        "<th>Overshoot (&deg;C)</th><th>Settling (s)</th></tr>";
+
+    for (int r=0; r<Autotune::nRules; r++) {
+
+        PID_Gains GL = Autotune::gains(TuneResult[0], r);
+        PID_Gains GR = Autotune::gains(TuneResult[1], r);
+        PID_Gains G = GL.P<=GR.P ? GL : GR;
+
+        Step_Response SL = Autotune::validate(TuneResult[0], G);
+        Step_Response SR = Autotune::validate(TuneResult[1], G);
+
+        S += QString("<tr><th>%1</th><td>%2</td><td>%3</td><td>%4</td><td>%5 / %6</td><td>%7 / %8</td></tr>")
+                .arg(Autotune::ruleName(r)).arg(G.P, 0, 'f', 2).arg(G.I, 0, 'f', 2).arg(G.D, 0, 'f', 2)
+                .arg(SL.overshoot, 0, 'f', 2).arg(SR.overshoot, 0, 'f', 2)
+                .arg(SL.settling<0 ? QString("-") : QString::number(SL.settling, 'f', 0))
+                .arg(SR.settling<0 ? QString("-") : QString::number(SR.settling, 'f', 0));
+    }
+    S += "</table>";
+    qInfo().nospace() << qPrintable(S);
+
+    // Applied only if it settles on both identified zones
+    int rule = ui->TuneRule->currentIndex();
+    PID_Gains GL = Autotune::gains(TuneResult[0], rule);
+    PID_Gains GR = Autotune::gains(TuneResult[1], rule);
+    PID_Gains G = GL.P<=GR.P ? GL : GR;
+    if (Autotune::validate(TuneResult[0], G).settling<0 || Autotune::validate(TuneResult[1], G).settling<0) {
+        qWarning() << Autotune::ruleName(rule) << "gains do not settle on the identified zones, gains left unchanged";
+        return;
+    }
+
+    applyTuneRule(rule);
+
+}
+
+void MainWindow::applyTuneRule(int rule) {
+
+    if (!TuneResult[0].valid || !TuneResult[1].valid) { return; }
+
+    // Gains are shared by both zones: keep the more conservative proposal
+    PID_Gains GL = Autotune::gains(TuneResult[0], rule);
+    PID_Gains GR = Autotune::gains(TuneResult[1], rule);
+    PID_Gains G = GL.P<=GR.P ? GL : GR;
+
+    ui->Pcoeff->setValue(G.P);
+    ui->Icoeff->setValue(G.I);
+    ui->Dcoeff->setValue(G.D);
+    setP();
+    setI();
+    setD();
+
+    qInfo() << "Applied" << Autotune::ruleName(rule) << "gains";
+
+}
+
+void MainWindow::saveGains() {
+
+    QSettings Settings(progPath + "Settings.conf", QSettings::IniFormat);
+    Settings.beginGroup("Rig_" + Link->RigId);
+
+    Settings.setValue("P", ui->Pcoeff->value());
+    Settings.setValue("I", ui->Icoeff->value());
+    Settings.setValue("D", ui->Dcoeff->value());
+
+    // Identified models, when available
+    for (int z=0; z<2; z++) {
+        if (!TuneResult[z].valid) { continue; }
+        QString zone(z ? "Right/" : "Left/");
+        Settings.setValue(zone + "K", TuneResult[z].Model.K);
+        Settings.setValue(zone + "tau", TuneResult[z].Model.tau);
+        Settings.setValue(zone + "L", TuneResult[z].Model.L);
+        Settings.setValue(zone + "ambient", TuneResult[z].Model.ambient);
+        Settings.setValue(zone + "dt", TuneResult[z].dt);
+    }
+
+    Settings.endGroup();
+    qInfo() << "PID gains saved for rig" << qPrintable(Link->RigId);
+
+}
+
+void MainWindow::loadGains() {
+
+    QSettings Settings(progPath + "Settings.conf", QSettings::IniFormat);
+    Settings.beginGroup("Rig_" + Link->RigId);
+
+    if (Settings.contains("P")) {
+
+        ui->Pcoeff->setValue(Settings.value("P").toDouble());
+        ui->Icoeff->setValue(Settings.value("I").toDouble());
+        ui->Dcoeff->setValue(Settings.value("D").toDouble());
+        setP();
+        setI();
+        setD();
+
+        qInfo() << "PID gains loaded for rig" << qPrintable(Link->RigId);
+    }
+
+    Settings.endGroup();
+
+}
+
 /* ====================================================================== *\
 |    PROTOCOLS                                                             |
 \* ====================================================================== */
@@ -534,171 +994,252 @@ void MainWindow::toggleProtocol(bool b) {
 
     if (ui->ProtocolRun->isChecked()) {
 
-        // --- Load protocol
-        QFile *PFile = new QFile(ui->ProtocolPath->text());
+        // --- Compile protocol
+        QElapsedTimer T;
+        T.start();
+
+        if (!Program.load(ui->ProtocolPath->text())) {
+
+            qWarning() << "Protocol rejected:" << qPrintable(ui->ProtocolPath->text());
+            foreach (const QString &E, Program.Errors) { qWarning() << qPrintable(E); }
 
-        if (!PFile->open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qWarning() << "Unable to load \"" << PFile->fileName() << "\"";
+            ui->ProtocolRun->blockSignals(true);
+            ui->ProtocolRun->setChecked(false);
+            ui->ProtocolRun->blockSignals(false);
             return;
-        };
+        }
 
-        QTextStream stream(PFile);
-        Protocol.clear();
-        QString line;
-        while (stream.readLineInto(&line)) {
+        qInfo() << TITLE_2 << "Protocol";
+        qInfo().noquote() << Program.Program.size() << "instructions compiled in"
+                          << QString::number(T.nsecsElapsed()*1e-6, 'f', 2) << "ms, planned duration"
+                          << hms(Program.duration());
 
-            // --- Remove empty lines and comments
-            if (line.isEmpty() || line.left(1) == "#") { continue; }
+        // --- New history for the run
+        for (int i=0; i<4; i++) { History[i].clear(); }
+        HistoryOffset = 0;
+        HistoryLast = 0;
+        HistoryFollow = true;
 
-            Protocol.append(line);
+        // Predictions of another protocol are dropped
+        if (PredictionPath!=Program.Path) {
+            for (int z=0; z<2; z++) { Prediction[z].clear(); }
         }
+        PredictionAlign = true;
 
         // --- Start protocol
         ui->ProtocolTime->setStyleSheet("QLabel { color: firebrick;}");
-        ProtocolTime.start();
         timerProtocol->start(1000);
-        ProtoLoop();
+        Engine->load(Program);
+        Engine->Left = TargetLeftValue;
+        Engine->Right = TargetRightValue;
+        Engine->start();
 
     } else {
 
-        // Clear Protocol
+        // Clear Protocol; a ramp in progress is frozen on the board too
+        if (Engine->isRamping()) {
+            double left, right;
+            Engine->current(left, right);
+            protocolTargets(left, right);
+        }
+        Engine->stop();
+        if (Engine->Steps) {
+            qInfo().noquote() << "Protocol timing:" << Engine->Steps << "steps, worst lateness"
+                              << QString::number(Engine->WorstLateness, 'f', 1) << "ms, cumulative"
+                              << QString::number(Engine->TotalLateness, 'f', 1) << "ms";
+        }
+        ui->ProtocolTime->setToolTip(QString());
         ui->ProtocolTime->setText("00:00:00");
         ui->ProtocolTime->setStyleSheet("QLabel { color: black;}");
-        Protocol.clear();
         timerProtocol->stop();
 
         // Stop recording
         ui->Record->setChecked(false);
 
+        // Timing of the whole run
+        if (Trace::isEnabled()) { writeTrace(); }
+
     }
 
 }
 
 void MainWindow::ProtocolLoop() {
-// Synchronous loop (every 1s) for display
+// Synchronous loop (every 1s) for display, on the engine clock
 
-    // Ellapsed time
-    int m = ProtocolTime.elapsed();
-    int hours = floor(m/3600000); m -= hours*3600000;
-    int minutes = floor(m/60000); m -= minutes*60000;
-    int seconds = floor(m/1000);
-
-    ui->ProtocolTime->setText(QString("%1").arg(hours, 2, 10, QChar('0')) + ":" +
-                              QString("%1").arg(minutes, 2, 10, QChar('0')) + ":" +
-                              QString("%1").arg(seconds, 2, 10, QChar('0')));
+    TRACE_SPAN("ProtoLoop");
+    ui->ProtocolTime->setText(hms(Engine->elapsed()));
+    ui->ProtocolTime->setToolTip(QString("Line %1, %2 left").arg(Engine->line()).arg(hms(Engine->remaining())));
 
 }
 
-void MainWindow::ProtoLoop() {
-// Asynchronous loop for processing protocol commands
-
-    // --- End of protocol
-    if (!Protocol.count()) {
-        ui->ProtocolRun->setChecked(false);
-        return;
-    }
-
-    // Loop by default
-    bool brem = true;
-    bool bcont = true;
-
-    // --- Parse first command
-    QStringList list = Protocol[0].split(":");
-
-    if (list.at(0)=="print") {
-
-        // --- PRINT ----------------------------
+QString MainWindow::hms(qint64 ms) {
 
-        qInfo() << qPrintable(list.at(1));
+    qint64 s = ms/1000;
+    return QString("%1:%2:%3").arg(s/3600, 2, 10, QChar('0')).arg((s/60)%60, 2, 10, QChar('0')).arg(s%60, 2, 10, QChar('0'));
 
-    } else if (list.at(0)=="data") {
+}
 
-        // --- DATA ---------------------------
+/* === Protocol actions ============================================== */
 
-        if (list.at(1)=="create directory") {
+void MainWindow::protocolPrint(QString text) { qInfo() << qPrintable(text); }
 
-            // Reset run number
-            nRun++;
+void MainWindow::protocolDirectory() {
 
-            // Create run directory
-            if (!QDir(ui->DataPath->text()).exists()) { QDir().mkdir(ui->DataPath->text()); }
-            RunPath = QString(ui->DataPath->text() + "Run %1" + filesep).arg(nRun, 2, 10, QLatin1Char('0'));
-            if (!QDir(RunPath).exists()) { QDir().mkdir(RunPath); }
+    Run_Parameters P;
+    P << qMakePair(QString("Strain"), ui->Strain->text());
+    P << qMakePair(QString("Spawning_date"), ui->SpawningDate->date().toString("yyyy-MM-dd"));
+    P << qMakePair(QString("Age"), ui->Age->text());
 
-            // Save protocol file
-            QFile::copy(ui->ProtocolPath->text(), RunPath + filesep + "Protocol.txt");
+    if (Rec->createRun(ui->DataPath->text(), Program.Path, P)) {
+        Clips->setDirectory(Rec->RunPath + "Clips" + filesep);
+    }
 
-            // Save parameters
-            QFile fparam(RunPath + filesep + "Parameters.txt");
-            if (fparam.open(QIODevice::ReadWrite)) {
-                QTextStream stream(&fparam);
-                stream << "Strain\t" << ui->Strain->text() << endl;
-                stream << "Spawning_date\t" << ui->SpawningDate->date().toString("yyyy-MM-dd") << endl;
-                stream << "Age\t" << ui->Age->text() << endl;
-            }
+}
 
-        }
+void MainWindow::protocolCamera(bool b) {
 
-    } else if (list.at(0)=="camera") {
+    // A new run restarts the frame count
+    if (b && ui->Record->isChecked()) { Rec->start(); }
+    ui->Record->setChecked(b);
 
-        // --- CAMERA ---------------------------
+}
 
-        if (list.at(1)=="start") {
+void MainWindow::protocolClip(QString label) { triggerClip(label); }
 
-            nFrame = 0;
-            ui->Record->setChecked(true);
+void MainWindow::protocolRegulation(bool b) {
 
-        } else if (list.at(1)=="stop") {
+    ui->Regulation->setChecked(b);
+    setRegulation();
 
-            ui->Record->setChecked(false);
+}
 
-        }
+void MainWindow::protocolTargets(double left, double right) {
 
-    } else if (list.at(0)=="regulation") {
+    ui->TargetLeft->setText(QString::number(left));
+    ui->TargetRight->setText(QString::number(right));
+    setTargets();
 
-        // --- REGULATION -----------------------
+}
 
-        // NOT WORKING. WHY ?!?
+void MainWindow::protocolRamp(double left, double right, qint64 ms) {
 
-        if (list.at(1)=="start") {
-            ui->Regulation->setChecked(true);
-            send(QString("start"));
-        } else if (list.at(1)=="stop") {
-            ui->Regulation->setChecked(false);
-            send(QString("stop"));
-        }
-        setRegulation();
+    // Interpolated on the board
+    send(QString("ramp %1 %2 %3").arg(left).arg(right).arg(ms));
 
-    }  else if (list.at(0)=="targets") {
+}
 
-        // --- TARGETS --------------------------
+void MainWindow::protocolSetpoints(double left, double right) {
 
-        ui->TargetLeft->setText(list.at(1));
-        ui->TargetRight->setText(list.at(2));
-        setTargets();
+    // Display only
+    ui->TargetLeft->setText(QString::number(left, 'f', 2));
+    ui->TargetRight->setText(QString::number(right, 'f', 2));
+    TargetLeftValue = left;
+    TargetRightValue = right;
 
-    } else if (list.at(0)=="wait") {
+}
 
-        // --- WAIT -----------------------------
+void MainWindow::protocolFinished() { ui->ProtocolRun->setChecked(false); }
 
-        QTimer::singleShot(list.at(1).toInt(), this, SLOT(ProtoLoop()));
-        Protocol.removeFirst();
-        return;
+/* === Simulation ==================================================== */
 
-    } else {
+void MainWindow::simulateProtocol() {
 
-        qDebug() << "Unknown command:" << Protocol[0];
+    Protocol Prog;
+    if (!Prog.load(ui->ProtocolPath->text())) {
+        qWarning() << "Protocol rejected:" << qPrintable(ui->ProtocolPath->text());
+        foreach (const QString &E, Prog.Errors) { qWarning() << qPrintable(E); }
         return;
     }
 
-    // --- Remove first command
-    Protocol.removeFirst();
+    // --- Plant models of the rig: saved, or from the last autotune
+    QSettings Settings(progPath + "Settings.conf", QSettings::IniFormat);
+    Settings.beginGroup("Rig_" + Link->RigId);
+
+    Plant_Params M[2];
+    double dt = 0;
+    for (int z=0; z<2; z++) {
+        QString zone(z ? "Right/" : "Left/");
+        if (Settings.contains(zone + "K")) {
+            M[z].K = Settings.value(zone + "K").toDouble();
+            M[z].tau = Settings.value(zone + "tau").toDouble();
+            M[z].L = Settings.value(zone + "L").toDouble();
+            M[z].ambient = Settings.value(zone + "ambient").toDouble();
+            dt = Settings.value(zone + "dt").toDouble();
+        } else if (TuneResult[z].valid) {
+            M[z] = TuneResult[z].Model;
+            dt = TuneResult[z].dt;
+        } else {
+            qWarning() << "No plant model for rig" << qPrintable(Link->RigId) << "- run and save the autotune of both zones first";
+            return;
+        }
+    }
+    Settings.endGroup();
+
+    // --- Fast-forward run, from the current temperatures
+    ProtocolSim Sim(M[0], M[1], dt);
+    Sim.P = ui->Pcoeff->value();
+    Sim.I = ui->Icoeff->value();
+    Sim.D = ui->Dcoeff->value();
+    if (!TempLeft.isEmpty()) { Sim.Initial[0] = TempLeft.last(); }
+    if (!TempRight.isEmpty()) { Sim.Initial[1] = TempRight.last(); }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    Sim.run(Prog);
+    QApplication::restoreOverrideCursor();
+
+    // --- Prediction in the history plot, from now until the run starts
+    for (int z=0; z<2; z++) {
+        Prediction[z].clear();
+        for (int i=0; i<Sim.Time.size(); i++) { Prediction[z].append(Sim.Time[i], Sim.Temp[z][i]); }
+    }
+    PredictionOffset = HistoryLast;
+    PredictionPath = Prog.Path;
+    HistoryFollow = true;
+    Replot->markDirty();
+
+    // --- Report
+    qInfo() << TITLE_2 << "Protocol simulation";
+    qInfo().noquote() << "Simulated" << hms(qRound64(Sim.Runtime*1000)) << "in" << Sim.Elapsed << "ms,"
+                      << Sim.Steps.size() << "steps, band" << Sim.Band << "°C";
+
+    QString S = "<table class='simInfo'><tr><th>Line</th><th>Start</th><th>Duration (s)</th><th>Targets (&deg;C)</th>"
+                "<th>In band (%)</th><th>Settling (s)</th><th>Saturated (%)</th><th>End (&deg;C)</th></tr>";
+
+    int nRows = qMin(Sim.Steps.size(), 200);
+    for (int i=0; i<nRows; i++) {
+        const Sim_Step &St = Sim.Steps[i];
+        QString settling[2];
+        for (int z=0; z<2; z++) { settling[z] = St.settling[z]<0 ? QString("never") : QString::number(St.settling[z], 'f', 1); }
+        S += QString("<tr><th>%1</th><td>%2</td><td>%3</td><td>%4 / %5</td><td>%6 / %7</td><td>%8 / %9</td>")
+                .arg(St.line).arg(hms(qRound64(St.start*1000))).arg(St.duration, 0, 'f', 1)
+                .arg(St.target[0], 0, 'f', 2).arg(St.target[1], 0, 'f', 2)
+                .arg(100*St.inBand[0]/St.duration, 0, 'f', 1).arg(100*St.inBand[1]/St.duration, 0, 'f', 1)
+                .arg(settling[0]).arg(settling[1]);
+        S += QString("<td>%1 / %2</td><td>%3 / %4</td></tr>")
+                .arg(100*St.saturated[0]/St.duration, 0, 'f', 1).arg(100*St.saturated[1]/St.duration, 0, 'f', 1)
+                .arg(St.end[0], 0, 'f', 2).arg(St.end[1], 0, 'f', 2);
+    }
+    S += "</table>";
+    qInfo().nospace() << qPrintable(S);
 
-    // --- Continue
-    if (bcont) { ProtoLoop(); }
+    if (Sim.Steps.size()>nRows) { qInfo() << Sim.Steps.size()-nRows << "more steps not shown"; }
 
 }
 
 MainWindow::~MainWindow() {
+
+    // Clip in progress
+    Clips->finish();
+
+    // The acquisition thread publishes until it stops
+    Camera->stopCamera();
+    delete Stream;
+
+    // Last messages to the session log, beyond the batch of a drain
+    UpdateMessage();
+    Message MSG;
+    while (Messages.pop(MSG)) { Session->write(MSG); }
+    Session->stop();
+
     delete ui;
 }
@@ -8,21 +8,35 @@
 #include <QScrollBar>
 #include <QVector>
 #include <QDesktopWidget>
-#include <QSerialPort>
-#include <QSerialPortInfo>
 #include <QTimer>
 #include <QTime>
 #include <QFile>
 #include <QFontDatabase>
 #include <QHashIterator>
 #include <QThread>
-#include <QImageWriter>
 #include <QFileDialog>
 #include <QVector>
+#include <QSettings>
+#include <QElapsedTimer>
 
 #include "qcustomplot.h"
 #include "MsgHandler.h"
+#include "LogSink.h"
 #include "Camera_FLIR.h"
+#include "Autotune.h"
+#include "SerialParser.h"
+#include "SerialLink.h"
+#include "Recorder.h"
+#include "ClipRecorder.h"
+#include "ClockSync.h"
+#include "TimeSeries.h"
+#include "ReplotScheduler.h"
+#include "MinMaxPyramid.h"
+#include "Protocol.h"
+#include "ProtocolSim.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
 
 // === Mainwindow class ====================================================
 
@@ -44,8 +58,6 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
-    void setTemperatures(QStringList);
-
 public slots:
 
     // Messages
@@ -58,28 +70,51 @@ public slots:
     // Protocols
     void BrowseProtocol();
     void toggleProtocol(bool);
-    void ProtoLoop();
     void ProtocolLoop();
+    void protocolPrint(QString);
+    void protocolDirectory();
+    void protocolCamera(bool);
+    void protocolClip(QString);
+    void protocolRegulation(bool);
+    void protocolTargets(double, double);
+    void protocolRamp(double, double, qint64);
+    void protocolSetpoints(double, double);
+    void protocolFinished();
+    void simulateProtocol();
     void updateAge(QDate);
 
     // Serial communication
     void checkSerial();
-    void readSerial();
+    void serialLine(QByteArray);
+    void setTemperatures(const Serial_Sample&);
 
     // Camera
     void InitCamera();
     void ArmCamera();
     void UpdateCamera();
-    void updateDisplay(QPixmap);
+    void updateDisplay(QImage);
+    void recordFrame(Image_FLIR);
+    void frameSaved();
+    void toggleRecord(bool);
     void SetAvgVal(bool);
 
     // Images
     void snapshot();
+    void triggerClip(QString label = QString());
+    void clipSaved(QString, int);
 
     // Lighting
     void setLight();
 
+    // Tracing
+    void toggleTrace();
+
     // Temperature
+    void setPlotWindow();
+    void plotRateChanged(double);
+    void updateHistory();
+    void historyRangeChanged(QCPRange);
+    void followHistory();
     void setTargets();
     void setRegulation();
 
@@ -88,6 +123,12 @@ public slots:
     void setI();
     void setD();
 
+    // Autotune
+    void toggleAutotune(bool);
+    void applyTuneRule(int);
+    void saveGains();
+    void loadGains();
+
 private:
 
     // --- Properties ---------------------------
@@ -97,34 +138,68 @@ private:
 
     // Windows management
     Ui::MainWindow *ui;
-    QShortcut *s_Close;
+    QShortcut *s_Close, *s_Trace;
+
+    // Messages
+    int LogMaxBlocks, LogBatchMax;
+    LogSink *Session;
 
     // Plots
-    QVector<double> Time, TempLeft, TempRight, TargetLeft, TargetRight;
+    TimeSeries TempLeft, TempRight, TargetLeft, TargetRight;
+    TimeSeries MotionLeft, MotionRight;
+    double MotionSum[2], MotionMax;
+    int MotionCount;
     double TargetLeftValue, TargetRightValue;
+    int PlotRateMax;
+    ReplotScheduler *Replot;
+
+    // History (left, right, left target, right target)
+    MinMaxPyramid History[4];
+    double HistoryOffset, HistoryLast;
+    bool HistoryFollow, HistoryUpdating;
+    int HistoryIdleMax;
+
+    // Simulated temperatures (left, right), aligned on the run start
+    MinMaxPyramid Prediction[2];
+    double PredictionOffset;
+    bool PredictionAlign;
+    QString PredictionPath;
 
     // Serial communication
-    QSerialPort *Serial;
-    bool skipSerial;
+    SerialLink *Link;
+    ClockSync BoardClock;
+    Metric_Gauge *mErrorLeft, *mErrorRight;
+
+    // Monitoring
+    MetricsServer *Monitor;
 
     // Camera
     Camera_FLIR *Camera;
-    QPixmap pixmap;
+    ClockSync CameraClock;
+    FrameStream *Stream;
 
     // Run
     int SaveRate;
     QTimer *timerGrab;
-    int nRun;
-    qint64 nFrame;
-    QString RunPath;
-    QImageWriter *ImgWriter;
+    Recorder *Rec;
+    ClipRecorder *Clips;
+    QImage LastFrame;
+    qint64 LastTimestamp, LastTime;
+    int nSnap;
 
     // Protocols
-    QVector<QString> Protocol;
-    QTime ProtocolTime;
+    Protocol Program;
+    ProtocolEngine *Engine;
     QTimer *timerProtocol;
     QString comment;
 
+    // Autotune
+    Autotune Tuner;
+    Relay_Result TuneResult[2];
+    double TuneAmplitude, TuneHysteresis;
+    QTime TuneTime;
+    int TuneTimeout;
+
     // --- Methods ------------------------------
 
     // Serial communication
@@ -134,6 +209,19 @@ private:
     // Directories
     void updatePath();
 
+    // Protocols
+    static QString hms(qint64 ms);
+
+    // History
+    void loadHistory();
+
+    // Tracing
+    void writeTrace();
+
+    // Autotune
+    void startTuneZone(char);
+    void finishAutotune();
+
 };
 
 #endif // MAINWINDOW_H
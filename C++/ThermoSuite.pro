@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# All ThermoMaster targets
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    ThermoMaster \
+    ThermoCLI \
+    ThermoCalib \
+    ThermoLog \
+    Bench
@@ -0,0 +1,193 @@
+"""Reader of the ThermoMaster shared-memory frame stream.
+
+The acquisition (GUI or thermomaster-cli) publishes every frame in a POSIX
+shared-memory ring, /dev/shm/thermomaster by default. The layout is
+described in C++/ThermoMaster/ThermoStream.h; this module mirrors it.
+
+Frames are read in place. Each slot carries a sequence number, odd while
+the writer fills it and 2(n+1) once frame n is complete: a frame is valid
+if the sequence is the same before and after it has been used. The writer
+never waits, so that a reader too slow for the frame rate skips frames.
+
+    from thermostream import Stream
+
+    with Stream() as S:
+        for F in S.frames():
+            print(F.index, F.timestamp, F.temp_left, F.image.mean())
+
+Zero-copy use, where the check comes after the processing:
+
+    n = S.latest_index()
+    F, seq = S.view(n)
+    result = analyse(F.image)
+    if not S.valid(n, seq):
+        result = None       # overwritten meanwhile
+
+Requires numpy. The checks rely on the ordering of loads of the x86
+family, where the rig computers are.
+"""
+
+import mmap
+import os
+import struct
+import time
+from collections import namedtuple
+
+import numpy as np
+
+MAGIC = 0x4D524854          # "THRM"
+VERSION = 1
+GRAY8 = 1
+
+_HEADER = struct.Struct('<IIIIQQIiQ64s')
+_SLOT = struct.Struct('<QQqqIIIIddd')
+_SLOT_SIZE = 128            # sizeof(ThermoStream_Slot)
+_PUBLISHED = 40             # offsetof(ThermoStream_Header, Published)
+_STATE = 32                 # offsetof(ThermoStream_Header, State)
+
+Frame = namedtuple('Frame', 'index timestamp frame_id temp_left temp_right mean image')
+
+
+class Stream:
+    """Read-only attachment to the frame ring."""
+
+    def __init__(self, name='/thermomaster'):
+        self.name = name.lstrip('/')
+        self.skipped = 0
+        self._map = None
+        self.attach()
+
+    # --- Attachment ------------------------------------------------------
+
+    def attach(self, timeout=None):
+        """Maps the ring, waiting for the writer up to timeout seconds (None: forever).
+
+        The object is sized before the writer fills its header: a ring is
+        only taken once it is marked open (State 1), which the writer does
+        last.
+        """
+        self.close()
+        t0 = time.monotonic()
+        while True:
+            try:
+                with open('/dev/shm/' + self.name, 'rb') as f:
+                    size = os.fstat(f.fileno()).st_size
+                    if size >= 4096:
+                        self._map = mmap.mmap(f.fileno(), size, access=mmap.ACCESS_READ)
+                        if not self.closed and struct.unpack_from('<I', self._map, 0)[0] != 0:
+                            break
+                        self.close()
+            except FileNotFoundError:
+                pass
+            if timeout is not None and time.monotonic() - t0 > timeout:
+                raise TimeoutError('No frame stream /%s' % self.name)
+            time.sleep(0.1)
+
+        (magic, version, self.header_size, self.slots, self.slot_size, self.capacity,
+         state, self.writer_pid, _, setup) = _HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC or version != VERSION:
+            self.close()
+            raise ValueError('/%s is not a ThermoMaster frame stream (version %d)' % (self.name, VERSION))
+        self.setup = setup.split(b'\0', 1)[0].decode('utf-8', 'replace')
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    @property
+    def closed(self):
+        """True once the writer has closed or replaced the ring."""
+        return struct.unpack_from('<I', self._map, _STATE)[0] == 0
+
+    # --- Frames ----------------------------------------------------------
+
+    def latest_index(self):
+        """Index of the last published frame, -1 if none."""
+        return struct.unpack_from('<Q', self._map, _PUBLISHED)[0] - 1
+
+    def _offset(self, n):
+        return self.header_size + (n % self.slots) * self.slot_size
+
+    def _sequence(self, n):
+        return struct.unpack_from('<Q', self._map, self._offset(n))[0]
+
+    def view(self, n):
+        """Frame n in place, and the sequence to check with valid(); (None, 0) if it is gone."""
+        off = self._offset(n)
+        seq = self._sequence(n)
+        if seq != 2 * (n + 1):
+            return None, 0
+        (_, index, timestamp, frame_id, w, h, stride, fmt,
+         temp_left, temp_right, mean) = _SLOT.unpack_from(self._map, off)
+        if fmt != GRAY8:
+            return None, 0
+        image = np.frombuffer(self._map, dtype=np.uint8, count=stride * h, offset=off + _SLOT_SIZE)
+        image = image.reshape(h, stride)[:, :w]
+        return Frame(index, timestamp, frame_id, temp_left, temp_right, mean, image), seq
+
+    def valid(self, n, seq):
+        """True if frame n has not been overwritten since view()."""
+        return seq != 0 and self._sequence(n) == seq
+
+    def read(self, n):
+        """Copy of frame n, None if it has been overwritten."""
+        F, seq = self.view(n)
+        if F is None:
+            return None
+        F = F._replace(image=F.image.copy())
+        return F if self.valid(n, seq) else None
+
+    def frames(self, start=None, poll=0.001):
+        """Copies of the frames as they come, from the next one by default.
+
+        Frames overwritten before being read are counted in self.skipped.
+        The ring is attached again when the writer replaces it.
+        """
+        n = self.latest_index() + 1 if start is None else start
+        while True:
+            if self.closed:
+                self.attach()
+                n = self.latest_index() + 1
+                continue
+            last = self.latest_index()
+            if last < n:
+                time.sleep(poll)
+                continue
+            # Too far behind: jump to the oldest frame still in the ring
+            if last - n >= self.slots - 1:
+                self.skipped += last - self.slots + 2 - n
+                n = last - self.slots + 2
+            F = self.read(n)
+            if F is None:
+                self.skipped += 1
+            else:
+                yield F
+            n += 1
+
+
+if __name__ == '__main__':
+
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Frame rate and temperatures of the ThermoMaster frame stream.')
+    parser.add_argument('name', nargs='?', default='/thermomaster', help='shared-memory name')
+    args = parser.parse_args()
+
+    with Stream(args.name) as S:
+        print('Attached to /%s (%s, writer %d, %d slots)' % (S.name, S.setup, S.writer_pid, S.slots))
+        t0, count = time.monotonic(), 0
+        for F in S.frames():
+            count += 1
+            t = time.monotonic()
+            if t - t0 >= 1:
+                print('frame %d  %dx%d  %.1f fps  mean %.1f  TL %.2f  TR %.2f  skipped %d'
+                      % (F.index, F.image.shape[1], F.image.shape[0], count / (t - t0),
+                         F.mean, F.temp_left, F.temp_right, S.skipped))
+                t0, count = t, 0